@@ -0,0 +1,131 @@
+// bench/pmr.cpp - request-scoped vx::vector on std::pmr resources and malloc()
+//
+// Build and run from the repository root (vx.h is implemented as C):
+//      cc -std=c99 -O2 -DVX_ALLOCATOR -DVX_IMPLEMENT -x c -c vx.h -o vx.o
+//      c++ -std=c++17 -O2 -DVX_ALLOCATOR -I. bench/pmr.cpp vx.o -o pmr
+//      ./pmr [requests]
+//
+// Each simulated request builds a handful of vectors of a few dozen to a few
+// thousand units by push_back(), as a request handler would for its scratch
+// lists, and then drops them all. This is run with the vectors on malloc(),
+// on a std::pmr::monotonic_buffer_resource released after each request, and
+// on a std::pmr::unsynchronized_pool_resource.
+
+#include "vx.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory_resource>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t vectors_per_request = 16;
+
+struct row {
+	std::uint64_t id;
+	double        score;
+};
+
+// The sizes of the vectors of each request, fixed up front so that every
+// resource sees the same sequence.
+std::vector<std::size_t> make_sizes(std::size_t requests)
+{
+	std::vector<std::size_t> sizes(requests * vectors_per_request);
+	std::uint64_t            x = 88172645463325252ull;
+
+	for (auto &size : sizes) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		size = 16 + x % 2048;
+	}
+
+	return sizes;
+}
+
+std::uint64_t request(const std::size_t *sizes, std::pmr::memory_resource *r)
+{
+	std::uint64_t sum = 0;
+	vx::vector<std::uint32_t> ids[vectors_per_request / 2];
+	vx::vector<row>           rows[vectors_per_request / 2];
+
+	for (std::size_t i = 0; i < vectors_per_request / 2; i++) {
+		if (r) {
+			ids[i]  = vx::vector<std::uint32_t>(r);
+			rows[i] = vx::vector<row>(r);
+		}
+		for (std::size_t j = 0; j < sizes[2 * i]; j++) {
+			ids[i].push_back(static_cast<std::uint32_t>(j));
+		}
+		for (std::size_t j = 0; j < sizes[2 * i + 1]; j++) {
+			rows[i].push_back({j, 0.5 * j});
+		}
+		sum += ids[i].back() + rows[i].back().id;
+	}
+
+	return sum;
+}
+
+// Runs 'each' for every request and prints the time per request, relative to
+// 'base' if given. Returns the time per request in microseconds.
+template <typename F>
+double run(const char *name, std::size_t requests, F &&each, double base = 0)
+{
+	using clock = std::chrono::steady_clock;
+
+	clock::time_point start = clock::now();
+	std::uint64_t     sum   = 0;
+
+	for (std::size_t i = 0; i < requests; i++) {
+		sum += each(i);
+	}
+
+	std::chrono::duration<double> t  = clock::now() - start;
+	double                        us = t.count() / requests * 1e6;
+
+	std::printf("%-14s %8.2f us/request", name, us);
+	if (base) {
+		std::printf(" %6.2fx", base / us);
+	}
+	std::printf("  (%llu)\n", static_cast<unsigned long long>(sum));
+
+	return us;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	std::size_t requests = argc > 1 ? std::strtoul(argv[1], nullptr, 10)
+	                                : 100000;
+	auto sizes = make_sizes(requests);
+	auto at    = [&](std::size_t i) {
+		return &sizes[i * vectors_per_request];
+	};
+
+	double base = run("malloc", requests, [&](std::size_t i) {
+		return request(at(i), nullptr);
+	});
+
+	// The arena's initial buffer is allocated once and reused after each
+	// release(), as a server would keep one per worker thread. It is large
+	// enough for a whole request, including the blocks left behind by
+	// growth, which a monotonic resource never reuses.
+	std::vector<unsigned char>          buffer(std::size_t(1) << 20);
+	std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size());
+	run("monotonic", requests, [&](std::size_t i) {
+		std::uint64_t sum = request(at(i), &arena);
+		arena.release();
+		return sum;
+	}, base);
+
+	std::pmr::unsynchronized_pool_resource pool;
+	run("pool", requests, [&](std::size_t i) {
+		return request(at(i), &pool);
+	}, base);
+
+	return 0;
+}
@@ -0,0 +1,85 @@
+// bench/search.c - sorted and Eytzinger-layout search against bsearch()
+//
+// Build and run from the repository root:
+//      cc -std=c99 -O2 -I. bench/search.c -o search && ./search [keys]
+//
+// Searches a sorted vector of 'keys' (10^8 by default, 400 MB) int32_t keys,
+// and an Eytzinger copy of it, for two million random keys, half of them
+// present, and prints the time per search.
+
+#define _POSIX_C_SOURCE 199309L
+#define VX_IMPLEMENT
+#include "vx.h"
+
+#include <time.h>
+
+enum { QUERIES = 2000000 };
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int cmp_i32(const void *a, const void *b)
+{
+	int32_t x = *(const int32_t *)a, y = *(const int32_t *)b;
+	return (x > y) - (x < y);
+}
+
+// Runs 'expr' for each query key 'k', and prints the time per search, with a
+// sum of the results so that none is optimized away.
+#define RUN(name, expr)                                                        \
+	do {                                                                   \
+		size_t sum = 0;                                                \
+		double t   = now();                                            \
+		for (size_t i = 0; i < QUERIES; i++) {                         \
+			int32_t k = q[i];                                      \
+			sum += (size_t)(expr);                                 \
+		}                                                              \
+		t = now() - t;                                                 \
+		printf("%-28s %7.1f ns  (%zu)\n", name, t / QUERIES * 1e9,     \
+		       sum);                                                   \
+	} while (0)
+
+int main(int argc, char **argv)
+{
+	size_t   n = argc > 1 ? (size_t)atol(argv[1]) : 100000000;
+	uint64_t x = 88172645463325252ull;
+
+	// Even keys, so that odd queries miss.
+
+	int32_t *v = vx_new(int32_t, n, NULL);
+	int32_t *q = malloc(QUERIES * sizeof(*q));
+	if (!v || !q || n > INT32_MAX / 2) {
+		return 1;
+	}
+	for (size_t i = 0; i < n; i++) {
+		v[i] = (int32_t)(i * 2);
+	}
+	for (size_t i = 0; i < QUERIES; i++) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		q[i] = (int32_t)(x % (2 * n));
+	}
+
+	int32_t *e = vx_eytzinger_build(v);
+	if (!e) {
+		return 1;
+	}
+
+	RUN("bsearch", bsearch(&k, v, n, sizeof(*v), cmp_i32) != NULL);
+	RUN("vx_lower_bound", vx_lower_bound(v, &k, cmp_i32));
+	RUN("vx_lower_bound_i32", vx_lower_bound_i32(v, k));
+	RUN("vx_lower_bound_prefetch_i32", vx_lower_bound_prefetch_i32(v, k));
+	RUN("vx_eytzinger_search", vx_eytzinger_search(e, &k, cmp_i32));
+	RUN("vx_eytzinger_search_i32", vx_eytzinger_search_i32(e, k));
+
+	vx_free(v);
+	vx_free(e);
+	free(q);
+
+	return 0;
+}
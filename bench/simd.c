@@ -0,0 +1,148 @@
+// bench/simd.c - the SIMD kernels at every level the CPU supports
+//
+// Build and run from the repository root:
+//      cc -std=c99 -O2 -I. bench/simd.c -o simd && ./simd [count]
+//
+// Switches between levels with vx_simd_set_level(), which is what the VX_SIMD
+// environment variable does at startup, and times the kernels behind
+// vx_find() and vx_count_eq() (scan), vx_set_intersect_u32(), vx_gather(),
+// vx_deinterleave() and vx_interleave() at each. Levels above what the CPU
+// supports are skipped. Times are in nanoseconds per unit of the input.
+
+#define _POSIX_C_SOURCE 199309L
+#define VX_IMPLEMENT
+#include "vx.h"
+
+#include <time.h>
+
+enum { REPS = 5 };
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t xorshift(uint64_t *x)
+{
+	*x ^= *x << 13;
+	*x ^= *x >> 7;
+	*x ^= *x << 17;
+	return *x;
+}
+
+// Keeps the result of each run alive without printing it.
+static volatile size_t sink;
+
+// Times 'expr' over REPS runs, each after an untimed 'prep', and prints the
+// best, per unit of 'n'.
+#define TIME(name, n, prep, expr)                                              \
+	do {                                                                   \
+		double best = 1e30;                                            \
+		for (int rep = 0; rep < REPS; rep++) {                         \
+			prep;                                                  \
+			double t = now();                                      \
+			sink     = (size_t)(expr);                             \
+			t        = now() - t;                                  \
+			best     = t < best ? t : best;                        \
+		}                                                              \
+		printf("  %-22s %7.3f ns\n", name, best / (n) * 1e9);          \
+	} while (0)
+
+int main(int argc, char **argv)
+{
+	size_t   n = argc > 1 ? (size_t)atol(argv[1]) : (size_t)1 << 24;
+	uint64_t x = 88172645463325252ull;
+
+	// Inputs: bytes and words to scan for a key which is absent, two sorted
+	// sets sharing about half their ids plus a set 1/64th the size, random
+	// indices to gather by, and 8-byte units to split into 4-byte fields.
+
+	uint8_t  *bytes = vx_new(uint8_t, n, NULL);
+	uint32_t *words = vx_new(uint32_t, n, NULL);
+	uint32_t *a     = vx_new(uint32_t, 0, NULL);
+	uint32_t *b     = vx_new(uint32_t, 0, NULL);
+	uint32_t *small = vx_new(uint32_t, 0, NULL);
+	uint32_t *idx   = vx_new(uint32_t, n, NULL);
+	uint64_t *wide  = vx_new(uint64_t, n, NULL);
+	uint32_t *out32 = vx_new(uint32_t, 0, NULL);
+	uint64_t *out64 = vx_new(uint64_t, 0, NULL);
+	uint32_t *set   = vx_new(uint32_t, 0, NULL);
+
+	if (!bytes || !words || !a || !b || !small || !idx || !wide || !out32
+	    || !out64 || !set || !vx_reserve(a, n) || !vx_reserve(b, n)
+	    || !vx_reserve(small, n / 64 + 1)) {
+		return 1;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		bytes[i] = (uint8_t)(i % 251);
+		words[i] = (uint32_t)i;
+		idx[i]   = (uint32_t)(xorshift(&x) % n);
+		wide[i]  = xorshift(&x);
+	}
+	for (uint32_t id = 0; vx_count(a) < (int)n; id++) {
+		uint64_t r = xorshift(&x);
+		if (r & 1) {
+			vx_push(a, id);
+		}
+		if (r & 2) {
+			vx_push(b, id);
+		}
+		if ((r & 252) == 0 && vx_count(small) < (int)(n / 64)) {
+			vx_push(small, id);
+		}
+	}
+	while (vx_count(b) < (int)n) {
+		vx_push(b, b[vx_count(b) - 1] + 1);
+	}
+
+	uint8_t  byte_key = 255;
+	uint32_t word_key = (uint32_t)n;
+
+	for (enum vx_simd level = VX_SIMD_SCALAR; level <= VX_SIMD_AVX512;
+	     level++) {
+		if (vx_simd_set_level(level) != level) {
+			printf("%s: not supported\n",
+			       vx_simd_name(level));
+			continue;
+		}
+		printf("%s:\n", vx_simd_name(level));
+
+		TIME("find u8", n, (void)0, vx_find(bytes, &byte_key));
+		TIME("find u32", n, (void)0, vx_find(words, &word_key));
+		TIME("count_eq u8", n, (void)0, vx_count_eq(bytes, &bytes[7]));
+		TIME("intersect even", 2 * n, (void)0,
+		     vx_set_intersect_u32(&set, a, b));
+		TIME("intersect 1:64", n / 64 + n, (void)0,
+		     vx_set_intersect_u32(&set, small, b));
+		TIME("gather u32", n, (void)0, vx_gather(words, idx, out32));
+		TIME("gather u64", n, (void)0, vx_gather(wide, idx, out64));
+
+		void *fields[2] = {NULL, NULL};
+		void *joined    = NULL;
+		TIME("deinterleave 8/4", n,
+		     (vx_free(fields[0]), vx_free(fields[1])),
+		     vx_deinterleave(wide, 4, fields));
+		TIME("interleave 4+4", n, vx_free(joined),
+		     joined = vx_interleave(fields, 2));
+
+		vx_free(joined);
+		vx_free(fields[0]);
+		vx_free(fields[1]);
+	}
+
+	vx_free(bytes);
+	vx_free(words);
+	vx_free(a);
+	vx_free(b);
+	vx_free(small);
+	vx_free(idx);
+	vx_free(wide);
+	vx_free(out32);
+	vx_free(out64);
+	vx_free(set);
+
+	return 0;
+}
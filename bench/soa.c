@@ -0,0 +1,124 @@
+// bench/soa.c - struct-of-arrays vectors against a vector of structs
+//
+// Build and run from the repository root:
+//      cc -std=c99 -O2 -I. bench/soa.c -o soa && ./soa [rows]
+//
+// Fills a vx_soa.h vector and an ordinary vector of the same 10-field, 48-byte
+// struct with 'rows' rows (2^22 by default), then times loops reading one and
+// two of the fields over every row, and pushing the rows in the first place.
+
+#define _POSIX_C_SOURCE 199309L
+#define VX_IMPLEMENT
+#include "vx_soa.h"
+
+#include <time.h>
+
+enum { PASSES = 20 };
+
+#define PARTICLE_FIELDS(X)                                                     \
+	X(float, x)                                                            \
+	X(float, y)                                                            \
+	X(float, z)                                                            \
+	X(float, vx)                                                           \
+	X(float, vy)                                                           \
+	X(float, vz)                                                           \
+	X(double, mass)                                                        \
+	X(uint32_t, id)                                                        \
+	X(uint32_t, flags)                                                     \
+	X(uint64_t, stamp)
+
+VX_SOA_DECLARE(particle, PARTICLE_FIELDS)
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char *name, double aos, double soa, double sum)
+{
+	printf("%-16s aos %7.3f s  soa %7.3f s  %5.2fx  (%g)\n", name, aos, soa,
+	       aos / soa, sum);
+}
+
+int main(int argc, char **argv)
+{
+	size_t n = argc > 1 ? (size_t)atol(argv[1]) : (size_t)1 << 22;
+
+	struct particle_soa soa;
+	struct particle    *aos = vx_new(struct particle, 0, NULL);
+	if (!aos || !particle_init(&soa, 0)) {
+		return 1;
+	}
+
+	double t_aos = now();
+	for (size_t i = 0; i < n; i++) {
+		struct particle row = {0};
+		row.x               = (float)i;
+		row.vx              = 1.0f;
+		row.mass            = 2.0;
+		row.id              = (uint32_t)i;
+		if (!vx_grow(aos, 1)) {
+			return 1;
+		}
+		aos[i] = row;
+	}
+	t_aos = now() - t_aos;
+
+	double t_soa = now();
+	for (size_t i = 0; i < n; i++) {
+		struct particle row = {0};
+		row.x               = (float)i;
+		row.vx              = 1.0f;
+		row.mass            = 2.0;
+		row.id              = (uint32_t)i;
+		if (!particle_push(&soa, row)) {
+			return 1;
+		}
+	}
+	t_soa = now() - t_soa;
+	report("push", t_aos, t_soa, (double)soa.count);
+
+	// One field: the sum of every id.
+
+	uint64_t ids = 0;
+	t_aos        = now();
+	for (int pass = 0; pass < PASSES; pass++) {
+		for (size_t i = 0; i < n; i++) {
+			ids += aos[i].id;
+		}
+	}
+	t_aos = now() - t_aos;
+	t_soa = now();
+	for (int pass = 0; pass < PASSES; pass++) {
+		for (size_t i = 0; i < n; i++) {
+			ids += soa.id[i];
+		}
+	}
+	t_soa = now() - t_soa;
+	report("sum id", t_aos, t_soa, (double)ids);
+
+	// Two fields: advancing x by vx.
+
+	t_aos = now();
+	for (int pass = 0; pass < PASSES; pass++) {
+		for (size_t i = 0; i < n; i++) {
+			aos[i].x += aos[i].vx;
+		}
+	}
+	t_aos = now() - t_aos;
+	t_soa = now();
+	for (int pass = 0; pass < PASSES; pass++) {
+		for (size_t i = 0; i < n; i++) {
+			soa.x[i] += soa.vx[i];
+		}
+	}
+	t_soa = now() - t_soa;
+	report("x += vx", t_aos, t_soa, (double)(aos[n - 1].x + soa.x[n - 1]));
+
+	vx_free(aos);
+	particle_free(&soa);
+
+	return 0;
+}
@@ -27,7 +27,12 @@
 // Linking:
 //      This is a single-header library. To use, add
 //              #define VX_IMPLEMENT
-//      to ONE .c file, prior to including the header.
+//      to ONE .c file, prior to including the header. The header may also be
+//      included from C++, but the implementation must be compiled as C; see
+//      vx.hpp for a C++ wrapper. The companion headers (vx_flatmap.h,
+//      vx_extsort.h, vx_groupby.h, vx_table.h, vx_soa.h, vx_bits.h,
+//      vx_roaring.h) include this header, and are implemented along with it
+//      when included after VX_IMPLEMENT is defined.
 //
 // Usage:
 //      The vectors produced by vx.h appear as plain heap-allocated arrays of
@@ -49,11 +54,31 @@
 //      size), where 'count' is the initial number of units, and 'unit_free' is
 //      an optional function for freeing individual units upon destruction (if
 //      units do not need to be freed, set this equal to NULL)
+// (TYPE *) vx_new_hinted(TYPE, size_t count, void (*unit_free)(void *),
+//                        struct vx_hint *hint)
+//      As vx_new(), but the vector starts with the capacity estimated by
+//      'hint', which should be a static object unique to the call site. When
+//      compiled with VX_HINTS, each vector remembers its hint and feeds its
+//      final count back into it upon vx_free(), so vectors created at the same
+//      site settle on a capacity that needs no reallocation. Without
+//      VX_HINTS, this is equivalent to vx_new().
+// (TYPE *) vx_new_with(TYPE, size_t count, void (*unit_free)(void *),
+//                      struct vx_allocator alloc)
+//      When compiled with VX_ALLOCATOR, creates a vector as vx_new() does, but
+//      whose memory is allocated, resized and freed by 'alloc.resize', which is
+//      called as resize(alloc.ctx, ptr, old_size, new_size); 'ptr' is NULL for
+//      new allocations, and 'new_size' is 0 to free. It must return NULL on
+//      failure, leaving the old allocation intact, and return memory aligned
+//      to 16 bytes. The allocator is kept in the tag, so the vector may be
+//      used with the rest of the API as usual. VX_ALLOCATOR cannot be combined
+//      with VX_COMPACT or VX_OUTLINE.
 // void vx_free(void *vx)
 //      Frees the vector 'vx' and sets it to NULL, including freeing any
 //      dynamically allocated members if unit_free() is set.
 // int vx_count(void *vx)
 //      Returns the number of units currently stored in a vector.
+// size_t vx_capacity(void *vx)
+//      Returns the number of units the vector can hold without reallocating.
 // bool vx_reserve(void *vx, size_t new_capacity)
 //      Attempts to allocate the requested 'new_capacity' in terms of units for
 //      use by the vector 'vx'. Returns a bool indicating success or failure.
@@ -79,9 +104,27 @@
 //      Inserts a series of 'count' units from array 'src' into the vector
 //      'dest', prior to 'index', shifting all existing units forward to
 //      compensate. Returns a bool indicating success or failure.
+// bool vx_erase(void *vx, size_t index, size_t count)
+//      Removes 'count' units starting at 'index' from the vector 'vx', shifting
+//      all following units back to compensate. Returns a bool indicating
+//      success or failure.
+// bool vx_pop(void *vx, void *out)
+//      Removes the last unit of the vector 'vx', copying it to 'out' if it is
+//      non-NULL (in which case unit_free() is not called on it). Returns a bool
+//      indicating success or failure.
 // bool vx_shrink(void *vx)
 //      Removes any unused capacity allocated for the vector 'vx'. Returns a
 //      bool indicating success or failure.
+// void vx_shrink_policy(void *vx, unsigned below, unsigned to)
+//      When compiled with VX_SHRINK_POLICY, removing units (vx_pop, vx_erase,
+//      or vx_shift with a negative shift) shrinks the vector once its count
+//      falls below 1/'below' of its capacity, to a capacity of 'to' times its
+//      count. This sets the thresholds for the vector 'vx'; new vectors use
+//      VX_SHRINK_BELOW (4) and VX_SHRINK_TO (2), and 'below' of 0 disables
+//      automatic shrinking. Otherwise both are clamped to USHRT_MAX, 'to' is
+//      raised to at least 1 and then lowered below 'below' (which is itself
+//      raised to at least 2). A shrink that fails to reallocate leaves the
+//      vector as it was and does not fail the removal that triggered it.
 // char *vx_str_new(const char *fmt, ...)
 //      Creates a string vector constructed using text formatted in the same
 //      manner as printf()
@@ -96,6 +139,428 @@
 //      Inserts a string constructed using text formatted in the same manner as
 //      printf() into the string vector 'vx', prior to 'index'. Returns a bool
 //      indicating success or failure.
+//
+// Files:
+// ======
+//      Vectors are stored in files in a binary format: a 20-byte header
+//      holding the characters "vxb1" followed by the unit size and the count
+//      as 64-bit integers, then the units themselves. The header and units
+//      are in the byte order of the machine which wrote them, and units are
+//      copied bitwise, so any pointers they hold are meaningless once read.
+//
+// bool vx_write(const void *vx, FILE *file)
+//      Writes the vector 'vx' to 'file'. Returns a bool indicating success or
+//      failure.
+// (TYPE *) vx_read(TYPE, FILE *file, void (*unit_free)(void *))
+//      Reads a vector of 'TYPE' written by vx_write() from 'file'. Returns
+//      NULL on failure, including where the unit size in the file differs
+//      from that of 'TYPE'.
+// bool vx_write_header(FILE *file, size_t unit, size_t count)
+// bool vx_read_header(FILE *file, size_t *unit, size_t *count)
+//      Write or read the header alone, for vectors too large to hold in
+//      memory, whose 'count' units of 'unit' bytes are then written or read
+//      in parts with fwrite() or fread(). Return a bool indicating success or
+//      failure.
+//
+// SIMD:
+// =====
+//      Functions with SIMD kernels pick the best implementation for the CPU
+//      once, at startup. The level may be lowered for testing by setting the
+//      environment variable VX_SIMD to one of "scalar", "sse2", "sse4.2",
+//      "avx2" or "avx512", or by calling vx_simd_set_level().
+//
+// enum vx_simd vx_simd_level(void)
+//      Returns the SIMD level in use: VX_SIMD_SCALAR, VX_SIMD_SSE2,
+//      VX_SIMD_SSE42, VX_SIMD_AVX2 or VX_SIMD_AVX512.
+// enum vx_simd vx_simd_set_level(enum vx_simd level)
+//      Switches to 'level', or to the highest level supported by the CPU if
+//      that is lower, and returns the level now in use. This is not
+//      thread-safe, and is intended for tests and benchmarks.
+// const char *vx_simd_name(enum vx_simd level)
+//      Returns the name of 'level', as accepted by VX_SIMD.
+//
+// Search:
+// =======
+//      The following compare units bytewise against the unit pointed to by
+//      'key'. Units of 1, 2, 4 or 8 bytes are compared with SIMD instructions;
+//      other sizes fall back to memcmp().
+//
+// ptrdiff_t vx_find(const void *vx, const void *key)
+//      Returns the index of the first unit of 'vx' equal to 'key', or -1.
+// ptrdiff_t vx_find_last(const void *vx, const void *key)
+//      Returns the index of the last unit of 'vx' equal to 'key', or -1.
+// size_t vx_count_eq(const void *vx, const void *key)
+//      Returns the number of units of 'vx' equal to 'key'.
+// bool vx_contains(const void *vx, const void *key)
+//      Returns whether any unit of 'vx' is equal to 'key'.
+//
+// Sorted search:
+// ==============
+//      The following search a vector sorted in ascending order, using a
+//      comparison function as for bsearch() and qsort(), which is always called
+//      with 'key' as its first argument.
+//
+// size_t vx_lower_bound(const void *vx, const void *key,
+//                       int (*cmp)(const void *, const void *))
+//      Returns the index of the first unit of 'vx' not less than 'key', or the
+//      count of 'vx' if there is none.
+// size_t vx_upper_bound(const void *vx, const void *key,
+//                       int (*cmp)(const void *, const void *))
+//      Returns the index of the first unit of 'vx' greater than 'key', or the
+//      count of 'vx' if there is none.
+// bool vx_equal_range(const void *vx, const void *key,
+//                     int (*cmp)(const void *, const void *),
+//                     size_t *first, size_t *last)
+//      Sets 'first' and 'last' to the lower and upper bounds of 'key', and
+//      returns whether any unit of 'vx' is equal to it.
+// size_t vx_lower_bound_T(const TYPE *vx, TYPE key)
+// size_t vx_upper_bound_T(const TYPE *vx, TYPE key)
+//      As above, for vectors of integers, where T is one of i32, u32, i64 or
+//      u64 for int32_t, uint32_t, int64_t and uint64_t respectively. These
+//      search without branching on the comparisons, and are fastest while the
+//      vector fits in cache.
+// size_t vx_lower_bound_prefetch_T(const TYPE *vx, TYPE key)
+// size_t vx_upper_bound_prefetch_T(const TYPE *vx, TYPE key)
+//      As above, but prefetching both possible units of the next step, which
+//      is faster for vectors much larger than the cache.
+// (TYPE *) vx_eytzinger_build(const TYPE *vx)
+//      Returns a new vector holding the units of the sorted vector 'vx' in
+//      Eytzinger (breadth-first) order, as an implicit binary search tree in
+//      which the children of the unit at index 'i' are at '2i + 1' and
+//      '2i + 2', or NULL on failure. The copy is bitwise, and has no
+//      unit_free() set; it is meant to be searched read-only, and is not
+//      itself sorted.
+// size_t vx_eytzinger_search(const void *eytz, const void *key,
+//                            int (*cmp)(const void *, const void *))
+// size_t vx_eytzinger_search_T(const TYPE *eytz, TYPE key)
+//      Returns the index within 'eytz' of the lower bound of 'key', or the
+//      count of 'eytz' if every unit is less than 'key'. The integer variants
+//      prefetch several levels of the tree ahead, which makes searches of
+//      large vectors considerably faster than with vx_lower_bound().
+//
+// Heaps:
+// ======
+//      The following keep a vector as a binary max-heap, ordered by a
+//      comparison function as for qsort(), so that the greatest unit is always
+//      at index 0; a comparison function with its result negated gives a
+//      min-heap. Any vector may be made into a heap, and remains an ordinary
+//      vector.
+//
+// void vx_heap_make(void *vx, int (*cmp)(const void *, const void *))
+//      Rearranges the units of 'vx' into a heap, in O(n) time.
+// bool vx_heap_push(void *vx, const void *value,
+//                   int (*cmp)(const void *, const void *))
+//      Adds the unit pointed to by 'value' to the heap 'vx'. Returns a bool
+//      indicating success or failure.
+// bool vx_heap_pop(void *vx, void *out,
+//                  int (*cmp)(const void *, const void *))
+//      Removes the greatest unit of the heap 'vx', copying it to 'out' if it is
+//      non-NULL, as for vx_pop(). Returns a bool indicating success or failure.
+// void vx_heap4_make_T(TYPE *vx)
+// bool vx_heap4_push_T(TYPE **vx_p, TYPE value)
+// bool vx_heap4_pop_T(TYPE **vx_p, TYPE *out)
+//      As above, for vectors of integers, where T is one of i32, u32, i64 or
+//      u64 as for vx_lower_bound_T(). These keep a 4-ary max-heap, whose
+//      shallower tree and adjacent children take fewer cache misses per
+//      operation, and take the address of the vector variable as VX_DECLARE()
+//      functions do. The layout differs from that of vx_heap_make().
+//
+// Selection:
+// ==========
+//      The following order units by a comparison function as for qsort(). The
+//      top k units are the k greatest.
+//
+// void vx_nth_element(void *vx, size_t n,
+//                     int (*cmp)(const void *, const void *))
+//      Rearranges the units of 'vx' so that the unit at index 'n' is the one
+//      which would be there were 'vx' sorted, with no greater unit before it
+//      and no lesser unit after it. This runs in O(n) time on average, using
+//      quickselect, and falls back to choosing pivots by the median of
+//      medians if it makes too little progress, which bounds the worst case
+//      at O(n) as well.
+// void vx_partial_sort(void *vx, size_t k,
+//                      int (*cmp)(const void *, const void *))
+//      Rearranges the units of 'vx' so that the first 'k' are the least, in
+//      sorted order, in O(n + k log k) time. The order of the rest is
+//      unspecified.
+// (TYPE *) vx_topk(const TYPE *vx, size_t k,
+//                  int (*cmp)(const void *, const void *))
+// (TYPE *) vx_topk_parallel(const TYPE *vx, size_t k,
+//                           int (*cmp)(const void *, const void *))
+//      Returns a new vector of the top 'k' units of 'vx' (or all of them, if
+//      there are fewer), from the greatest down, or NULL on failure. 'vx' is
+//      not modified, and is scanned once in O(n log k) time. When compiled with
+//      OpenMP, vx_topk_parallel() splits the scan across threads and merges
+//      their results, in which case 'cmp' must be thread-safe; otherwise it is
+//      equivalent to vx_topk().
+//
+//      The top k of a stream of units may be kept in a struct vx_topk, which
+//      holds them in a min-heap of at most 'k' units, so that each unit pushed
+//      is compared against the least of the top k first. Pushing never
+//      allocates.
+//
+// bool vx_topk_init(struct vx_topk *topk, TYPE, size_t k,
+//                   int (*cmp)(const void *, const void *))
+//      Initializes 'topk' to keep the top 'k' units of 'TYPE'. Returns a bool
+//      indicating success or failure.
+// void vx_topk_free(struct vx_topk *topk)
+//      Frees the units held by 'topk'.
+// void vx_topk_push(struct vx_topk *topk, const void *value)
+//      Offers the unit pointed to by 'value' to 'topk'.
+// void vx_topk_merge(struct vx_topk *dest, const struct vx_topk *src)
+//      Offers all the units held by 'src' to 'dest', e.g. to combine the
+//      results of several threads.
+// (TYPE *) vx_topk_result(const struct vx_topk *topk)
+//      Returns a new vector of the units held by 'topk', from the greatest
+//      down, or NULL on failure.
+//
+// Set operations:
+// ===============
+//      The following operate on sets of 32-bit unsigned integers, such as
+//      document ids, held as vectors sorted in strictly ascending order. Each
+//      replaces the contents of the vector '*out_p', which must not be one of
+//      the inputs, growing it as needed, and returns a bool indicating success
+//      or failure.
+//
+//      Intersections compare blocks of four ids against each other with SIMD
+//      instructions (at VX_SIMD_SSE42 and above). Where one set is more than
+//      VX_GALLOP_RATIO (32) times the size of the other, each id of the smaller
+//      set is instead found in the larger with an exponential search, which
+//      skips over most of it.
+//
+// bool vx_set_intersect_u32(uint32_t **out_p, const uint32_t *a,
+//                           const uint32_t *b)
+//      Sets '*out_p' to the ids present in both 'a' and 'b'.
+// bool vx_set_union_u32(uint32_t **out_p, const uint32_t *a,
+//                       const uint32_t *b)
+//      Sets '*out_p' to the ids present in either 'a' or 'b'.
+// bool vx_set_difference_u32(uint32_t **out_p, const uint32_t *a,
+//                            const uint32_t *b)
+//      Sets '*out_p' to the ids present in 'a' but not in 'b'.
+// bool vx_set_intersect_many_u32(uint32_t **out_p,
+//                                const uint32_t *const *sets, size_t n)
+//      Sets '*out_p' to the ids present in all 'n' vectors of 'sets',
+//      intersecting them from the smallest up, so that the result shrinks
+//      early and later intersections gallop.
+// bool vx_set_union_many_u32(uint32_t **out_p,
+//                            const uint32_t *const *sets, size_t n)
+//      Sets '*out_p' to the ids present in any of the 'n' vectors of 'sets',
+//      merging them all at once in a single pass.
+//
+// Merging:
+// ========
+//      The following merge sorted runs, ordered by a comparison function as
+//      for qsort(), through a tournament (loser) tree, which picks each unit
+//      with one comparison per level of the tree, i.e. log2(n) for n runs.
+//      Units which compare equal are taken from the runs in order, so the
+//      merge is stable. With VX_MERGE_DEDUP in 'flags', a unit equal to the
+//      last one output is dropped, keeping the first of each run of equal
+//      units. Output is appended to the destination vector, which is grown
+//      geometrically and has its count updated once per call.
+//
+// bool vx_merge_k(void *out, const void *const *runs, size_t n,
+//                 int (*cmp)(const void *, const void *), unsigned flags)
+//      Appends the merged units of the 'n' sorted vectors 'runs' to the
+//      vector 'out', whose unit size they must share. Returns a bool
+//      indicating success or failure.
+//
+//      Runs too large to hold in memory at once may instead be merged from a
+//      struct vx_merge_source each, whose 'read' function is called as
+//      read(ctx, dest, max) to copy the next (up to) 'max' units of the run to
+//      'dest', returning the number copied, or 0 at the end of the run. Errors
+//      should be recorded in 'ctx' and reported as the end of the run.
+//
+// bool vx_merge_init(struct vx_merge *merge, TYPE,
+//                    const struct vx_merge_source *sources, size_t n,
+//                    size_t chunk, int (*cmp)(const void *, const void *),
+//                    unsigned flags)
+//      Initializes 'merge' to merge the 'n' runs read from 'sources', which
+//      are read 'chunk' units at a time, so that at most 'n * chunk' units are
+//      held in memory. Returns a bool indicating success or failure.
+// bool vx_merge_next(struct vx_merge *merge, void *out, size_t max)
+//      Appends up to 'max' merged units to the vector 'out'. Returns a bool
+//      indicating success or failure.
+// bool vx_merge_done(const struct vx_merge *merge)
+//      Returns whether every run has been merged.
+// void vx_merge_free(struct vx_merge *merge)
+//      Frees the buffers held by 'merge'.
+//
+// Deduplication:
+// ==============
+// bool vx_unique(void *vx, int (*cmp)(const void *, const void *))
+//      Removes from the vector 'vx', sorted by 'cmp' as for qsort(), every unit
+//      equal to the one before it, keeping the first of each run of equal
+//      units, in a single pass. unit_free() is called on the units removed.
+//      Returns a bool indicating success or failure.
+// bool vx_dedup_hash(void *vx)
+// bool vx_dedup_hash_parallel(void *vx)
+//      Removes from the vector 'vx', in any order, every unit bytewise equal
+//      to an earlier one, keeping the first occurrences in their order. Units
+//      are found through a hash table sized from the count, in O(n) time. As
+//      the units removed are bytewise copies of those kept, sharing anything
+//      they point to, unit_free() is not called on them. When compiled with
+//      OpenMP, vx_dedup_hash_parallel() splits large vectors into partitions
+//      by hash, each deduplicated by its own thread with its own table;
+//      otherwise it is equivalent to vx_dedup_hash(). Both return a bool
+//      indicating success or failure, in which case 'vx' is unchanged.
+//
+// Interleaving and gathering:
+// ===========================
+// bool vx_deinterleave(const void *vx, size_t width, void **fields)
+//      Splits each unit of the vector 'vx' into fields of 'width' bytes, one
+//      of 2, 4, 8 or 16, of which the unit size must be a multiple. Sets
+//      fields[f] to a new vector holding the f-th field of every unit, in
+//      order, for each of the unit size / 'width' fields. Returns a bool
+//      indicating success or failure, in which case every fields[f] is NULL.
+// void *vx_interleave(void *const *fields, size_t n)
+//      The reverse of vx_deinterleave(): returns a new vector whose units
+//      each join the units at the same index of the 'n' vectors 'fields',
+//      which must have the same count and unit size, one of 2, 4, 8 or 16.
+//      Returns NULL on failure.
+// bool vx_gather(const void *src, const uint32_t *idx, void *out)
+//      Replaces the contents of the vector 'out', of the same unit size as
+//      'src', with src[idx[i]] for each index of the vector 'idx', in order.
+//      Units are copied bitwise, and unit_free() is not called on those
+//      replaced. Returns a bool indicating success or failure.
+// bool vx_scatter(const void *src, const uint32_t *idx, void *dest)
+//      Sets dest[idx[i]] to src[i] for each unit of the vector 'src', where
+//      'idx' has the same count, and 'dest' the same unit size. Where an
+//      index is repeated, the last unit for it is kept. Returns a bool
+//      indicating success or failure.
+//
+//      Every index must be less than the count of the vector it indexes, and
+//      the vectors must not overlap. Where the units indexed span more than
+//      VX_GATHER_PREFETCH_MIN (16 MiB), the units at upcoming indices are
+//      prefetched as each block of indices is copied; otherwise, vectors of
+//      4- or 8-byte units are gathered with AVX2 where available.
+//
+// Permutation:
+// ============
+//      A permutation is a vector of uint32_t holding each index of the vector
+//      it applies to exactly once, such as the order in which a sort would
+//      leave the units. Applying it moves the unit at index perm[i] to index
+//      i, so that a permutation computed for one vector may be applied to
+//      any number of parallel vectors in turn.
+//
+// bool vx_permute_inplace(void *vx, const uint32_t *perm)
+//      Applies the permutation 'perm', of the same count, to the vector 'vx'
+//      in place, by following each cycle of the permutation with a single
+//      unit held aside, and marking the indices placed in a bitset of one
+//      bit per unit. Returns a bool indicating success or failure, including
+//      where 'perm' is not a permutation, in which case 'vx' is unchanged.
+// bool vx_permute_into(const void *vx, const uint32_t *perm, void *out)
+//      As vx_permute_inplace(), but replaces the contents of the vector 'out',
+//      of the same unit size, as vx_gather() does, leaving 'vx' unchanged.
+//      Each index of 'perm' must be less than the count of 'vx', but may be
+//      repeated.
+// bool vx_stable_partition(void *vx, bool (*pred)(const void *, void *),
+//                          void *ctx, size_t *split)
+//      Moves the units of the vector 'vx' for which pred(unit, ctx) is true
+//      before those for which it is false, keeping the order of the units
+//      within each part, and sets '*split' to the number of units in the
+//      first. The units of the second part are held aside in a scratch
+//      buffer, from the first of them on. Returns a bool indicating success
+//      or failure, in which case 'vx' is unchanged.
+//
+// Typed API:
+// ==========
+// VX_DECLARE(name, TYPE)
+//      Declares inline functions operating on vectors of 'TYPE', specialized
+//      for its size. Each takes the address of the vector variable, grows it
+//      geometrically, and returns a bool indicating success or failure where
+//      applicable:
+//              TYPE *name_new(size_t count)
+//              bool  name_push(TYPE **vx_p, TYPE value)
+//              bool  name_append(TYPE **vx_p, const TYPE *src, size_t count)
+//              bool  name_insert(TYPE **vx_p, size_t index, TYPE value)
+//              bool  name_erase(TYPE **vx_p, size_t index, size_t count)
+//              bool  name_pop(TYPE **vx_p, TYPE *out)
+//      These vectors are ordinary vectors, and may be used with the rest of
+//      the API as well.
+//
+// Compact tags:
+// =============
+//      By default, each vector's tag takes 32 bytes (on 64-bit platforms). When
+//      compiled with VX_COMPACT, the tag instead takes 16 bytes, holding a
+//      32-bit count and capacity and an index into a table of up to
+//      VX_DESC_MAX (256) distinct unit size and unit_free() pairs. Vectors
+//      which grow beyond 32 bits switch to a wide tag automatically. The tag
+//      fields should then only be read via vx_count(), vx_capacity() and the
+//      vx_tag_*() accessors. VX_COMPACT cannot be combined with VX_HINTS,
+//      VX_REGISTRY or VX_SHRINK_POLICY. The table of pairs is shared by all
+//      vectors and never shrinks. Pairs are looked up without locking and
+//      added under a lock, so threads may still create vectors of their own
+//      concurrently. The lock requires gcc or clang; with other compilers,
+//      vx_new() must not be called from more than one thread at a time.
+//
+// Outline tags:
+// =============
+//      When compiled with VX_OUTLINE, tags are stored apart from the data in a
+//      table keyed by the data pointer, at the cost of a lookup per operation.
+//      The data of new vectors is then aligned to VX_ALIGN (16 by default, and
+//      any power of two, e.g. a page), and buffers allocated elsewhere can be
+//      adopted as vectors without copying. VX_OUTLINE cannot be combined with
+//      VX_COMPACT. The table is shared by all vectors, but is split into
+//      VX_OUTLINE_SHARDS (64) shards each with its own lock, so that threads
+//      may still work on vectors of their own concurrently, as they may in
+//      other modes. The locks require gcc or clang; with other compilers,
+//      VX_OUTLINE makes the whole API single-threaded.
+//
+// (TYPE *) vx_adopt(TYPE, TYPE *ptr, size_t count, size_t capacity,
+//                   void *(*realloc_fn)(void *, size_t),
+//                   void (*free_fn)(void *))
+//      Adopts the buffer 'ptr', holding 'count' units of 'TYPE' in space for
+//      'capacity', as a vector, and returns it (or NULL on failure). Resizing
+//      the vector calls 'realloc_fn' with the new size in bytes; if it is NULL,
+//      the vector cannot grow beyond 'capacity'. vx_free() calls 'free_fn' on
+//      the buffer, if it is non-NULL.
+//
+// Registry:
+// =========
+//      When compiled with VX_REGISTRY, vectors may be registered so that their
+//      memory use can be inspected and their unused capacity reclaimed in bulk.
+//      The registry stores the address of the variable holding the vector, so
+//      that variable must stay at a fixed address (e.g. a global or a struct
+//      member) and must be the one used for every operation that may move the
+//      vector. Registered vectors are removed automatically upon vx_free().
+//
+//      The registry is a single unlocked table, and trimming reallocates the
+//      registered vectors through their variables. None of it is thread-safe
+//      or async-signal-safe: registering and unregistering vectors, freeing
+//      registered vectors, and all of the queries and trimming below must run
+//      on the one thread which owns every registered vector, e.g. an event
+//      loop, and never from a signal handler.
+//
+// bool vx_register(void *vx)
+//      Adds the vector 'vx' to the registry. Returns a bool indicating success
+//      or failure.
+// void vx_unregister(void *vx)
+//      Removes the vector 'vx' from the registry, if present.
+// size_t vx_registry_bytes(void)
+//      Returns the total number of bytes allocated by registered vectors,
+//      including their tags.
+// size_t vx_registry_slack(void)
+//      Returns the total number of bytes allocated by registered vectors
+//      beyond their current count.
+// void vx_set_budget(size_t bytes)
+//      Sets the memory budget used by vx_trim_budget(); 0 disables it.
+// size_t vx_trim_all(size_t target)
+//      Shrinks registered vectors, those with the most slack first, until the
+//      registry uses no more than 'target' bytes or no slack remains. Returns
+//      the number of bytes released.
+// size_t vx_trim_budget(void)
+//      Calls vx_trim_all() with the budget if the registry exceeds it, and
+//      returns the number of bytes released. This is intended to be called
+//      periodically or upon memory pressure, from the thread which owns the
+//      registered vectors (e.g. on a timer of its event loop), not from a
+//      signal handler or another thread.
+// int vx_psi_open(unsigned stall_us, unsigned window_us)
+//      (Linux only) Opens a PSI trigger on /proc/pressure/memory which fires
+//      when tasks stall on memory for 'stall_us' within any 'window_us'. The
+//      returned descriptor signals POLLPRI on each event, upon which the caller
+//      should call vx_trim_budget(). The descriptor should be polled by the
+//      event loop of the thread which owns the registered vectors, rather
+//      than by a thread of its own. Returns -1 on failure.
 
 #ifndef VX_H
 #define VX_H
@@ -103,6 +568,7 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -111,22 +577,202 @@
 #include <errno.h>
 #endif
 
+#if defined(VX_SHRINK_POLICY) && defined(VX_IMPLEMENT)
+#include <limits.h>
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) \
+    && (defined(__GNUC__) || defined(__clang__))
+#define VX_SIMD_X86
+#endif
+
+#if defined(VX_SIMD_X86) && defined(VX_IMPLEMENT)
+#include <immintrin.h>
+#endif
+
+#if defined(_OPENMP) && defined(VX_IMPLEMENT)
+#include <omp.h>
+#endif
+
+#if defined(VX_REGISTRY) && defined(VX_IMPLEMENT) && defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #ifndef VX_CHUNK_COUNT
 #define VX_CHUNK_COUNT 16
 #endif
 
+#ifndef VX_SHRINK_BELOW
+#define VX_SHRINK_BELOW 4
+#endif
+
+#ifndef VX_SHRINK_TO
+#define VX_SHRINK_TO 2
+#endif
+
+#ifndef VX_ALIGN
+#define VX_ALIGN 16
+#endif
+
+#ifndef VX_GALLOP_RATIO
+#define VX_GALLOP_RATIO 32
+#endif
+
+#ifndef VX_OUTLINE_SHARDS
+#define VX_OUTLINE_SHARDS 64
+#endif
+
+#if defined(VX_ALLOCATOR) && defined(VX_OUTLINE)
+#error "VX_ALLOCATOR cannot be combined with VX_OUTLINE"
+#endif
+
+struct vx_hint {
+	size_t estimate;
+};
+
+struct vx_allocator {
+	void *(*resize)(void *ctx, void *ptr, size_t old_size, size_t new_size);
+	void *ctx;
+};
+
+enum vx_simd {
+	VX_SIMD_SCALAR,
+	VX_SIMD_SSE2,
+	VX_SIMD_SSE42,
+	VX_SIMD_AVX2,
+	VX_SIMD_AVX512,
+};
+
+#ifdef VX_COMPACT
+#if defined(VX_HINTS) || defined(VX_REGISTRY) || defined(VX_SHRINK_POLICY) \
+    || defined(VX_ALLOCATOR)
+#error "VX_COMPACT cannot be combined with per-vector tag fields"
+#endif
+#ifdef VX_OUTLINE
+#error "VX_COMPACT cannot be combined with VX_OUTLINE"
+#endif
+
+#ifndef VX_DESC_MAX
+#define VX_DESC_MAX 256
+#endif
+
+#define VX_TAG_WIDE 1u
+
+// In compact mode, the unit size and unit_free() of each vector are stored
+// once in a table of descriptors, and the tag keeps only an index into it
+// alongside a 32-bit count and capacity. Vectors whose capacity exceeds 32 bits
+// set VX_TAG_WIDE and keep their real count and capacity in a wide block at the
+// start of their allocation, just prior to the tag, which then holds a pointer
+// to it in place of the 32-bit fields. The wide block is only ever reached
+// through that pointer, never by stepping back from a tag which may have no
+// block before it.
+
+struct vx_desc {
+	size_t unit;
+	void (*unit_free)(void *);
+};
+
+struct vx_wide {
+	size_t count;
+	size_t capacity;
+};
+
+struct vx_tag {
+	union {
+		struct {
+			uint32_t count;
+			uint32_t capacity;
+		} narrow;
+		struct vx_wide *wide;
+	} size;
+	uint32_t desc;
+	uint32_t flags;
+};
+
+extern struct vx_desc vx_descs[VX_DESC_MAX];
+
+#define VX_WIDE_SIZE (((sizeof(struct vx_wide) + 15) / 16) * 16)
+#define vx_wide(tag) ((tag)->size.wide)
+#define vx_tag_unit(tag) (vx_descs[(tag)->desc].unit)
+#define vx_tag_unit_free(tag) (vx_descs[(tag)->desc].unit_free)
+#define vx_tag_count(tag)                                 \
+	((tag)->flags & VX_TAG_WIDE ? vx_wide(tag)->count \
+	                            : (size_t)(tag)->size.narrow.count)
+#define vx_tag_capacity(tag)                                 \
+	((tag)->flags & VX_TAG_WIDE ? vx_wide(tag)->capacity \
+	                            : (size_t)(tag)->size.narrow.capacity)
+#define vx_tag_set_count(tag, n)                            \
+	((tag)->flags & VX_TAG_WIDE                         \
+	     ? (void)(vx_wide(tag)->count = (n))            \
+	     : (void)((tag)->size.narrow.count = (uint32_t)(n)))
+#else
 struct vx_tag {
 	void (*unit_free)(void *);
-	size_t        unit;
-	size_t        capacity;
-	size_t        count;
-	unsigned char data[];
+	size_t unit;
+	size_t capacity;
+	size_t count;
+#ifdef VX_HINTS
+	struct vx_hint *hint;
+#endif
+#ifdef VX_REGISTRY
+	size_t reg_index;
+#endif
+#ifdef VX_SHRINK_POLICY
+	unsigned short shrink_below;
+	unsigned short shrink_to;
+#endif
+#ifdef VX_ALLOCATOR
+	struct vx_allocator alloc;
+#endif
+#ifdef VX_OUTLINE
+	unsigned char *data;
+	void          *block;
+	void *(*realloc_fn)(void *, size_t);
+	void (*free_fn)(void *);
+#endif
 };
 
+#define vx_tag_unit(tag) ((tag)->unit)
+#define vx_tag_unit_free(tag) ((tag)->unit_free)
+#define vx_tag_count(tag) ((tag)->count)
+#define vx_tag_capacity(tag) ((tag)->capacity)
+#define vx_tag_set_count(tag, n) ((tag)->count = (n))
+#endif
+
+// The tag is padded to a multiple of 16 bytes so that the data following it
+// keeps the alignment of the underlying allocation.
+#define VX_TAG_SIZE (((sizeof(struct vx_tag) + 15) / 16) * 16)
+
 #define vx_new(type, count, unit_free) \
 	(type *)vx_new_(sizeof(type), count, unit_free)
-#define vx_tag(vx) ((struct vx_tag *)(vx)-1)
-#define vx_count(vx) (int)vx_tag(vx)->count
+#ifdef VX_ALLOCATOR
+#define vx_new_with(type, count, unit_free, alloc) \
+	(type *)vx_new_with_(sizeof(type), count, unit_free, alloc)
+#endif
+#ifdef VX_HINTS
+#define vx_new_hinted(type, count, unit_free, hint) \
+	(type *)vx_new_hinted_(sizeof(type), count, unit_free, hint)
+#else
+#define vx_new_hinted(type, count, unit_free, hint) \
+	((void)(hint), vx_new(type, count, unit_free))
+#endif
+#ifdef VX_OUTLINE
+#define vx_tag(vx) vx_outline_tag(vx)
+#define vx_data(tag) ((tag)->data)
+#define vx_adopt(type, ptr, count, capacity, realloc_fn, free_fn) \
+	(type *)vx_adopt_(                                        \
+	    sizeof(type), ptr, count, capacity, realloc_fn, free_fn)
+#else
+#define vx_tag(vx) ((struct vx_tag *)((unsigned char *)(vx)-VX_TAG_SIZE))
+#define vx_data(tag) ((unsigned char *)(tag) + VX_TAG_SIZE)
+#endif
+#define vx_count(vx) (int)vx_tag_count(vx_tag(vx))
+#define vx_capacity(vx) vx_tag_capacity(vx_tag(vx))
 #define vx_free(vx) vx_free_((void **)&vx)
 #define vx_reserve(vx, new_capacity) vx_reserve_((void **)&vx, new_capacity)
 #define vx_grow(vx, grow_by) vx_grow_((void **)&vx, grow_by)
@@ -139,271 +785,4625 @@ struct vx_tag {
 #define vx_emplace(dest, index, src, count) \
 	vx_emplace_((void **)&dest, index, src, count)
 #define vx_shrink(vx) vx_shrink_((void **)&vx)
+#define vx_pop(vx, out) vx_pop_((void **)&vx, out)
+#define vx_erase(vx, index, count) \
+	vx_shift_((void **)&vx, (index) + (count), -(ptrdiff_t)(count))
+#ifdef VX_SHRINK_POLICY
+#define vx_shrink_policy(vx, below, to) vx_shrink_policy_(vx, below, to)
+#endif
 #define vx_str_push(vx, c) vx_str_push_(&vx, c)
 #define vx_str_append(vx, ...) vx_str_append_(&vx, __VA_ARGS__)
 #define vx_str_emplace(vx, ...) vx_str_emplace_(&vx, __VA_ARGS__)
+#define vx_read(type, file, unit_free) \
+	(type *)vx_read_(sizeof(type), file, unit_free)
+#ifdef VX_REGISTRY
+#define vx_register(vx) vx_register_((void **)&vx)
+#define vx_unregister(vx) vx_unregister_(vx)
+#endif
 
-#ifdef VX_IMPLEMENT
+void *vx_new_(size_t unit, size_t count, void (*unit_free)(void *));
+void  vx_free_(void **vx_p);
+bool  vx_reserve_(void **vx_p, size_t new_capacity);
+bool  vx_grow_(void **vx_p, size_t grow_by);
+bool  vx_append_(void **vx_p, void *src, size_t count);
+bool  vx_shift_(void **vx_p, size_t index, ptrdiff_t shift);
+bool  vx_emplace_(void **dest_p, size_t index, void *src, size_t count);
+bool  vx_shrink_(void **vx_p);
+bool  vx_pop_(void **vx_p, void *out);
+bool  vx_expand_(void **vx_p, size_t min_capacity);
+enum vx_simd vx_simd_level(void);
+enum vx_simd vx_simd_set_level(enum vx_simd level);
+const char  *vx_simd_name(enum vx_simd level);
+ptrdiff_t    vx_find(const void *vx, const void *key);
+ptrdiff_t    vx_find_last(const void *vx, const void *key);
+size_t       vx_count_eq(const void *vx, const void *key);
+bool         vx_contains(const void *vx, const void *key);
+size_t       vx_lower_bound(const void *vx,
+                            const void *key,
+                            int (*cmp)(const void *, const void *));
+size_t       vx_upper_bound(const void *vx,
+                            const void *key,
+                            int (*cmp)(const void *, const void *));
+bool         vx_equal_range(const void *vx,
+                            const void *key,
+                            int (*cmp)(const void *, const void *),
+                            size_t *first,
+                            size_t *last);
+void        *vx_eytzinger_build(const void *vx);
+size_t       vx_eytzinger_search(const void *eytz,
+                                 const void *key,
+                                 int (*cmp)(const void *, const void *));
+char *vx_str_new(const char *fmt, ...);
+bool  vx_str_push_(char **vx_p, char c);
+bool  vx_str_append_(char **vx_p, const char *fmt, ...);
+bool  vx_str_emplace_(char **vx_p, size_t index, const char *fmt, ...);
+bool  vx_write(const void *vx, FILE *file);
+void *vx_read_(size_t unit, FILE *file, void (*unit_free)(void *));
+bool  vx_write_header(FILE *file, size_t unit, size_t count);
+bool  vx_read_header(FILE *file, size_t *unit, size_t *count);
 
-void *vx_new_(size_t unit, size_t count, void (*unit_free)(void *))
-{
-	struct vx_tag *tag = calloc(1, sizeof(struct vx_tag) + unit * count);
-	if (!tag) {
-#ifdef VX_USER_ERRORS
-		perror(strerror(errno));
-#endif
-		return NULL;
-	}
+#define VX_BOUND_PROTOTYPES_(suffix, type)                                     \
+	size_t vx_lower_bound_##suffix(const type *vx, type key);              \
+	size_t vx_upper_bound_##suffix(const type *vx, type key);              \
+	size_t vx_lower_bound_prefetch_##suffix(const type *vx, type key);     \
+	size_t vx_upper_bound_prefetch_##suffix(const type *vx, type key);     \
+	size_t vx_eytzinger_search_##suffix(const type *eytz, type key);
 
-	tag->unit_free = unit_free;
-	tag->unit      = unit;
-	tag->capacity  = count;
-	tag->count     = count;
+VX_BOUND_PROTOTYPES_(i32, int32_t)
+VX_BOUND_PROTOTYPES_(u32, uint32_t)
+VX_BOUND_PROTOTYPES_(i64, int64_t)
+VX_BOUND_PROTOTYPES_(u64, uint64_t)
 
-	return tag->data;
-}
+#define vx_heap_push(vx, value, cmp) vx_heap_push_((void **)&vx, value, cmp)
+#define vx_heap_pop(vx, out, cmp) vx_heap_pop_((void **)&vx, out, cmp)
 
-bool vx_unit_nonempty(struct vx_tag *tag, size_t index)
-{
-	// This function checks if a given unit is non-empty (i.e. not all
-	// zeros/NULL). This is necessary to prevent freeing zero/NULL units of
-	// arbitrary size if unit_free() is set.
+void vx_heap_make(void *vx, int (*cmp)(const void *, const void *));
+bool vx_heap_push_(void      **vx_p,
+                   const void *value,
+                   int (*cmp)(const void *, const void *));
+bool vx_heap_pop_(void **vx_p,
+                  void  *out,
+                  int (*cmp)(const void *, const void *));
 
-	for (size_t i = 0; i < tag->unit; i++) {
-		if (tag->data[tag->unit * index + i]) {
-			return true;
-		}
-	}
+#define VX_HEAP4_PROTOTYPES_(suffix, type)                                     \
+	void vx_heap4_make_##suffix(type *vx);                                 \
+	bool vx_heap4_push_##suffix(type **vx_p, type value);                  \
+	bool vx_heap4_pop_##suffix(type **vx_p, type *out);
 
-	return false;
-}
+VX_HEAP4_PROTOTYPES_(i32, int32_t)
+VX_HEAP4_PROTOTYPES_(u32, uint32_t)
+VX_HEAP4_PROTOTYPES_(i64, int64_t)
+VX_HEAP4_PROTOTYPES_(u64, uint64_t)
 
-void vx_free_(void **vx_p)
-{
-	if (!*vx_p) {
-		return;
-	}
+struct vx_topk {
+	void  *heap;
+	size_t k;
+	int (*cmp)(const void *, const void *);
+};
 
-	struct vx_tag *tag = vx_tag(*vx_p);
-	*vx_p              = NULL;
+#define vx_topk_init(topk, type, k, cmp) \
+	vx_topk_init_(topk, sizeof(type), k, cmp)
 
-	if (tag->unit_free) {
-		for (size_t i = 0; i < tag->count; i++) {
-			if (vx_unit_nonempty(tag, i)) {
-				tag->unit_free(tag->data + tag->unit * i);
-			}
-		}
-	}
+void  vx_nth_element(void  *vx,
+                     size_t n,
+                     int (*cmp)(const void *, const void *));
+void  vx_partial_sort(void *vx,
+                      size_t k,
+                      int (*cmp)(const void *, const void *));
+void *vx_topk(const void *vx,
+              size_t      k,
+              int (*cmp)(const void *, const void *));
+void *vx_topk_parallel(const void *vx,
+                       size_t      k,
+                       int (*cmp)(const void *, const void *));
+bool  vx_topk_init_(struct vx_topk *topk,
+                    size_t          unit,
+                    size_t          k,
+                    int (*cmp)(const void *, const void *));
+void  vx_topk_free(struct vx_topk *topk);
+void  vx_topk_push(struct vx_topk *topk, const void *value);
+void  vx_topk_merge(struct vx_topk *dest, const struct vx_topk *src);
+void *vx_topk_result(const struct vx_topk *topk);
+bool  vx_set_intersect_u32(uint32_t      **out_p,
+                           const uint32_t *a,
+                           const uint32_t *b);
+bool  vx_set_union_u32(uint32_t **out_p, const uint32_t *a, const uint32_t *b);
+bool  vx_set_difference_u32(uint32_t      **out_p,
+                            const uint32_t *a,
+                            const uint32_t *b);
+bool  vx_set_intersect_many_u32(uint32_t             **out_p,
+                                const uint32_t *const *sets,
+                                size_t                 n);
+bool  vx_set_union_many_u32(uint32_t             **out_p,
+                            const uint32_t *const *sets,
+                            size_t                 n);
 
-	free(tag);
-}
+#define VX_MERGE_DEDUP 1
 
-bool vx_reserve_(void **vx_p, size_t new_capacity)
-{
-	struct vx_tag *tag = vx_tag(*vx_p);
+struct vx_merge_source {
+	size_t (*read)(void *ctx, void *dest, size_t max);
+	void *ctx;
+};
 
-	if (new_capacity < tag->count) {
-#ifdef VX_USER_ERRORS
-		fprintf(stderr,
-		        "Error resizing vector below current contents.\n");
-#endif
-		return false;
-	}
+struct vx_merge_run {
+	const unsigned char *pos;
+	const unsigned char *end;
+	unsigned char       *buf;
+};
 
-	tag = realloc(tag, sizeof(struct vx_tag) + tag->unit * new_capacity);
-	if (!tag) {
-#ifdef VX_USER_ERRORS
-		perror(strerror(errno));
+struct vx_merge {
+	size_t                  unit;
+	size_t                  n;
+	size_t                  chunk;
+	unsigned                flags;
+	int (*cmp)(const void *, const void *);
+	struct vx_merge_source *sources;
+	struct vx_merge_run    *runs;
+	size_t                 *tree;
+	unsigned char          *last;
+	bool                    has_last;
+};
+
+#define vx_merge_k(out, runs, n, cmp, flags) \
+	vx_merge_k_((void **)&out, (const void *const *)(runs), n, cmp, flags)
+#define vx_merge_init(merge, type, sources, n, chunk, cmp, flags) \
+	vx_merge_init_(merge, sizeof(type), sources, n, chunk, cmp, flags)
+#define vx_merge_next(merge, out, max) \
+	vx_merge_next_(merge, (void **)&out, max)
+
+bool vx_merge_k_(void             **out_p,
+                 const void *const *runs,
+                 size_t             n,
+                 int (*cmp)(const void *, const void *),
+                 unsigned flags);
+bool vx_merge_init_(struct vx_merge              *merge,
+                    size_t                        unit,
+                    const struct vx_merge_source *sources,
+                    size_t                        n,
+                    size_t                        chunk,
+                    int (*cmp)(const void *, const void *),
+                    unsigned flags);
+bool vx_merge_next_(struct vx_merge *merge, void **out_p, size_t max);
+bool vx_merge_done(const struct vx_merge *merge);
+void vx_merge_free(struct vx_merge *merge);
+
+#define vx_unique(vx, cmp) vx_unique_((void **)&vx, cmp)
+#define vx_dedup_hash(vx) vx_dedup_hash_((void **)&vx)
+#define vx_dedup_hash_parallel(vx) vx_dedup_hash_parallel_((void **)&vx)
+
+bool vx_unique_(void **vx_p, int (*cmp)(const void *, const void *));
+bool vx_dedup_hash_(void **vx_p);
+bool vx_dedup_hash_parallel_(void **vx_p);
+
+#ifndef VX_GATHER_PREFETCH_MIN
+#define VX_GATHER_PREFETCH_MIN ((size_t)16 << 20)
 #endif
-		return false;
-	}
 
-	tag->capacity = new_capacity;
+#define vx_gather(src, idx, out) vx_gather_(src, idx, (void **)&out)
+#define vx_permute_into(vx, perm, out) \
+	vx_permute_into_(vx, perm, (void **)&out)
 
-	return true;
-}
+bool  vx_deinterleave(const void *vx, size_t width, void **fields);
+void *vx_interleave(void *const *fields, size_t n);
+bool  vx_gather_(const void *src, const uint32_t *idx, void **out_p);
+bool  vx_scatter(const void *src, const uint32_t *idx, void *dest);
+bool  vx_permute_inplace(void *vx, const uint32_t *perm);
+bool  vx_permute_into_(const void *vx, const uint32_t *perm, void **out_p);
+bool  vx_stable_partition(void *vx,
+                          bool (*pred)(const void *, void *),
+                          void   *ctx,
+                          size_t *split);
 
-bool vx_grow_(void **vx_p, size_t grow_by)
-{
-	struct vx_tag *tag        = vx_tag(*vx_p);
-	size_t         prev_count = tag->count;
+#ifdef VX_HINTS
+void *vx_new_hinted_(size_t unit,
+                     size_t count,
+                     void (*unit_free)(void *),
+                     struct vx_hint *hint);
+void  vx_hint_update(struct vx_hint *hint, size_t count);
+#endif
+#ifdef VX_ALLOCATOR
+void *vx_new_with_(size_t unit,
+                   size_t count,
+                   void (*unit_free)(void *),
+                   struct vx_allocator alloc);
+#endif
+#ifdef VX_OUTLINE
+struct vx_tag *vx_outline_tag(const void *vx);
+void          *vx_adopt_(size_t unit,
+                         void  *ptr,
+                         size_t count,
+                         size_t capacity,
+                         void *(*realloc_fn)(void *, size_t),
+                         void (*free_fn)(void *));
+#endif
+#ifdef VX_SHRINK_POLICY
+void vx_shrink_policy_(void *vx, unsigned below, unsigned to);
+bool vx_shrink_policy_apply_(void **vx_p);
+#endif
+#ifdef VX_REGISTRY
+bool   vx_register_(void **vx_p);
+void   vx_unregister_(void *vx);
+size_t vx_registry_bytes(void);
+size_t vx_registry_slack(void);
+void   vx_set_budget(size_t bytes);
+size_t vx_trim_all(size_t target);
+size_t vx_trim_budget(void);
+#ifdef __linux__
+int vx_psi_open(unsigned stall_us, unsigned window_us);
+#endif
+#endif
 
-	if (tag->capacity < tag->count + grow_by) {
-		if (!vx_reserve_(vx_p, tag->count + grow_by)) {
-			return false;
-		}
-		tag = vx_tag(*vx_p);
+#ifdef VX_SHRINK_POLICY
+#define vx_typed_shrink_(vx_p) vx_shrink_policy_apply_((void **)(vx_p))
+#else
+#define vx_typed_shrink_(vx_p) true
+#endif
 
-		for (size_t i = prev_count; i < tag->count; i++) {
-			for (size_t j = 0; j < tag->unit; j++) {
-				tag->data[tag->unit * i + j] = 0;
-			}
-		}
+// The functions declared by VX_DECLARE() know the unit size at compile time, so
+// each inlines down to a capacity check and a constant-stride move. Growth and
+// vectors with unit_free() set take the generic paths out of line.
+
+#define VX_DECLARE(name, type)                                                 \
+	static inline type *name##_new(size_t count)                           \
+	{                                                                      \
+		return (type *)vx_new_(sizeof(type), count, NULL);             \
+	}                                                                      \
+                                                                               \
+	static inline bool name##_push(type **vx_p, type value)                \
+	{                                                                      \
+		struct vx_tag *tag   = vx_tag(*vx_p);                          \
+		size_t         count = vx_tag_count(tag);                      \
+                                                                               \
+		if (count == vx_tag_capacity(tag)) {                           \
+			if (!vx_expand_((void **)vx_p, count + 1)) {           \
+				return false;                                  \
+			}                                                      \
+			tag = vx_tag(*vx_p);                                   \
+		}                                                              \
+                                                                               \
+		(*vx_p)[count] = value;                                        \
+		vx_tag_set_count(tag, count + 1);                              \
+                                                                               \
+		return true;                                                   \
+	}                                                                      \
+                                                                               \
+	static inline bool name##_append(type **vx_p, const type *src,         \
+	                                 size_t n)                             \
+	{                                                                      \
+		struct vx_tag *tag   = vx_tag(*vx_p);                          \
+		size_t         count = vx_tag_count(tag);                      \
+                                                                               \
+		if (count + n > vx_tag_capacity(tag)) {                        \
+			if (!vx_expand_((void **)vx_p, count + n)) {           \
+				return false;                                  \
+			}                                                      \
+			tag = vx_tag(*vx_p);                                   \
+		}                                                              \
+                                                                               \
+		memcpy(*vx_p + count, src, n * sizeof(type));                  \
+		vx_tag_set_count(tag, count + n);                              \
+                                                                               \
+		return true;                                                   \
+	}                                                                      \
+                                                                               \
+	static inline bool name##_insert(type **vx_p, size_t index,            \
+	                                 type value)                           \
+	{                                                                      \
+		struct vx_tag *tag   = vx_tag(*vx_p);                          \
+		size_t         count = vx_tag_count(tag);                      \
+                                                                               \
+		if (count == vx_tag_capacity(tag)) {                           \
+			if (!vx_expand_((void **)vx_p, count + 1)) {           \
+				return false;                                  \
+			}                                                      \
+			tag = vx_tag(*vx_p);                                   \
+		}                                                              \
+                                                                               \
+		memmove(*vx_p + index + 1,                                     \
+		        *vx_p + index,                                         \
+		        (count - index) * sizeof(type));                       \
+		(*vx_p)[index] = value;                                        \
+		vx_tag_set_count(tag, count + 1);                              \
+                                                                               \
+		return true;                                                   \
+	}                                                                      \
+                                                                               \
+	static inline bool name##_erase(type **vx_p, size_t index, size_t n)   \
+	{                                                                      \
+		struct vx_tag *tag   = vx_tag(*vx_p);                          \
+		size_t         count = vx_tag_count(tag);                      \
+                                                                               \
+		if (vx_tag_unit_free(tag)) {                                   \
+			return vx_shift_((void **)vx_p, index + n,             \
+			                 -(ptrdiff_t)n);                       \
+		}                                                              \
+                                                                               \
+		memmove(*vx_p + index,                                         \
+		        *vx_p + index + n,                                     \
+		        (count - index - n) * sizeof(type));                   \
+		vx_tag_set_count(tag, count - n);                              \
+                                                                               \
+		return vx_typed_shrink_(vx_p);                                 \
+	}                                                                      \
+                                                                               \
+	static inline bool name##_pop(type **vx_p, type *out)                  \
+	{                                                                      \
+		struct vx_tag *tag   = vx_tag(*vx_p);                          \
+		size_t         count = vx_tag_count(tag);                      \
+                                                                               \
+		if (!count || vx_tag_unit_free(tag)) {                         \
+			return vx_pop_((void **)vx_p, out);                    \
+		}                                                              \
+                                                                               \
+		if (out) {                                                     \
+			*out = (*vx_p)[count - 1];                             \
+		}                                                              \
+		vx_tag_set_count(tag, count - 1);                              \
+                                                                               \
+		return vx_typed_shrink_(vx_p);                                 \
 	}
 
-	tag->count += grow_by;
+#ifdef VX_IMPLEMENT
 
-	return true;
-}
+// Tables shared between all vectors (the outline table and the descriptor
+// table of compact mode) are guarded by spinlocks, which are only ever held for
+// a few loads and stores. Without GNU atomics, there is no locking, and those
+// modes are then single-threaded.
 
-bool vx_append_(void **vx_p, void *src, size_t count)
+#if defined(__GNUC__) || defined(__clang__)
+typedef unsigned char vx_lock;
+
+void vx_lock_acquire(vx_lock *lock)
 {
-	if (!vx_grow_(vx_p, count)) {
-		return false;
+	while (__atomic_test_and_set(lock, __ATOMIC_ACQUIRE)) {
+		while (__atomic_load_n(lock, __ATOMIC_RELAXED)) {
+		}
 	}
+}
 
-	struct vx_tag *tag = vx_tag(*vx_p);
+void vx_lock_release(vx_lock *lock)
+{
+	__atomic_clear(lock, __ATOMIC_RELEASE);
+}
 
-	memmove(tag->data + tag->unit * (tag->count - count),
-	        src,
-	        tag->unit * count);
+#define vx_load_acquire(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define vx_store_release(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#else
+typedef unsigned char vx_lock;
 
-	return true;
+void vx_lock_acquire(vx_lock *lock)
+{
+	(void)lock;
 }
 
-bool vx_shift_(void **vx_p, size_t index, ptrdiff_t shift)
+void vx_lock_release(vx_lock *lock)
 {
-	struct vx_tag *tag        = vx_tag(*vx_p);
-	size_t         prev_count = tag->count;
-
-	if (shift > 0) {
-		if (!vx_grow_(vx_p, shift)) {
-			return false;
-		}
-		tag = vx_tag(*vx_p);
-	}
+	(void)lock;
+}
 
-	memmove(tag->data + tag->unit * (index + shift),
-	        tag->data + tag->unit * index,
-	        tag->unit * (prev_count - index));
+#define vx_load_acquire(p) (*(p))
+#define vx_store_release(p, v) (*(p) = (v))
+#endif
 
-	if (shift < 0) {
-		if (tag->unit_free) {
-			for (size_t i = prev_count; i < tag->count; i++) {
-				if (vx_unit_nonempty(tag, i)) {
-					tag->unit_free(tag->data
-					               + tag->unit * i);
-				}
-			}
-		}
+#ifdef VX_COMPACT
+struct vx_desc vx_descs[VX_DESC_MAX];
+size_t         vx_desc_count;
+vx_lock        vx_desc_lock;
 
-		tag->count += shift;
-	} else if (shift > 0 && tag->unit_free) {
-		for (size_t i = index; i < index + shift; i++) {
-			for (size_t j = 0; j < tag->unit; j++) {
-				tag->data[tag->unit * i + j] = 0;
-			}
+size_t
+vx_desc_search(size_t from, size_t to, size_t unit, void (*unit_free)(void *))
+{
+	for (size_t i = from; i < to; i++) {
+		if (vx_descs[i].unit == unit
+		    && vx_descs[i].unit_free == unit_free) {
+			return i;
 		}
 	}
 
-	return true;
+	return to;
 }
 
-bool vx_emplace_(void **dest_p, size_t index, void *src, size_t count)
+size_t vx_desc_find(size_t unit, void (*unit_free)(void *))
 {
-	if (!vx_shift_(dest_p, index, count)) {
-		return false;
+	// Descriptors are only ever appended, each written before the count
+	// which publishes it, so those already published are searched without
+	// the lock, which is only taken to add one.
+
+	size_t count = vx_load_acquire(&vx_desc_count);
+	size_t desc  = vx_desc_search(0, count, unit, unit_free);
+	if (desc < count) {
+		return desc;
 	}
 
-	struct vx_tag *tag = vx_tag(*dest_p);
-	memmove(tag->data + tag->unit * index, src, tag->unit * count);
+	vx_lock_acquire(&vx_desc_lock);
 
-	return true;
-}
+	// Another thread may have added the same descriptor meanwhile.
 
-bool vx_shrink_(void **vx_p)
-{
-	struct vx_tag *tag = vx_tag(*vx_p);
+	size_t added = vx_desc_count;
+	desc         = vx_desc_search(count, added, unit, unit_free);
 
-	tag = realloc(tag, sizeof(struct vx_tag) + tag->unit * tag->count);
-	if (!tag) {
+	if (desc == VX_DESC_MAX) {
 #ifdef VX_USER_ERRORS
-		perror(strerror(errno));
+		fprintf(stderr, "Error registering vector descriptor.\n");
 #endif
-		return false;
+		desc = (size_t)-1;
+	} else if (desc == added) {
+		vx_descs[desc].unit      = unit;
+		vx_descs[desc].unit_free = unit_free;
+		vx_store_release(&vx_desc_count, added + 1);
 	}
 
-	tag->capacity = tag->count;
-	*vx_p         = tag->data;
+	vx_lock_release(&vx_desc_lock);
 
-	return true;
+	return desc;
 }
 
-char *vx_str_new(const char *fmt, ...)
+struct vx_tag *
+vx_tag_new_(size_t unit, size_t capacity, void (*unit_free)(void *))
 {
-	va_list args;
+	size_t desc = vx_desc_find(unit, unit_free);
+	if (desc == (size_t)-1) {
+		return NULL;
+	}
 
-	va_start(args, fmt);
-	size_t len = vsnprintf(NULL, 0, fmt, args);
-	va_end(args);
+	bool   wide   = capacity > UINT32_MAX;
+	size_t prefix = wide ? VX_WIDE_SIZE : 0;
 
-	char *str = vx_new(char, len + 1, NULL);
-	if (!str) {
+	unsigned char *block =
+	    calloc(1, prefix + VX_TAG_SIZE + unit * capacity);
+	if (!block) {
+#ifdef VX_USER_ERRORS
+		perror(strerror(errno));
+#endif
 		return NULL;
 	}
 
-	va_start(args, fmt);
-	vsnprintf(str, len + 1, fmt, args);
-	va_end(args);
-
-	return str;
-}
+	struct vx_tag *tag = (struct vx_tag *)(block + prefix);
+	tag->desc          = desc;
 
-bool vx_str_push_(char **vx_p, char c)
-{
-	if (!vx_grow_((void **)vx_p, 1)) {
-		return false;
+	if (wide) {
+		tag->flags             = VX_TAG_WIDE;
+		tag->size.wide         = (struct vx_wide *)block;
+		vx_wide(tag)->capacity = capacity;
+	} else {
+		tag->size.narrow.capacity = capacity;
 	}
 
-	struct vx_tag *tag        = vx_tag(*vx_p);
-	tag->data[tag->count - 2] = c;
-	tag->data[tag->count - 1] = 0;
-
-	return true;
+	return tag;
 }
 
-bool vx_str_append_(char **vx_p, const char *fmt, ...)
+struct vx_tag *vx_tag_resize_(struct vx_tag *tag, size_t capacity)
 {
-	size_t  prev_count = vx_tag(*vx_p)->count;
-	va_list args;
+	size_t unit     = vx_tag_unit(tag);
+	size_t count    = vx_tag_count(tag);
+	bool   was_wide = tag->flags & VX_TAG_WIDE;
+	bool   wide     = capacity > UINT32_MAX;
+	size_t prefix   = wide ? VX_WIDE_SIZE : 0;
 
-	va_start(args, fmt);
-	size_t len = vsnprintf(NULL, 0, fmt, args);
-	va_end(args);
+	unsigned char *block =
+	    was_wide ? (unsigned char *)vx_wide(tag) : (unsigned char *)tag;
 
-	if (!vx_grow_((void **)vx_p, len)) {
+	if (wide == was_wide) {
+		block = realloc(block, prefix + VX_TAG_SIZE + unit * capacity);
+		if (!block) {
+#ifdef VX_USER_ERRORS
+			perror(strerror(errno));
+#endif
+			return NULL;
+		}
+		tag = (struct vx_tag *)(block + prefix);
+	} else {
+		// Crossing the 32-bit limit moves the data relative to the
+		// start of the allocation, so the vector is copied into a new
+		// block.
+
+		unsigned char *new_block =
+		    malloc(prefix + VX_TAG_SIZE + unit * capacity);
+		if (!new_block) {
+#ifdef VX_USER_ERRORS
+			perror(strerror(errno));
+#endif
+			return NULL;
+		}
+
+		struct vx_tag *new_tag = (struct vx_tag *)(new_block + prefix);
+		*new_tag               = *tag;
+		memcpy(vx_data(new_tag), vx_data(tag), unit * count);
+		free(block);
+
+		block      = new_block;
+		tag        = new_tag;
+		tag->flags = wide ? tag->flags | VX_TAG_WIDE
+		                  : tag->flags & ~VX_TAG_WIDE;
+	}
+
+	if (wide) {
+		tag->size.wide         = (struct vx_wide *)block;
+		vx_wide(tag)->count    = count;
+		vx_wide(tag)->capacity = capacity;
+	} else {
+		tag->size.narrow.count    = count;
+		tag->size.narrow.capacity = capacity;
+	}
+
+	return tag;
+}
+
+void vx_tag_release_(struct vx_tag *tag)
+{
+	free(tag->flags & VX_TAG_WIDE ? (void *)vx_wide(tag) : (void *)tag);
+}
+#else
+void vx_tag_init_(struct vx_tag *tag,
+                  size_t         unit,
+                  size_t         capacity,
+                  void (*unit_free)(void *))
+{
+	tag->unit_free = unit_free;
+	tag->unit      = unit;
+	tag->capacity  = capacity;
+#ifdef VX_REGISTRY
+	tag->reg_index = (size_t)-1;
+#endif
+#ifdef VX_SHRINK_POLICY
+	tag->shrink_below = VX_SHRINK_BELOW;
+	tag->shrink_to    = VX_SHRINK_TO;
+#endif
+}
+
+#ifdef VX_OUTLINE
+// In outline mode, tags are allocated separately from the data, and found via
+// an open-addressed table keyed by the data pointer. Data owned by the library
+// is over-allocated by VX_ALIGN so that it can be aligned within its block;
+// adopted data has no block and is resized and freed via the functions it was
+// adopted with.
+
+struct vx_outline_slot {
+	const void    *data;
+	struct vx_tag *tag;
+};
+
+// The table is split into shards by hash, each an open-addressed table with
+// its own lock, so that threads working on their own vectors rarely contend.
+
+struct vx_outline_shard {
+	struct vx_outline_slot *slots;
+	size_t                  size;
+	size_t                  used;
+	vx_lock                 lock;
+};
+
+struct vx_outline_shard vx_outline_shards[VX_OUTLINE_SHARDS];
+
+size_t vx_outline_hash(const void *data)
+{
+	size_t h = (size_t)((uintptr_t)data / VX_ALIGN);
+	h ^= h >> 16;
+	h *= (size_t)0x9E3779B97F4A7C15ull;
+
+	return h ^ (h >> 16);
+}
+
+struct vx_outline_shard *vx_outline_shard(size_t hash)
+{
+	return &vx_outline_shards[hash % VX_OUTLINE_SHARDS];
+}
+
+struct vx_tag *vx_outline_tag(const void *vx)
+{
+	size_t                   hash  = vx_outline_hash(vx);
+	struct vx_outline_shard *shard = vx_outline_shard(hash);
+	struct vx_tag           *tag   = NULL;
+
+	vx_lock_acquire(&shard->lock);
+
+	if (shard->size) {
+		size_t mask = shard->size - 1;
+
+		for (size_t i = (hash / VX_OUTLINE_SHARDS) & mask;
+		     shard->slots[i].data;
+		     i = (i + 1) & mask) {
+			if (shard->slots[i].data == vx) {
+				tag = shard->slots[i].tag;
+				break;
+			}
+		}
+	}
+
+	vx_lock_release(&shard->lock);
+
+	return tag;
+}
+
+// Inserts into 'shard', whose lock is held, growing it first if it is half
+// full. If growing fails, a 'forced' insert still goes ahead while a slot is
+// free, for callers which cannot back out.
+
+bool vx_outline_shard_insert(struct vx_outline_shard *shard,
+                             struct vx_tag           *tag,
+                             bool                     forced)
+{
+	if ((shard->used + 1) * 2 > shard->size) {
+		size_t prev_size = shard->size;
+		size_t size      = prev_size ? prev_size * 2 : 16;
+
+		struct vx_outline_slot *prev_slots = shard->slots;
+		struct vx_outline_slot *slots = calloc(size, sizeof(*slots));
+
+		if (slots) {
+			shard->slots = slots;
+			shard->size  = size;
+			shard->used  = 0;
+
+			for (size_t i = 0; i < prev_size; i++) {
+				if (prev_slots[i].data) {
+					vx_outline_shard_insert(
+					    shard, prev_slots[i].tag, false);
+				}
+			}
+			free(prev_slots);
+		} else if (!forced || shard->used + 1 >= shard->size) {
+#ifdef VX_USER_ERRORS
+			perror(strerror(errno));
+#endif
+			return false;
+		}
+	}
+
+	size_t mask = shard->size - 1;
+	size_t i    = (vx_outline_hash(tag->data) / VX_OUTLINE_SHARDS) & mask;
+	while (shard->slots[i].data) {
+		i = (i + 1) & mask;
+	}
+
+	shard->slots[i].data = tag->data;
+	shard->slots[i].tag  = tag;
+	shard->used++;
+
+	return true;
+}
+
+bool vx_outline_insert(struct vx_tag *tag, bool forced)
+{
+	struct vx_outline_shard *shard =
+	    vx_outline_shard(vx_outline_hash(tag->data));
+
+	vx_lock_acquire(&shard->lock);
+	bool ok = vx_outline_shard_insert(shard, tag, forced);
+	vx_lock_release(&shard->lock);
+
+	return ok;
+}
+
+void vx_outline_remove(const void *data)
+{
+	struct vx_outline_shard *shard =
+	    vx_outline_shard(vx_outline_hash(data));
+
+	vx_lock_acquire(&shard->lock);
+
+	size_t mask = shard->size - 1;
+	size_t i    = (vx_outline_hash(data) / VX_OUTLINE_SHARDS) & mask;
+
+	while (shard->slots[i].data != data) {
+		i = (i + 1) & mask;
+	}
+
+	// Later entries of the same probe run are shifted back into the hole,
+	// so that lookups never stop short at an emptied slot.
+
+	for (size_t j = (i + 1) & mask; shard->slots[j].data;
+	     j = (j + 1) & mask) {
+		size_t home = (vx_outline_hash(shard->slots[j].data)
+		               / VX_OUTLINE_SHARDS)
+		              & mask;
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			shard->slots[i] = shard->slots[j];
+			i               = j;
+		}
+	}
+
+	shard->slots[i].data = NULL;
+	shard->used--;
+
+	vx_lock_release(&shard->lock);
+}
+
+unsigned char *vx_outline_align(void *block)
+{
+	return (unsigned char *)(((uintptr_t)block + VX_ALIGN - 1)
+	                         & ~(uintptr_t)(VX_ALIGN - 1));
+}
+
+struct vx_tag *
+vx_tag_new_(size_t unit, size_t capacity, void (*unit_free)(void *))
+{
+	struct vx_tag *tag = calloc(1, sizeof(*tag));
+	if (!tag) {
+#ifdef VX_USER_ERRORS
+		perror(strerror(errno));
+#endif
+		return NULL;
+	}
+
+	tag->block = calloc(1, unit * capacity + VX_ALIGN);
+	if (!tag->block) {
+#ifdef VX_USER_ERRORS
+		perror(strerror(errno));
+#endif
+		free(tag);
+		return NULL;
+	}
+
+	vx_tag_init_(tag, unit, capacity, unit_free);
+	tag->data = vx_outline_align(tag->block);
+
+	if (!vx_outline_insert(tag, false)) {
+		free(tag->block);
+		free(tag);
+		return NULL;
+	}
+
+	return tag;
+}
+
+void *vx_adopt_(size_t unit,
+                void  *ptr,
+                size_t count,
+                size_t capacity,
+                void *(*realloc_fn)(void *, size_t),
+                void (*free_fn)(void *))
+{
+	if (!ptr || count > capacity) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error adopting invalid buffer.\n");
+#endif
+		return NULL;
+	}
+
+	struct vx_tag *tag = calloc(1, sizeof(*tag));
+	if (!tag) {
+#ifdef VX_USER_ERRORS
+		perror(strerror(errno));
+#endif
+		return NULL;
+	}
+
+	vx_tag_init_(tag, unit, capacity, NULL);
+	tag->count      = count;
+	tag->data       = ptr;
+	tag->realloc_fn = realloc_fn;
+	tag->free_fn    = free_fn;
+
+	if (!vx_outline_insert(tag, false)) {
+		free(tag);
+		return NULL;
+	}
+
+	return ptr;
+}
+
+struct vx_tag *vx_tag_resize_(struct vx_tag *tag, size_t capacity)
+{
+	unsigned char *data;
+
+	if (tag->block) {
+		size_t offset = tag->data - (unsigned char *)tag->block;
+
+		void *block =
+		    realloc(tag->block, tag->unit * capacity + VX_ALIGN);
+		if (!block) {
+#ifdef VX_USER_ERRORS
+			perror(strerror(errno));
+#endif
+			return NULL;
+		}
+
+		// realloc() only preserves the alignment of malloc(), so the
+		// data is moved if its offset within the block has changed.
+
+		data = vx_outline_align(block);
+		if (data != (unsigned char *)block + offset) {
+			memmove(data,
+			        (unsigned char *)block + offset,
+			        tag->unit * tag->count);
+		}
+		tag->block = block;
+	} else if (tag->realloc_fn) {
+		data = tag->realloc_fn(tag->data,
+		                       capacity ? tag->unit * capacity : 1);
+		if (!data) {
+#ifdef VX_USER_ERRORS
+			fprintf(stderr, "Error resizing adopted vector.\n");
+#endif
+			return NULL;
+		}
+	} else if (capacity <= tag->capacity) {
+		// Without a reallocator, an adopted buffer cannot be shrunk,
+		// but keeping it as-is is still correct.
+		return tag;
+	} else {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error growing adopted vector.\n");
+#endif
+		return NULL;
+	}
+
+	if (data != tag->data) {
+		// The data has already moved, so the new key is inserted even if
+		// its shard cannot grow; it only fails once the shard is full.
+		vx_outline_remove(tag->data);
+		tag->data = data;
+		vx_outline_insert(tag, true);
+	}
+	tag->capacity = capacity;
+
+	return tag;
+}
+
+void vx_tag_release_(struct vx_tag *tag)
+{
+	vx_outline_remove(tag->data);
+
+	if (tag->block) {
+		free(tag->block);
+	} else if (tag->free_fn) {
+		tag->free_fn(tag->data);
+	}
+
+	free(tag);
+}
+#else
+struct vx_tag *
+vx_tag_new_(size_t unit, size_t capacity, void (*unit_free)(void *))
+{
+	struct vx_tag *tag = calloc(1, VX_TAG_SIZE + unit * capacity);
+	if (!tag) {
+#ifdef VX_USER_ERRORS
+		perror(strerror(errno));
+#endif
+		return NULL;
+	}
+
+	vx_tag_init_(tag, unit, capacity, unit_free);
+
+	return tag;
+}
+
+struct vx_tag *vx_tag_resize_(struct vx_tag *tag, size_t capacity)
+{
+	size_t size = VX_TAG_SIZE + tag->unit * capacity;
+
+#ifdef VX_ALLOCATOR
+	if (tag->alloc.resize) {
+		tag = tag->alloc.resize(tag->alloc.ctx,
+		                        tag,
+		                        VX_TAG_SIZE + tag->unit * tag->capacity,
+		                        size);
+	} else {
+		tag = realloc(tag, size);
+	}
+#else
+	tag = realloc(tag, size);
+#endif
+	if (!tag) {
+#ifdef VX_USER_ERRORS
+		perror(strerror(errno));
+#endif
+		return NULL;
+	}
+
+	tag->capacity = capacity;
+
+	return tag;
+}
+
+void vx_tag_release_(struct vx_tag *tag)
+{
+#ifdef VX_ALLOCATOR
+	if (tag->alloc.resize) {
+		tag->alloc.resize(tag->alloc.ctx,
+		                  tag,
+		                  VX_TAG_SIZE + tag->unit * tag->capacity,
+		                  0);
+		return;
+	}
+#endif
+
+	free(tag);
+}
+#endif
+#endif
+
+void *vx_new_(size_t unit, size_t count, void (*unit_free)(void *))
+{
+	struct vx_tag *tag = vx_tag_new_(unit, count, unit_free);
+	if (!tag) {
+		return NULL;
+	}
+
+	vx_tag_set_count(tag, count);
+
+	return vx_data(tag);
+}
+
+#ifdef VX_ALLOCATOR
+void *vx_new_with_(size_t unit,
+                   size_t count,
+                   void (*unit_free)(void *),
+                   struct vx_allocator alloc)
+{
+	size_t size = VX_TAG_SIZE + unit * count;
+
+	struct vx_tag *tag = alloc.resize(alloc.ctx, NULL, 0, size);
+	if (!tag) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error allocating vector.\n");
+#endif
+		return NULL;
+	}
+
+	memset(tag, 0, size);
+	vx_tag_init_(tag, unit, count, unit_free);
+	tag->count = count;
+	tag->alloc = alloc;
+
+	return vx_data(tag);
+}
+#endif
+
+#ifdef VX_HINTS
+void *vx_new_hinted_(size_t unit,
+                     size_t count,
+                     void (*unit_free)(void *),
+                     struct vx_hint *hint)
+{
+	size_t capacity = hint->estimate > count ? hint->estimate : count;
+
+	struct vx_tag *tag = vx_tag_new_(unit, capacity, unit_free);
+	if (!tag) {
+		return NULL;
+	}
+
+	tag->count = count;
+	tag->hint  = hint;
+
+	return vx_data(tag);
+}
+
+void vx_hint_update(struct vx_hint *hint, size_t count)
+{
+	// The estimate jumps straight up to any larger final count, so that a
+	// site never keeps reallocating, but only decays by an eighth of the
+	// difference when vectors end up smaller, so that a single small vector
+	// does not throw away the capacity learned from many large ones.
+
+	if (count >= hint->estimate) {
+		hint->estimate = count;
+	} else {
+		hint->estimate -= (hint->estimate - count) / 8;
+	}
+}
+#endif
+
+bool vx_unit_nonempty(struct vx_tag *tag, size_t index)
+{
+	// This function checks if a given unit is non-empty (i.e. not all
+	// zeros/NULL). This is necessary to prevent freeing zero/NULL units of
+	// arbitrary size if unit_free() is set.
+
+	size_t unit = vx_tag_unit(tag);
+
+	for (size_t i = 0; i < unit; i++) {
+		if (vx_data(tag)[unit * index + i]) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void vx_free_(void **vx_p)
+{
+	if (!*vx_p) {
+		return;
+	}
+
+	struct vx_tag *tag = vx_tag(*vx_p);
+	*vx_p              = NULL;
+
+#ifdef VX_HINTS
+	if (tag->hint) {
+		vx_hint_update(tag->hint, tag->count);
+	}
+#endif
+#ifdef VX_REGISTRY
+	vx_unregister_(vx_data(tag));
+#endif
+
+	void (*unit_free)(void *) = vx_tag_unit_free(tag);
+	if (unit_free) {
+		size_t unit  = vx_tag_unit(tag);
+		size_t count = vx_tag_count(tag);
+
+		for (size_t i = 0; i < count; i++) {
+			if (vx_unit_nonempty(tag, i)) {
+				unit_free(vx_data(tag) + unit * i);
+			}
+		}
+	}
+
+	vx_tag_release_(tag);
+}
+
+bool vx_reserve_(void **vx_p, size_t new_capacity)
+{
+	struct vx_tag *tag = vx_tag(*vx_p);
+
+	if (new_capacity < vx_tag_count(tag)) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr,
+		        "Error resizing vector below current contents.\n");
+#endif
+		return false;
+	}
+
+	tag = vx_tag_resize_(tag, new_capacity);
+	if (!tag) {
+		return false;
+	}
+
+	*vx_p = vx_data(tag);
+
+	return true;
+}
+
+bool vx_grow_(void **vx_p, size_t grow_by)
+{
+	struct vx_tag *tag   = vx_tag(*vx_p);
+	size_t         count = vx_tag_count(tag);
+
+	if (vx_tag_capacity(tag) < count + grow_by) {
+		if (!vx_reserve_(vx_p, count + grow_by)) {
+			return false;
+		}
+		tag = vx_tag(*vx_p);
+	}
+
+	memset(vx_data(tag) + vx_tag_unit(tag) * count,
+	       0,
+	       vx_tag_unit(tag) * grow_by);
+	vx_tag_set_count(tag, count + grow_by);
+
+	return true;
+}
+
+bool vx_append_(void **vx_p, void *src, size_t count)
+{
+	if (!vx_grow_(vx_p, count)) {
+		return false;
+	}
+
+	struct vx_tag *tag  = vx_tag(*vx_p);
+	size_t         unit = vx_tag_unit(tag);
+
+	memmove(vx_data(tag) + unit * (vx_tag_count(tag) - count),
+	        src,
+	        unit * count);
+
+	return true;
+}
+
+bool vx_shift_(void **vx_p, size_t index, ptrdiff_t shift)
+{
+	struct vx_tag *tag        = vx_tag(*vx_p);
+	size_t         unit       = vx_tag_unit(tag);
+	size_t         prev_count = vx_tag_count(tag);
+
+	void (*unit_free)(void *) = vx_tag_unit_free(tag);
+
+	if (shift > 0) {
+		if (!vx_grow_(vx_p, shift)) {
+			return false;
+		}
+		tag = vx_tag(*vx_p);
+	} else if (shift < 0 && unit_free) {
+		for (size_t i = index + shift; i < index; i++) {
+			if (vx_unit_nonempty(tag, i)) {
+				unit_free(vx_data(tag) + unit * i);
+			}
+		}
+	}
+
+	memmove(vx_data(tag) + unit * (index + shift),
+	        vx_data(tag) + unit * index,
+	        unit * (prev_count - index));
+
+	if (shift < 0) {
+		vx_tag_set_count(tag, prev_count + shift);
+#ifdef VX_SHRINK_POLICY
+		return vx_shrink_policy_apply_(vx_p);
+#endif
+	} else if (shift > 0 && unit_free) {
+		for (size_t i = index; i < index + shift; i++) {
+			for (size_t j = 0; j < unit; j++) {
+				vx_data(tag)[unit * i + j] = 0;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool vx_emplace_(void **dest_p, size_t index, void *src, size_t count)
+{
+	if (!vx_shift_(dest_p, index, count)) {
+		return false;
+	}
+
+	struct vx_tag *tag  = vx_tag(*dest_p);
+	size_t         unit = vx_tag_unit(tag);
+	memmove(vx_data(tag) + unit * index, src, unit * count);
+
+	return true;
+}
+
+bool vx_shrink_(void **vx_p)
+{
+	struct vx_tag *tag = vx_tag(*vx_p);
+
+	tag = vx_tag_resize_(tag, vx_tag_count(tag));
+	if (!tag) {
+		return false;
+	}
+
+	*vx_p = vx_data(tag);
+
+	return true;
+}
+
+bool vx_pop_(void **vx_p, void *out)
+{
+	struct vx_tag *tag   = vx_tag(*vx_p);
+	size_t         unit  = vx_tag_unit(tag);
+	size_t         count = vx_tag_count(tag);
+
+	if (!count) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error popping from an empty vector.\n");
+#endif
+		return false;
+	}
+
+	vx_tag_set_count(tag, --count);
+
+	unsigned char *last = vx_data(tag) + unit * count;
+	if (out) {
+		memcpy(out, last, unit);
+	} else if (vx_tag_unit_free(tag) && vx_unit_nonempty(tag, count)) {
+		vx_tag_unit_free(tag)(last);
+	}
+
+#ifdef VX_SHRINK_POLICY
+	return vx_shrink_policy_apply_(vx_p);
+#else
+	return true;
+#endif
+}
+
+bool vx_expand_(void **vx_p, size_t min_capacity)
+{
+	// Unlike vx_grow(), which reserves exactly what is asked for, this
+	// doubles the capacity so that repeated pushes are amortized O(1).
+
+	size_t capacity = vx_tag_capacity(vx_tag(*vx_p)) * 2;
+
+	if (capacity < VX_CHUNK_COUNT) {
+		capacity = VX_CHUNK_COUNT;
+	}
+	if (capacity < min_capacity) {
+		capacity = min_capacity;
+	}
+
+	return vx_reserve_(vx_p, capacity);
+}
+
+#ifdef VX_SHRINK_POLICY
+void vx_shrink_policy_(void *vx, unsigned below, unsigned to)
+{
+	struct vx_tag *tag = vx_tag(vx);
+
+	// A shrink must leave room for the remaining units, and must not be
+	// triggered again by the capacity it leaves, so 1 <= to < below.
+
+	if (below) {
+		if (below > USHRT_MAX) {
+			below = USHRT_MAX;
+		}
+		if (below < 2) {
+			below = 2;
+		}
+		if (to < 1) {
+			to = 1;
+		}
+		if (to >= below) {
+			to = below - 1;
+		}
+	}
+
+	tag->shrink_below = below;
+	tag->shrink_to    = to;
+}
+
+bool vx_shrink_policy_apply_(void **vx_p)
+{
+	// Shrinking only once the count falls well below the capacity, and then
+	// leaving headroom above the count, means a vector oscillating around
+	// some size reallocates a bounded number of times rather than on every
+	// pop/push cycle.
+
+	struct vx_tag *tag = vx_tag(*vx_p);
+
+	if (!tag->shrink_below
+	    || tag->count >= tag->capacity / tag->shrink_below) {
+		return true;
+	}
+
+	// The removal that got here has already succeeded; if the smaller
+	// block cannot be had, the vector simply keeps its current one.
+
+	vx_reserve_(vx_p, tag->count * tag->shrink_to);
+
+	return true;
+}
+#endif
+
+char *vx_str_new(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	size_t len = vsnprintf(NULL, 0, fmt, args);
+	va_end(args);
+
+	char *str = vx_new(char, len + 1, NULL);
+	if (!str) {
+		return NULL;
+	}
+
+	va_start(args, fmt);
+	vsnprintf(str, len + 1, fmt, args);
+	va_end(args);
+
+	return str;
+}
+
+bool vx_str_push_(char **vx_p, char c)
+{
+	if (!vx_grow_((void **)vx_p, 1)) {
+		return false;
+	}
+
+	struct vx_tag *tag   = vx_tag(*vx_p);
+	size_t         count = vx_tag_count(tag);
+
+	vx_data(tag)[count - 2] = c;
+	vx_data(tag)[count - 1] = 0;
+
+	return true;
+}
+
+bool vx_str_append_(char **vx_p, const char *fmt, ...)
+{
+	size_t  prev_count = vx_tag_count(vx_tag(*vx_p));
+	va_list args;
+
+	va_start(args, fmt);
+	size_t len = vsnprintf(NULL, 0, fmt, args);
+	va_end(args);
+
+	if (!vx_grow_((void **)vx_p, len)) {
+		return false;
+	}
+
+	va_start(args, fmt);
+	vsnprintf(*vx_p + prev_count - 1, len + 1, fmt, args);
+	va_end(args);
+
+	return true;
+}
+
+bool vx_str_emplace_(char **vx_p, size_t index, const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	size_t len = vsnprintf(NULL, 0, fmt, args);
+	va_end(args);
+
+	if (!vx_shift_((void **)vx_p, index, len)) {
+		return false;
+	}
+
+	char c = (*vx_p)[index];
+
+	va_start(args, fmt);
+	(*vx_p)[index + vsprintf(*vx_p + index, fmt, args)] = c;
+	va_end(args);
+
+	return true;
+}
+
+// Files
+// =====
+
+#define VX_FILE_MAGIC "vxb1"
+#define VX_FILE_HEADER_SIZE 20
+
+bool vx_write_header(FILE *file, size_t unit, size_t count)
+{
+	unsigned char header[VX_FILE_HEADER_SIZE];
+	uint64_t      unit64  = unit;
+	uint64_t      count64 = count;
+
+	memcpy(header, VX_FILE_MAGIC, 4);
+	memcpy(header + 4, &unit64, 8);
+	memcpy(header + 12, &count64, 8);
+
+	if (fwrite(header, VX_FILE_HEADER_SIZE, 1, file) != 1) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error writing vector header.\n");
+#endif
+		return false;
+	}
+
+	return true;
+}
+
+bool vx_read_header(FILE *file, size_t *unit, size_t *count)
+{
+	unsigned char header[VX_FILE_HEADER_SIZE];
+	uint64_t      unit64, count64;
+
+	if (fread(header, VX_FILE_HEADER_SIZE, 1, file) != 1
+	    || memcmp(header, VX_FILE_MAGIC, 4)) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error reading vector header.\n");
+#endif
+		return false;
+	}
+
+	memcpy(&unit64, header + 4, 8);
+	memcpy(&count64, header + 12, 8);
+
+	if (!unit64 || unit64 > SIZE_MAX || count64 > SIZE_MAX / unit64) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error reading vector header: bad size.\n");
+#endif
+		return false;
+	}
+
+	*unit  = unit64;
+	*count = count64;
+
+	return true;
+}
+
+bool vx_write(const void *vx, FILE *file)
+{
+	struct vx_tag *tag   = vx_tag(vx);
+	size_t         unit  = vx_tag_unit(tag);
+	size_t         count = vx_tag_count(tag);
+
+	if (!vx_write_header(file, unit, count)) {
+		return false;
+	}
+
+	if (fwrite(vx, unit, count, file) != count) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error writing vector.\n");
+#endif
+		return false;
+	}
+
+	return true;
+}
+
+void *vx_read_(size_t unit, FILE *file, void (*unit_free)(void *))
+{
+	size_t file_unit, count;
+
+	if (!vx_read_header(file, &file_unit, &count)) {
+		return NULL;
+	}
+	if (file_unit != unit) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr,
+		        "Error reading vector: unit size %zu, expected %zu.\n",
+		        file_unit,
+		        unit);
+#endif
+		return NULL;
+	}
+
+	void *vx = vx_new_(unit, count, unit_free);
+	if (!vx) {
+		return NULL;
+	}
+
+	if (fread(vx, unit, count, file) != count) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error reading vector: truncated file.\n");
+#endif
+		// The units were never filled in, so must not be freed as such.
+		vx_tag_set_count(vx_tag(vx), 0);
+		vx_free_(&vx);
+		return NULL;
+	}
+
+	return vx;
+}
+
+// SIMD dispatch
+// =============
+// Each family of kernels has an entry in vx_kernels, which is filled in once
+// by vx_simd_resolve() for the level chosen at startup (or by
+// vx_simd_set_level()). vx_simd_resolve() is defined at the end of the
+// implementation, after every kernel it may choose.
+
+enum vx_scan_mode {
+	VX_SCAN_FIRST,
+	VX_SCAN_LAST,
+	VX_SCAN_COUNT,
+};
+
+struct vx_kernels {
+	size_t (*scan)(const unsigned char *data,
+	               size_t               count,
+	               size_t               unit,
+	               uint64_t             key,
+	               enum vx_scan_mode    mode);
+	size_t (*intersect_u32)(const uint32_t *a,
+	                        size_t          a_count,
+	                        const uint32_t *b,
+	                        size_t          b_count,
+	                        uint32_t       *out);
+	void (*deinterleave)(const unsigned char *src,
+	                     void *const         *fields,
+	                     size_t               count,
+	                     size_t               width,
+	                     size_t               k);
+	void (*interleave)(unsigned char *dest,
+	                   void *const   *fields,
+	                   size_t         count,
+	                   size_t         width,
+	                   size_t         k);
+	void (*gather)(const unsigned char *src,
+	               const uint32_t      *idx,
+	               size_t               n,
+	               size_t               unit,
+	               unsigned char       *out);
+};
+
+struct vx_kernels vx_kernels;
+int               vx_simd_current = -1;
+
+void vx_simd_resolve(enum vx_simd level);
+
+static const char *const vx_simd_names[] = {
+	"scalar",
+	"sse2",
+	"sse4.2",
+	"avx2",
+	"avx512",
+};
+
+const char *vx_simd_name(enum vx_simd level)
+{
+	return vx_simd_names[level];
+}
+
+enum vx_simd vx_simd_detect(void)
+{
+#ifdef VX_SIMD_X86
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx512f")
+	    && __builtin_cpu_supports("avx512bw")) {
+		return VX_SIMD_AVX512;
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		return VX_SIMD_AVX2;
+	}
+	if (__builtin_cpu_supports("sse4.2")) {
+		return VX_SIMD_SSE42;
+	}
+	return VX_SIMD_SSE2;
+#else
+	return VX_SIMD_SCALAR;
+#endif
+}
+
+enum vx_simd vx_simd_level(void)
+{
+	if (vx_simd_current < 0) {
+		enum vx_simd level = vx_simd_detect();
+		const char  *env   = getenv("VX_SIMD");
+
+		if (env) {
+			for (int i = VX_SIMD_SCALAR; i <= VX_SIMD_AVX512; i++) {
+				if (!strcmp(env, vx_simd_names[i])
+				    && i < (int)level) {
+					level = (enum vx_simd)i;
+				}
+			}
+		}
+
+		vx_simd_resolve(level);
+	}
+
+	return (enum vx_simd)vx_simd_current;
+}
+
+enum vx_simd vx_simd_set_level(enum vx_simd level)
+{
+	enum vx_simd supported = vx_simd_detect();
+
+	if (level > supported) {
+		level = supported;
+	}
+	vx_simd_resolve(level);
+
+	return level;
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((constructor)) void vx_simd_init(void)
+{
+	vx_simd_level();
+}
+#endif
+
+// Search
+// ======
+// Each scan runs in one of three modes, and returns an index (or SIZE_MAX if
+// there is no match) for VX_SCAN_FIRST and VX_SCAN_LAST, or a number of
+// matches for VX_SCAN_COUNT. The SSE2 and AVX2 kernels turn each comparison
+// into a byte mask, in which a matching unit of 'unit' bytes sets 'unit'
+// consecutive bits, whereas AVX-512 masks have one bit per unit.
+
+static inline bool vx_scan_eq(const unsigned char *a, uint64_t key, size_t unit)
+{
+	switch (unit) {
+	case 1:
+		return *a == (uint8_t)key;
+	case 2: {
+		uint16_t x;
+		memcpy(&x, a, 2);
+		return x == (uint16_t)key;
+	}
+	case 4: {
+		uint32_t x;
+		memcpy(&x, a, 4);
+		return x == (uint32_t)key;
+	}
+	default: {
+		uint64_t x;
+		memcpy(&x, a, 8);
+		return x == key;
+	}
+	}
+}
+
+static inline size_t vx_scan_tail(const unsigned char *data,
+                                  size_t               begin,
+                                  size_t               end,
+                                  size_t               unit,
+                                  uint64_t             key,
+                                  enum vx_scan_mode    mode,
+                                  size_t               matches)
+{
+	// Scans the units [begin, end) without SIMD, continuing a scan which
+	// has already found 'matches' units.
+
+	if (mode == VX_SCAN_LAST) {
+		for (size_t i = end; i-- > begin;) {
+			if (vx_scan_eq(data + unit * i, key, unit)) {
+				return i;
+			}
+		}
+		return SIZE_MAX;
+	}
+
+	for (size_t i = begin; i < end; i++) {
+		if (vx_scan_eq(data + unit * i, key, unit)) {
+			if (mode == VX_SCAN_FIRST) {
+				return i;
+			}
+			matches++;
+		}
+	}
+
+	return mode == VX_SCAN_FIRST ? SIZE_MAX : matches;
+}
+
+size_t vx_scan_scalar(const unsigned char *data,
+                      size_t               count,
+                      size_t               unit,
+                      uint64_t             key,
+                      enum vx_scan_mode    mode)
+{
+	switch (unit) {
+	case 1:
+		return vx_scan_tail(data, 0, count, 1, key, mode, 0);
+	case 2:
+		return vx_scan_tail(data, 0, count, 2, key, mode, 0);
+	case 4:
+		return vx_scan_tail(data, 0, count, 4, key, mode, 0);
+	default:
+		return vx_scan_tail(data, 0, count, 8, key, mode, 0);
+	}
+}
+
+#ifdef VX_SIMD_X86
+static inline __attribute__((always_inline)) unsigned
+vx_scan_mask_sse2(__m128i block, __m128i needle, size_t unit)
+{
+	__m128i eq;
+
+	switch (unit) {
+	case 1:
+		eq = _mm_cmpeq_epi8(block, needle);
+		break;
+	case 2:
+		eq = _mm_cmpeq_epi16(block, needle);
+		break;
+	case 4:
+		eq = _mm_cmpeq_epi32(block, needle);
+		break;
+	default:
+		// SSE2 has no 64-bit comparison, so both halves of each
+		// 64-bit lane must compare equal as 32-bit lanes.
+		eq = _mm_cmpeq_epi32(block, needle);
+		eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, 0xB1));
+		break;
+	}
+
+	return (unsigned)_mm_movemask_epi8(eq);
+}
+
+static inline __attribute__((always_inline)) size_t
+vx_scan_sse2_unit(const unsigned char *data,
+                  size_t               count,
+                  size_t               unit,
+                  uint64_t             key,
+                  enum vx_scan_mode    mode)
+{
+	size_t  per    = 16 / unit;
+	size_t  blocks = count / per;
+	__m128i needle;
+
+	switch (unit) {
+	case 1:
+		needle = _mm_set1_epi8((char)key);
+		break;
+	case 2:
+		needle = _mm_set1_epi16((short)key);
+		break;
+	case 4:
+		needle = _mm_set1_epi32((int)key);
+		break;
+	default:
+		needle = _mm_set1_epi64x((long long)key);
+		break;
+	}
+
+	if (mode == VX_SCAN_LAST) {
+		size_t found = vx_scan_tail(
+		    data, blocks * per, count, unit, key, mode, 0);
+		if (found != SIZE_MAX) {
+			return found;
+		}
+
+		for (size_t b = blocks; b-- > 0;) {
+			__m128i block =
+			    _mm_loadu_si128((const __m128i *)(data + 16 * b));
+			unsigned mask = vx_scan_mask_sse2(block, needle, unit);
+			if (mask) {
+				return b * per
+				       + (31 - __builtin_clz(mask)) / unit;
+			}
+		}
+		return SIZE_MAX;
+	}
+
+	size_t matches = 0;
+	for (size_t b = 0; b < blocks; b++) {
+		__m128i block =
+		    _mm_loadu_si128((const __m128i *)(data + 16 * b));
+		unsigned mask = vx_scan_mask_sse2(block, needle, unit);
+		if (mode == VX_SCAN_FIRST) {
+			if (mask) {
+				return b * per + __builtin_ctz(mask) / unit;
+			}
+		} else {
+			matches += __builtin_popcount(mask);
+		}
+	}
+
+	return vx_scan_tail(
+	    data, blocks * per, count, unit, key, mode, matches / unit);
+}
+
+size_t vx_scan_sse2(const unsigned char *data,
+                    size_t               count,
+                    size_t               unit,
+                    uint64_t             key,
+                    enum vx_scan_mode    mode)
+{
+	switch (unit) {
+	case 1:
+		return vx_scan_sse2_unit(data, count, 1, key, mode);
+	case 2:
+		return vx_scan_sse2_unit(data, count, 2, key, mode);
+	case 4:
+		return vx_scan_sse2_unit(data, count, 4, key, mode);
+	default:
+		return vx_scan_sse2_unit(data, count, 8, key, mode);
+	}
+}
+
+static inline __attribute__((always_inline, target("avx2"))) unsigned
+vx_scan_mask_avx2(__m256i block, __m256i needle, size_t unit)
+{
+	__m256i eq;
+
+	switch (unit) {
+	case 1:
+		eq = _mm256_cmpeq_epi8(block, needle);
+		break;
+	case 2:
+		eq = _mm256_cmpeq_epi16(block, needle);
+		break;
+	case 4:
+		eq = _mm256_cmpeq_epi32(block, needle);
+		break;
+	default:
+		eq = _mm256_cmpeq_epi64(block, needle);
+		break;
+	}
+
+	return (unsigned)_mm256_movemask_epi8(eq);
+}
+
+static inline __attribute__((always_inline, target("avx2"))) size_t
+vx_scan_avx2_unit(const unsigned char *data,
+                  size_t               count,
+                  size_t               unit,
+                  uint64_t             key,
+                  enum vx_scan_mode    mode)
+{
+	size_t  per    = 32 / unit;
+	size_t  blocks = count / per;
+	__m256i needle;
+
+	switch (unit) {
+	case 1:
+		needle = _mm256_set1_epi8((char)key);
+		break;
+	case 2:
+		needle = _mm256_set1_epi16((short)key);
+		break;
+	case 4:
+		needle = _mm256_set1_epi32((int)key);
+		break;
+	default:
+		needle = _mm256_set1_epi64x((long long)key);
+		break;
+	}
+
+	if (mode == VX_SCAN_LAST) {
+		size_t found = vx_scan_tail(
+		    data, blocks * per, count, unit, key, mode, 0);
+		if (found != SIZE_MAX) {
+			return found;
+		}
+
+		for (size_t b = blocks; b-- > 0;) {
+			__m256i block = _mm256_loadu_si256(
+			    (const __m256i *)(data + 32 * b));
+			unsigned mask = vx_scan_mask_avx2(block, needle, unit);
+			if (mask) {
+				return b * per
+				       + (31 - __builtin_clz(mask)) / unit;
+			}
+		}
+		return SIZE_MAX;
+	}
+
+	// Counting consumes two vectors per iteration, to keep enough loads in
+	// flight to run at memory bandwidth.
+
+	size_t matches = 0;
+	size_t b       = 0;
+
+	if (mode == VX_SCAN_COUNT) {
+		for (; b + 2 <= blocks; b += 2) {
+			__m256i lo = _mm256_loadu_si256(
+			    (const __m256i *)(data + 32 * b));
+			__m256i hi = _mm256_loadu_si256(
+			    (const __m256i *)(data + 32 * b + 32));
+			matches += __builtin_popcount(
+			    vx_scan_mask_avx2(lo, needle, unit));
+			matches += __builtin_popcount(
+			    vx_scan_mask_avx2(hi, needle, unit));
+		}
+	}
+
+	for (; b < blocks; b++) {
+		__m256i block =
+		    _mm256_loadu_si256((const __m256i *)(data + 32 * b));
+		unsigned mask = vx_scan_mask_avx2(block, needle, unit);
+		if (mode == VX_SCAN_FIRST) {
+			if (mask) {
+				return b * per + __builtin_ctz(mask) / unit;
+			}
+		} else {
+			matches += __builtin_popcount(mask);
+		}
+	}
+
+	return vx_scan_tail(
+	    data, blocks * per, count, unit, key, mode, matches / unit);
+}
+
+__attribute__((target("avx2"))) size_t
+vx_scan_avx2(const unsigned char *data,
+             size_t               count,
+             size_t               unit,
+             uint64_t             key,
+             enum vx_scan_mode    mode)
+{
+	switch (unit) {
+	case 1:
+		return vx_scan_avx2_unit(data, count, 1, key, mode);
+	case 2:
+		return vx_scan_avx2_unit(data, count, 2, key, mode);
+	case 4:
+		return vx_scan_avx2_unit(data, count, 4, key, mode);
+	default:
+		return vx_scan_avx2_unit(data, count, 8, key, mode);
+	}
+}
+static inline
+    __attribute__((always_inline, target("avx512f,avx512bw"))) uint64_t
+    vx_scan_mask_avx512(__m512i block, __m512i needle, size_t unit)
+{
+	switch (unit) {
+	case 1:
+		return _mm512_cmpeq_epi8_mask(block, needle);
+	case 2:
+		return _mm512_cmpeq_epi16_mask(block, needle);
+	case 4:
+		return _mm512_cmpeq_epi32_mask(block, needle);
+	default:
+		return _mm512_cmpeq_epi64_mask(block, needle);
+	}
+}
+
+static inline __attribute__((always_inline, target("avx512f,avx512bw"))) size_t
+vx_scan_avx512_unit(const unsigned char *data,
+                    size_t               count,
+                    size_t               unit,
+                    uint64_t             key,
+                    enum vx_scan_mode    mode)
+{
+	size_t  per    = 64 / unit;
+	size_t  blocks = count / per;
+	__m512i needle;
+
+	switch (unit) {
+	case 1:
+		needle = _mm512_set1_epi8((char)key);
+		break;
+	case 2:
+		needle = _mm512_set1_epi16((short)key);
+		break;
+	case 4:
+		needle = _mm512_set1_epi32((int)key);
+		break;
+	default:
+		needle = _mm512_set1_epi64((long long)key);
+		break;
+	}
+
+	if (mode == VX_SCAN_LAST) {
+		size_t found = vx_scan_tail(
+		    data, blocks * per, count, unit, key, mode, 0);
+		if (found != SIZE_MAX) {
+			return found;
+		}
+
+		for (size_t b = blocks; b-- > 0;) {
+			__m512i  block = _mm512_loadu_si512(data + 64 * b);
+			uint64_t mask =
+			    vx_scan_mask_avx512(block, needle, unit);
+			if (mask) {
+				return b * per + (63 - __builtin_clzll(mask));
+			}
+		}
+		return SIZE_MAX;
+	}
+
+	size_t matches = 0;
+	for (size_t b = 0; b < blocks; b++) {
+		__m512i  block = _mm512_loadu_si512(data + 64 * b);
+		uint64_t mask  = vx_scan_mask_avx512(block, needle, unit);
+		if (mode == VX_SCAN_FIRST) {
+			if (mask) {
+				return b * per + __builtin_ctzll(mask);
+			}
+		} else {
+			matches += __builtin_popcountll(mask);
+		}
+	}
+
+	return vx_scan_tail(
+	    data, blocks * per, count, unit, key, mode, matches);
+}
+
+__attribute__((target("avx512f,avx512bw"))) size_t
+vx_scan_avx512(const unsigned char *data,
+               size_t               count,
+               size_t               unit,
+               uint64_t             key,
+               enum vx_scan_mode    mode)
+{
+	switch (unit) {
+	case 1:
+		return vx_scan_avx512_unit(data, count, 1, key, mode);
+	case 2:
+		return vx_scan_avx512_unit(data, count, 2, key, mode);
+	case 4:
+		return vx_scan_avx512_unit(data, count, 4, key, mode);
+	default:
+		return vx_scan_avx512_unit(data, count, 8, key, mode);
+	}
+}
+#endif
+
+size_t vx_scan(const void *vx, const void *key, enum vx_scan_mode mode)
+{
+	struct vx_tag       *tag   = vx_tag(vx);
+	size_t               unit  = vx_tag_unit(tag);
+	size_t               count = vx_tag_count(tag);
+	const unsigned char *data  = (const unsigned char *)vx;
+
+	if (unit != 1 && unit != 2 && unit != 4 && unit != 8) {
+		size_t matches = 0;
+
+		if (mode == VX_SCAN_LAST) {
+			for (size_t i = count; i-- > 0;) {
+				if (!memcmp(data + unit * i, key, unit)) {
+					return i;
+				}
+			}
+			return SIZE_MAX;
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			if (!memcmp(data + unit * i, key, unit)) {
+				if (mode == VX_SCAN_FIRST) {
+					return i;
+				}
+				matches++;
+			}
+		}
+		return mode == VX_SCAN_FIRST ? SIZE_MAX : matches;
+	}
+
+	uint64_t needle = 0;
+	memcpy(&needle, key, unit);
+
+	vx_simd_level();
+
+	return vx_kernels.scan(data, count, unit, needle, mode);
+}
+
+ptrdiff_t vx_find(const void *vx, const void *key)
+{
+	size_t index = vx_scan(vx, key, VX_SCAN_FIRST);
+
+	return index == SIZE_MAX ? -1 : (ptrdiff_t)index;
+}
+
+ptrdiff_t vx_find_last(const void *vx, const void *key)
+{
+	size_t index = vx_scan(vx, key, VX_SCAN_LAST);
+
+	return index == SIZE_MAX ? -1 : (ptrdiff_t)index;
+}
+
+size_t vx_count_eq(const void *vx, const void *key)
+{
+	return vx_scan(vx, key, VX_SCAN_COUNT);
+}
+
+bool vx_contains(const void *vx, const void *key)
+{
+	return vx_scan(vx, key, VX_SCAN_FIRST) != SIZE_MAX;
+}
+
+// Sorted search
+// =============
+
+#if defined(__GNUC__) || defined(__clang__)
+#define VX_PREFETCH(addr) __builtin_prefetch((const void *)(addr))
+#else
+#define VX_PREFETCH(addr) ((void)0)
+#endif
+
+static size_t vx_bound(const void *vx,
+                       const void *key,
+                       int (*cmp)(const void *, const void *),
+                       bool upper)
+{
+	struct vx_tag       *tag   = vx_tag(vx);
+	size_t               unit  = vx_tag_unit(tag);
+	size_t               count = vx_tag_count(tag);
+	size_t               first = 0;
+	const unsigned char *data  = (const unsigned char *)vx;
+
+	// A unit lies before the lower bound if it compares less than 'key',
+	// and before the upper bound if it also compares equal.
+
+	int before = upper ? 0 : 1;
+
+	while (count) {
+		size_t half = count / 2;
+		if (cmp(key, data + unit * (first + half)) >= before) {
+			first += half + 1;
+			count -= half + 1;
+		} else {
+			count = half;
+		}
+	}
+
+	return first;
+}
+
+size_t vx_lower_bound(const void *vx,
+                      const void *key,
+                      int (*cmp)(const void *, const void *))
+{
+	return vx_bound(vx, key, cmp, false);
+}
+
+size_t vx_upper_bound(const void *vx,
+                      const void *key,
+                      int (*cmp)(const void *, const void *))
+{
+	return vx_bound(vx, key, cmp, true);
+}
+
+bool vx_equal_range(const void *vx,
+                    const void *key,
+                    int (*cmp)(const void *, const void *),
+                    size_t *first,
+                    size_t *last)
+{
+	*first = vx_bound(vx, key, cmp, false);
+	*last  = vx_bound(vx, key, cmp, true);
+
+	return *first != *last;
+}
+
+// Fills the subtree rooted at 'k' with the units of 'src' from index 'i'
+// onwards, in order, and returns the index of the next unit to place.
+static size_t vx_eytzinger_fill(unsigned char       *dest,
+                                const unsigned char *src,
+                                size_t               unit,
+                                size_t               count,
+                                size_t               i,
+                                size_t               k)
+{
+	if (k < count) {
+		i = vx_eytzinger_fill(dest, src, unit, count, i, 2 * k + 1);
+		memcpy(dest + unit * k, src + unit * i++, unit);
+		i = vx_eytzinger_fill(dest, src, unit, count, i, 2 * k + 2);
+	}
+
+	return i;
+}
+
+void *vx_eytzinger_build(const void *vx)
+{
+	struct vx_tag *tag   = vx_tag(vx);
+	size_t         unit  = vx_tag_unit(tag);
+	size_t         count = vx_tag_count(tag);
+
+	unsigned char *eytz = (unsigned char *)vx_new_(unit, count, NULL);
+	if (!eytz) {
+		return NULL;
+	}
+
+	vx_eytzinger_fill(eytz, (const unsigned char *)vx, unit, count, 0, 0);
+
+	return eytz;
+}
+
+// The search goes right past every unit less than the key, and so ends below a
+// leaf. Numbering the nodes from 1, each step appends a bit to the index (1 to
+// go right), and the lower bound is the last node at which the search went
+// left: dropping the trailing 1 bits and the 0 before them leaves that node, or
+// 0 if there is none.
+static inline size_t vx_eytzinger_result(size_t k, size_t count)
+{
+	k++;
+	while (k & 1) {
+		k >>= 1;
+	}
+	k >>= 1;
+
+	return k ? k - 1 : count;
+}
+
+size_t vx_eytzinger_search(const void *eytz,
+                           const void *key,
+                           int (*cmp)(const void *, const void *))
+{
+	struct vx_tag       *tag   = vx_tag(eytz);
+	size_t               unit  = vx_tag_unit(tag);
+	size_t               count = vx_tag_count(tag);
+	const unsigned char *data  = (const unsigned char *)eytz;
+
+	size_t k = 0;
+	while (k < count) {
+		k = 2 * k + 1 + (cmp(key, data + unit * k) > 0);
+	}
+
+	return vx_eytzinger_result(k, count);
+}
+
+// The integer searches are generated for each key type. The branchless bounds
+// advance 'base' by arithmetic rather than a conditional jump, so comparisons
+// never mispredict and memory latency is the only limit; the prefetching
+// variants hide some of that by loading both candidates for the next step,
+// base[next - 1] on either side of the current probe, where 'next' is the half
+// the next step will use.
+// The Eytzinger search prefetches the cache line of descendants several levels
+// down, which may lie beyond the vector, hence the address is computed as an
+// integer; a prefetch never faults.
+
+#define VX_BOUND_DEFINE_(suffix, type)                                         \
+	static inline size_t vx_bound_##suffix(                                \
+	    const type *vx, type key, bool upper, bool prefetch)               \
+	{                                                                      \
+		const type *base  = vx;                                        \
+		size_t      count = vx_tag_count(vx_tag(vx));                  \
+                                                                               \
+		if (!count) {                                                  \
+			return 0;                                              \
+		}                                                              \
+                                                                               \
+		while (count > 1) {                                            \
+			size_t half = count / 2;                               \
+			size_t next = (count - half) / 2;                      \
+			if (prefetch && next) {                                \
+				VX_PREFETCH(base + next - 1);                  \
+				VX_PREFETCH(base + half + next - 1);           \
+			}                                                      \
+			bool before = upper ? base[half - 1] <= key            \
+			                    : base[half - 1] < key;            \
+			base += before * half;                                 \
+			count -= half;                                         \
+		}                                                              \
+                                                                               \
+		return (size_t)(base - vx)                                     \
+		       + (upper ? *base <= key : *base < key);                 \
+	}                                                                      \
+                                                                               \
+	size_t vx_lower_bound_##suffix(const type *vx, type key)               \
+	{                                                                      \
+		return vx_bound_##suffix(vx, key, false, false);               \
+	}                                                                      \
+                                                                               \
+	size_t vx_upper_bound_##suffix(const type *vx, type key)               \
+	{                                                                      \
+		return vx_bound_##suffix(vx, key, true, false);                \
+	}                                                                      \
+                                                                               \
+	size_t vx_lower_bound_prefetch_##suffix(const type *vx, type key)      \
+	{                                                                      \
+		return vx_bound_##suffix(vx, key, false, true);                \
+	}                                                                      \
+                                                                               \
+	size_t vx_upper_bound_prefetch_##suffix(const type *vx, type key)      \
+	{                                                                      \
+		return vx_bound_##suffix(vx, key, true, true);                 \
+	}                                                                      \
+                                                                               \
+	size_t vx_eytzinger_search_##suffix(const type *eytz, type key)        \
+	{                                                                      \
+		size_t count = vx_tag_count(vx_tag(eytz));                     \
+		size_t per   = 64 / sizeof(type);                              \
+		size_t k     = 0;                                              \
+                                                                               \
+		while (k < count) {                                            \
+			uintptr_t ahead = (uintptr_t)eytz                      \
+			                  + sizeof(type) * (per * k + per - 1);\
+			VX_PREFETCH(ahead);                                    \
+			VX_PREFETCH(ahead + 64 - sizeof(type));                \
+			k = 2 * k + 1 + (eytz[k] < key);                       \
+		}                                                              \
+                                                                               \
+		return vx_eytzinger_result(k, count);                          \
+	}
+
+VX_BOUND_DEFINE_(i32, int32_t)
+VX_BOUND_DEFINE_(u32, uint32_t)
+VX_BOUND_DEFINE_(i64, int64_t)
+VX_BOUND_DEFINE_(u64, uint64_t)
+
+// Heaps
+// =====
+
+static void vx_swap_units(unsigned char *a, unsigned char *b, size_t unit)
+{
+	unsigned char temp[64];
+
+	while (unit) {
+		size_t n = unit < sizeof(temp) ? unit : sizeof(temp);
+		memcpy(temp, a, n);
+		memcpy(a, b, n);
+		memcpy(b, temp, n);
+		a += n;
+		b += n;
+		unit -= n;
+	}
+}
+
+// Returns whether 'a' belongs above 'b' in a max-heap, or in a min-heap if
+// 'min' is set; the public functions only keep max-heaps, but top-k selection
+// keeps the least of the greatest units at the top.
+static inline bool vx_heap_above(const void *a,
+                                 const void *b,
+                                 int (*cmp)(const void *, const void *),
+                                 bool min)
+{
+	return min ? cmp(b, a) > 0 : cmp(a, b) > 0;
+}
+
+static void vx_heap_down(unsigned char *data,
+                         size_t         unit,
+                         size_t         count,
+                         size_t         i,
+                         int (*cmp)(const void *, const void *),
+                         bool min)
+{
+	for (;;) {
+		size_t top   = i;
+		size_t left  = 2 * i + 1;
+		size_t right = left + 1;
+
+		if (left < count
+		    && vx_heap_above(
+		        data + unit * left, data + unit * top, cmp, min)) {
+			top = left;
+		}
+		if (right < count
+		    && vx_heap_above(
+		        data + unit * right, data + unit * top, cmp, min)) {
+			top = right;
+		}
+		if (top == i) {
+			return;
+		}
+
+		vx_swap_units(data + unit * i, data + unit * top, unit);
+		i = top;
+	}
+}
+
+static void vx_heap_up(unsigned char *data,
+                       size_t         unit,
+                       size_t         i,
+                       int (*cmp)(const void *, const void *),
+                       bool min)
+{
+	while (i) {
+		size_t parent = (i - 1) / 2;
+		if (!vx_heap_above(
+		        data + unit * i, data + unit * parent, cmp, min)) {
+			return;
+		}
+		vx_swap_units(data + unit * i, data + unit * parent, unit);
+		i = parent;
+	}
+}
+
+void vx_heap_make(void *vx, int (*cmp)(const void *, const void *))
+{
+	struct vx_tag *tag   = vx_tag(vx);
+	size_t         unit  = vx_tag_unit(tag);
+	size_t         count = vx_tag_count(tag);
+
+	// Sifting down every parent, from the last, costs O(n) in total, since
+	// most units sit near the bottom and move only a short way.
+
+	for (size_t i = count / 2; i-- > 0;) {
+		vx_heap_down((unsigned char *)vx, unit, count, i, cmp, false);
+	}
+}
+
+bool vx_heap_push_(void      **vx_p,
+                   const void *value,
+                   int (*cmp)(const void *, const void *))
+{
+	struct vx_tag *tag   = vx_tag(*vx_p);
+	size_t         unit  = vx_tag_unit(tag);
+	size_t         count = vx_tag_count(tag);
+
+	if (count == vx_tag_capacity(tag)) {
+		if (!vx_expand_(vx_p, count + 1)) {
+			return false;
+		}
+		tag = vx_tag(*vx_p);
+	}
+
+	unsigned char *data = (unsigned char *)*vx_p;
+	memcpy(data + unit * count, value, unit);
+	vx_tag_set_count(tag, count + 1);
+	vx_heap_up(data, unit, count, cmp, false);
+
+	return true;
+}
+
+bool vx_heap_pop_(void **vx_p,
+                  void  *out,
+                  int (*cmp)(const void *, const void *))
+{
+	struct vx_tag *tag   = vx_tag(*vx_p);
+	size_t         unit  = vx_tag_unit(tag);
+	size_t         count = vx_tag_count(tag);
+
+	if (count > 1) {
+		unsigned char *data = (unsigned char *)*vx_p;
+		vx_swap_units(data, data + unit * (count - 1), unit);
+		vx_heap_down(data, unit, count - 1, 0, cmp, false);
+	}
+
+	return vx_pop_(vx_p, out);
+}
+
+// The 4-ary heaps move a hole down or up rather than swapping, writing each
+// unit passed over once, and place the value being sifted at the end.
+
+#define VX_HEAP4_DEFINE_(suffix, type)                                         \
+	static void vx_heap4_down_##suffix(                                    \
+	    type *vx, size_t count, size_t i, type value)                      \
+	{                                                                      \
+		for (;;) {                                                     \
+			size_t first = 4 * i + 1;                              \
+			if (first >= count) {                                  \
+				break;                                         \
+			}                                                      \
+                                                                               \
+			size_t last = first + 4 < count ? first + 4 : count;   \
+			size_t max  = first;                                   \
+			for (size_t c = first + 1; c < last; c++) {            \
+				max = vx[c] > vx[max] ? c : max;               \
+			}                                                      \
+			if (vx[max] <= value) {                                \
+				break;                                         \
+			}                                                      \
+                                                                               \
+			vx[i] = vx[max];                                       \
+			i     = max;                                           \
+		}                                                              \
+		vx[i] = value;                                                 \
+	}                                                                      \
+                                                                               \
+	void vx_heap4_make_##suffix(type *vx)                                  \
+	{                                                                      \
+		size_t count = vx_tag_count(vx_tag(vx));                       \
+                                                                               \
+		if (count > 1) {                                               \
+			for (size_t i = (count - 2) / 4 + 1; i-- > 0;) {       \
+				vx_heap4_down_##suffix(vx, count, i, vx[i]);   \
+			}                                                      \
+		}                                                              \
+	}                                                                      \
+                                                                               \
+	bool vx_heap4_push_##suffix(type **vx_p, type value)                   \
+	{                                                                      \
+		struct vx_tag *tag   = vx_tag(*vx_p);                          \
+		size_t         count = vx_tag_count(tag);                      \
+                                                                               \
+		if (count == vx_tag_capacity(tag)) {                           \
+			if (!vx_expand_((void **)vx_p, count + 1)) {           \
+				return false;                                  \
+			}                                                      \
+			tag = vx_tag(*vx_p);                                   \
+		}                                                              \
+                                                                               \
+		type  *vx = *vx_p;                                             \
+		size_t i  = count;                                             \
+		while (i && vx[(i - 1) / 4] < value) {                         \
+			vx[i] = vx[(i - 1) / 4];                               \
+			i     = (i - 1) / 4;                                   \
+		}                                                              \
+		vx[i] = value;                                                 \
+		vx_tag_set_count(tag, count + 1);                              \
+                                                                               \
+		return true;                                                   \
+	}                                                                      \
+                                                                               \
+	bool vx_heap4_pop_##suffix(type **vx_p, type *out)                     \
+	{                                                                      \
+		struct vx_tag *tag   = vx_tag(*vx_p);                          \
+		size_t         count = vx_tag_count(tag);                      \
+                                                                               \
+		if (!count) {                                                  \
+			return vx_pop_((void **)vx_p, out);                    \
+		}                                                              \
+                                                                               \
+		type *vx = *vx_p;                                              \
+		if (out) {                                                     \
+			*out = vx[0];                                          \
+		}                                                              \
+		if (count > 1) {                                               \
+			type last = vx[count - 1];                             \
+			vx_heap4_down_##suffix(vx, count - 1, 0, last);        \
+		}                                                              \
+		vx_tag_set_count(tag, count - 1);                              \
+                                                                               \
+		return vx_typed_shrink_(vx_p);                                 \
+	}
+
+VX_HEAP4_DEFINE_(i32, int32_t)
+VX_HEAP4_DEFINE_(u32, uint32_t)
+VX_HEAP4_DEFINE_(i64, int64_t)
+VX_HEAP4_DEFINE_(u64, uint64_t)
+
+// Selection
+// =========
+
+// Ranges this short are finished by insertion sort.
+#define VX_SELECT_SORT 16
+
+static void vx_insertion_sort(unsigned char *data,
+                              size_t         unit,
+                              size_t         lo,
+                              size_t         hi,
+                              int (*cmp)(const void *, const void *))
+{
+	for (size_t i = lo + 1; i < hi; i++) {
+		for (size_t j = i; j > lo; j--) {
+			unsigned char *prev = data + unit * (j - 1);
+			if (cmp(prev, prev + unit) <= 0) {
+				break;
+			}
+			vx_swap_units(prev, prev + unit, unit);
+		}
+	}
+}
+
+static void vx_select(unsigned char *data,
+                      size_t         unit,
+                      size_t         lo,
+                      size_t         hi,
+                      size_t         n,
+                      size_t         depth,
+                      int (*cmp)(const void *, const void *));
+
+// Returns the index of the median of three units.
+static size_t vx_median3(const unsigned char *data,
+                         size_t               unit,
+                         size_t               a,
+                         size_t               b,
+                         size_t               c,
+                         int (*cmp)(const void *, const void *))
+{
+	const void *x = data + unit * a;
+	const void *y = data + unit * b;
+	const void *z = data + unit * c;
+
+	if (cmp(x, y) < 0) {
+		return cmp(y, z) < 0 ? b : cmp(x, z) < 0 ? c : a;
+	}
+	return cmp(x, z) < 0 ? a : cmp(y, z) < 0 ? c : b;
+}
+
+// Gathers the medians of each group of five units at the front of the range,
+// and returns the index of their median, which is guaranteed to lie between
+// the 30th and 70th percentiles of the range.
+static size_t vx_median_of_medians(unsigned char *data,
+                                   size_t         unit,
+                                   size_t         lo,
+                                   size_t         hi,
+                                   int (*cmp)(const void *, const void *))
+{
+	size_t groups = 0;
+
+	for (size_t i = lo; i < hi; i += 5) {
+		size_t end = i + 5 < hi ? i + 5 : hi;
+		vx_insertion_sort(data, unit, i, end, cmp);
+		vx_swap_units(data + unit * (lo + groups),
+		              data + unit * (i + (end - i) / 2),
+		              unit);
+		groups++;
+	}
+
+	size_t mid = lo + groups / 2;
+	vx_select(data, unit, lo, lo + groups, mid, 0, cmp);
+
+	return mid;
+}
+
+// Selects the 'n'th unit within [lo, hi). Each pass partitions the range three
+// ways around a pivot, so that runs of equal units are settled at once; once
+// 'depth' passes have been spent, pivots are chosen by the median of medians.
+static void vx_select(unsigned char *data,
+                      size_t         unit,
+                      size_t         lo,
+                      size_t         hi,
+                      size_t         n,
+                      size_t         depth,
+                      int (*cmp)(const void *, const void *))
+{
+	while (hi - lo > VX_SELECT_SORT) {
+		size_t pivot;
+		if (depth) {
+			depth--;
+			pivot = vx_median3(
+			    data, unit, lo, lo + (hi - lo) / 2, hi - 1, cmp);
+		} else {
+			pivot = vx_median_of_medians(data, unit, lo, hi, cmp);
+		}
+		vx_swap_units(data + unit * lo, data + unit * pivot, unit);
+
+		// Units in [lo, lt) are less than the pivot, those in [lt, i)
+		// equal to it, and those in [gt, hi) greater. The pivot itself
+		// stays at 'lt', so it can be compared against in place.
+
+		size_t lt = lo, i = lo + 1, gt = hi;
+		while (i < gt) {
+			int order = cmp(data + unit * i, data + unit * lt);
+			if (order < 0) {
+				vx_swap_units(
+				    data + unit * lt, data + unit * i, unit);
+				lt++;
+				i++;
+			} else if (order > 0) {
+				gt--;
+				vx_swap_units(
+				    data + unit * i, data + unit * gt, unit);
+			} else {
+				i++;
+			}
+		}
+
+		if (n < lt) {
+			hi = lt;
+		} else if (n >= gt) {
+			lo = gt;
+		} else {
+			return;
+		}
+	}
+
+	vx_insertion_sort(data, unit, lo, hi, cmp);
+}
+
+void vx_nth_element(void  *vx,
+                    size_t n,
+                    int (*cmp)(const void *, const void *))
+{
+	struct vx_tag *tag   = vx_tag(vx);
+	size_t         count = vx_tag_count(tag);
+	size_t         depth = 0;
+
+	if (n >= count) {
+		return;
+	}
+
+	for (size_t i = count; i > 1; i /= 2) {
+		depth += 2;
+	}
+
+	vx_select(
+	    (unsigned char *)vx, vx_tag_unit(tag), 0, count, n, depth, cmp);
+}
+
+void vx_partial_sort(void *vx,
+                     size_t k,
+                     int (*cmp)(const void *, const void *))
+{
+	struct vx_tag *tag   = vx_tag(vx);
+	size_t         count = vx_tag_count(tag);
+
+	if (k > count) {
+		k = count;
+	}
+	if (k < count) {
+		vx_nth_element(vx, k, cmp);
+	}
+
+	qsort(vx, k, vx_tag_unit(tag), cmp);
+}
+
+bool vx_topk_init_(struct vx_topk *topk,
+                   size_t          unit,
+                   size_t          k,
+                   int (*cmp)(const void *, const void *))
+{
+	topk->k   = k;
+	topk->cmp = cmp;
+
+	topk->heap = vx_new_(unit, k, NULL);
+	if (!topk->heap) {
+		return false;
+	}
+	vx_tag_set_count(vx_tag(topk->heap), 0);
+
+	return true;
+}
+
+void vx_topk_free(struct vx_topk *topk)
+{
+	vx_free_(&topk->heap);
+}
+
+void vx_topk_push(struct vx_topk *topk, const void *value)
+{
+	struct vx_tag *tag   = vx_tag(topk->heap);
+	size_t         unit  = vx_tag_unit(tag);
+	size_t         count = vx_tag_count(tag);
+	unsigned char *data  = (unsigned char *)topk->heap;
+
+	if (count < topk->k) {
+		memcpy(data + unit * count, value, unit);
+		vx_tag_set_count(tag, count + 1);
+		vx_heap_up(data, unit, count, topk->cmp, true);
+	} else if (count && topk->cmp(value, data) > 0) {
+		memcpy(data, value, unit);
+		vx_heap_down(data, unit, count, 0, topk->cmp, true);
+	}
+}
+
+void vx_topk_merge(struct vx_topk *dest, const struct vx_topk *src)
+{
+	struct vx_tag       *tag   = vx_tag(src->heap);
+	size_t               unit  = vx_tag_unit(tag);
+	size_t               count = vx_tag_count(tag);
+	const unsigned char *data  = (const unsigned char *)src->heap;
+
+	for (size_t i = 0; i < count; i++) {
+		vx_topk_push(dest, data + unit * i);
+	}
+}
+
+void *vx_topk_result(const struct vx_topk *topk)
+{
+	struct vx_tag *tag   = vx_tag(topk->heap);
+	size_t         unit  = vx_tag_unit(tag);
+	size_t         count = vx_tag_count(tag);
+
+	unsigned char *result = (unsigned char *)vx_new_(unit, count, NULL);
+	if (!result) {
+		return NULL;
+	}
+	memcpy(result, topk->heap, unit * count);
+
+	// Heap sort: each pass moves the least remaining unit to the end.
+
+	for (size_t n = count; n > 1; n--) {
+		vx_swap_units(result, result + unit * (n - 1), unit);
+		vx_heap_down(result, unit, n - 1, 0, topk->cmp, true);
+	}
+
+	return result;
+}
+
+void *vx_topk(const void *vx,
+              size_t      k,
+              int (*cmp)(const void *, const void *))
+{
+	struct vx_tag       *tag   = vx_tag(vx);
+	size_t               unit  = vx_tag_unit(tag);
+	size_t               count = vx_tag_count(tag);
+	const unsigned char *data  = (const unsigned char *)vx;
+	struct vx_topk       topk;
+
+	if (!vx_topk_init_(&topk, unit, k < count ? k : count, cmp)) {
+		return NULL;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		vx_topk_push(&topk, data + unit * i);
+	}
+
+	void *result = vx_topk_result(&topk);
+	vx_topk_free(&topk);
+
+	return result;
+}
+
+void *vx_topk_parallel(const void *vx,
+                       size_t      k,
+                       int (*cmp)(const void *, const void *))
+{
+#ifdef _OPENMP
+	struct vx_tag       *tag   = vx_tag(vx);
+	size_t               unit  = vx_tag_unit(tag);
+	size_t               count = vx_tag_count(tag);
+	const unsigned char *data  = (const unsigned char *)vx;
+	int                  teams = omp_get_max_threads();
+
+	if (k > count) {
+		k = count;
+	}
+
+	// Every heap is allocated up front, since vx_new() is not thread-safe
+	// in all configurations; within the loop, pushes never allocate.
+
+	struct vx_topk *topks
+	    = (struct vx_topk *)calloc((size_t)teams, sizeof(struct vx_topk));
+	if (!topks) {
+		return NULL;
+	}
+
+	void *result = NULL;
+	int   ready  = 0;
+	while (ready < teams && vx_topk_init_(&topks[ready], unit, k, cmp)) {
+		ready++;
+	}
+
+	if (ready == teams) {
+#pragma omp parallel num_threads(teams)
+		{
+			struct vx_topk *topk = &topks[omp_get_thread_num()];
+
+#pragma omp for schedule(static)
+			for (ptrdiff_t i = 0; i < (ptrdiff_t)count; i++) {
+				vx_topk_push(topk, data + unit * i);
+			}
+		}
+
+		for (int t = 1; t < teams; t++) {
+			vx_topk_merge(&topks[0], &topks[t]);
+		}
+		result = vx_topk_result(&topks[0]);
+	}
+
+	while (ready--) {
+		vx_topk_free(&topks[ready]);
+	}
+	free(topks);
+
+	return result;
+#else
+	return vx_topk(vx, k, cmp);
+#endif
+}
+
+// Set operations
+// ==============
+
+// Empties the output vector and ensures it can hold 'capacity' ids.
+static bool vx_set_prepare(uint32_t **out_p, size_t capacity)
+{
+	struct vx_tag *tag = vx_tag(*out_p);
+
+	vx_tag_set_count(tag, 0);
+
+	return capacity <= vx_tag_capacity(tag)
+	       || vx_reserve_((void **)out_p, capacity);
+}
+
+// Returns the index of the first id of 'v' from 'lo' onwards which is not less
+// than 'key', probing 1, 2, 4... ids ahead before searching within the last
+// step, so the cost grows with the log of the distance skipped.
+static size_t
+vx_gallop_u32(const uint32_t *v, size_t lo, size_t count, uint32_t key)
+{
+	size_t hi   = lo;
+	size_t step = 1;
+
+	while (hi < count && v[hi] < key) {
+		lo = hi + 1;
+		hi += step;
+		step *= 2;
+	}
+	if (hi > count) {
+		hi = count;
+	}
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (v[mid] < key) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+// Each step consumes whichever id is lesser, or both if they are equal, and
+// always writes the id from 'a', counting it only if it matched.
+size_t vx_intersect_u32_scalar(const uint32_t *a,
+                               size_t          a_count,
+                               const uint32_t *b,
+                               size_t          b_count,
+                               uint32_t       *out)
+{
+	size_t i = 0, j = 0, k = 0;
+
+	while (i < a_count && j < b_count) {
+		uint32_t x = a[i], y = b[j];
+		out[k]     = x;
+		k += x == y;
+		i += x <= y;
+		j += y <= x;
+	}
+
+	return k;
+}
+
+#ifdef VX_SIMD_X86
+// Indexed by a 4-bit mask of matching lanes, each entry shuffles those lanes
+// to the front of a vector; bytes of 0x80 are zeroed.
+static const uint8_t vx_intersect_shuffle[16][16] = {
+	{0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	 0x80, 0x80, 0x80, 0x80},
+	{0, 1, 2, 3, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	 0x80, 0x80},
+	{4, 5, 6, 7, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	 0x80, 0x80},
+	{0, 1, 2, 3, 4, 5, 6, 7, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	 0x80},
+	{8, 9, 10, 11, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	 0x80, 0x80, 0x80},
+	{0, 1, 2, 3, 8, 9, 10, 11, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	 0x80},
+	{4, 5, 6, 7, 8, 9, 10, 11, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	 0x80},
+	{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 0x80, 0x80, 0x80, 0x80},
+	{12, 13, 14, 15, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	 0x80, 0x80, 0x80},
+	{0, 1, 2, 3, 12, 13, 14, 15, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	 0x80},
+	{4, 5, 6, 7, 12, 13, 14, 15, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	 0x80},
+	{0, 1, 2, 3, 4, 5, 6, 7, 12, 13, 14, 15, 0x80, 0x80, 0x80, 0x80},
+	{8, 9, 10, 11, 12, 13, 14, 15, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	 0x80},
+	{0, 1, 2, 3, 8, 9, 10, 11, 12, 13, 14, 15, 0x80, 0x80, 0x80, 0x80},
+	{4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 0x80, 0x80, 0x80, 0x80},
+	{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+};
+
+// Compares a block of four ids from each set against all four rotations of
+// the other, stores those of 'a' which matched, compacted by a shuffle, and
+// then advances past whichever block ends lower (or both, if they end on the
+// same id). Since ids are unique, no id can match in more than one step. Each
+// store writes four lanes, and a block of 'a' may already have matched in
+// earlier steps, so 'out' needs room for three ids beyond the smaller set.
+__attribute__((target("ssse3"))) size_t
+vx_intersect_u32_ssse3(const uint32_t *a,
+                       size_t          a_count,
+                       const uint32_t *b,
+                       size_t          b_count,
+                       uint32_t       *out)
+{
+	size_t i = 0, j = 0, k = 0;
+	size_t a_end = a_count & ~(size_t)3;
+	size_t b_end = b_count & ~(size_t)3;
+
+	while (i < a_end && j < b_end) {
+		__m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i *)(b + j));
+
+		__m128i eq0 = _mm_cmpeq_epi32(va, vb);
+		__m128i eq1 = _mm_cmpeq_epi32(
+		    va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1)));
+		__m128i eq2 = _mm_cmpeq_epi32(
+		    va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2)));
+		__m128i eq3 = _mm_cmpeq_epi32(
+		    va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3)));
+		__m128i eq = _mm_or_si128(_mm_or_si128(eq0, eq1),
+		                          _mm_or_si128(eq2, eq3));
+
+		int     mask    = _mm_movemask_ps(_mm_castsi128_ps(eq));
+		__m128i shuffle = _mm_loadu_si128(
+		    (const __m128i *)vx_intersect_shuffle[mask]);
+		_mm_storeu_si128((__m128i *)(out + k),
+		                 _mm_shuffle_epi8(va, shuffle));
+		k += __builtin_popcount(mask);
+
+		uint32_t a_max = a[i + 3], b_max = b[j + 3];
+		i += (a_max <= b_max) * 4;
+		j += (b_max <= a_max) * 4;
+	}
+
+	return k
+	       + vx_intersect_u32_scalar(
+	           a + i, a_count - i, b + j, b_count - j, out + k);
+}
+#endif
+
+bool vx_set_intersect_u32(uint32_t      **out_p,
+                          const uint32_t *a,
+                          const uint32_t *b)
+{
+	size_t a_count = vx_tag_count(vx_tag(a));
+	size_t b_count = vx_tag_count(vx_tag(b));
+
+	if (a_count > b_count) {
+		const uint32_t *swap = a;
+		a                    = b;
+		b                    = swap;
+		a_count              = b_count;
+		b_count              = vx_tag_count(vx_tag(b));
+	}
+
+	if (!vx_set_prepare(out_p, a_count + 3)) {
+		return false;
+	}
+
+	uint32_t *out = *out_p;
+	size_t    k   = 0;
+
+	if (a_count * VX_GALLOP_RATIO < b_count) {
+		size_t j = 0;
+		for (size_t i = 0; i < a_count; i++) {
+			j = vx_gallop_u32(b, j, b_count, a[i]);
+			if (j == b_count) {
+				break;
+			}
+			if (b[j] == a[i]) {
+				out[k++] = a[i];
+			}
+		}
+	} else {
+		vx_simd_level();
+		k = vx_kernels.intersect_u32(a, a_count, b, b_count, out);
+	}
+
+	vx_tag_set_count(vx_tag(out), k);
+
+	return true;
+}
+
+bool vx_set_union_u32(uint32_t **out_p, const uint32_t *a, const uint32_t *b)
+{
+	size_t a_count = vx_tag_count(vx_tag(a));
+	size_t b_count = vx_tag_count(vx_tag(b));
+
+	if (!vx_set_prepare(out_p, a_count + b_count)) {
+		return false;
+	}
+
+	uint32_t *out = *out_p;
+	size_t    i = 0, j = 0, k = 0;
+
+	while (i < a_count && j < b_count) {
+		uint32_t x = a[i], y = b[j];
+		out[k++]   = x <= y ? x : y;
+		i += x <= y;
+		j += y <= x;
+	}
+	memcpy(out + k, a + i, (a_count - i) * sizeof(uint32_t));
+	k += a_count - i;
+	memcpy(out + k, b + j, (b_count - j) * sizeof(uint32_t));
+	k += b_count - j;
+
+	vx_tag_set_count(vx_tag(out), k);
+
+	return true;
+}
+
+bool vx_set_difference_u32(uint32_t      **out_p,
+                           const uint32_t *a,
+                           const uint32_t *b)
+{
+	size_t a_count = vx_tag_count(vx_tag(a));
+	size_t b_count = vx_tag_count(vx_tag(b));
+
+	if (!vx_set_prepare(out_p, a_count)) {
+		return false;
+	}
+
+	uint32_t *out = *out_p;
+	size_t    i = 0, j = 0, k = 0;
+
+	if (a_count * VX_GALLOP_RATIO < b_count) {
+		for (; i < a_count; i++) {
+			j = vx_gallop_u32(b, j, b_count, a[i]);
+			if (j == b_count || b[j] != a[i]) {
+				out[k++] = a[i];
+			}
+		}
+	} else {
+		while (i < a_count && j < b_count) {
+			uint32_t x = a[i], y = b[j];
+			out[k]     = x;
+			k += x < y;
+			i += x <= y;
+			j += y <= x;
+		}
+		memcpy(out + k, a + i, (a_count - i) * sizeof(uint32_t));
+		k += a_count - i;
+	}
+
+	vx_tag_set_count(vx_tag(out), k);
+
+	return true;
+}
+
+bool vx_set_intersect_many_u32(uint32_t             **out_p,
+                               const uint32_t *const *sets,
+                               size_t                 n)
+{
+	if (n < 2) {
+		size_t count = n ? vx_tag_count(vx_tag(sets[0])) : 0;
+		if (!vx_set_prepare(out_p, count)) {
+			return false;
+		}
+		if (count) {
+			memcpy(*out_p, sets[0], count * sizeof(uint32_t));
+		}
+		vx_tag_set_count(vx_tag(*out_p), count);
+		return true;
+	}
+
+	const uint32_t **order
+	    = (const uint32_t **)malloc(n * sizeof(const uint32_t *));
+	uint32_t *temp = (uint32_t *)vx_new_(sizeof(uint32_t), 0, NULL);
+	if (!order || !temp) {
+		free(order);
+		vx_free_((void **)&temp);
+		return false;
+	}
+
+	// Sorting the sets by size, which is cheap next to intersecting them,
+	// lets the running result start small and gallop through the rest.
+
+	for (size_t i = 0; i < n; i++) {
+		size_t count = vx_tag_count(vx_tag(sets[i]));
+		size_t j     = i;
+		for (; j && vx_tag_count(vx_tag(order[j - 1])) > count; j--) {
+			order[j] = order[j - 1];
+		}
+		order[j] = sets[i];
+	}
+
+	// The running result alternates between '*out_p' and 'temp'. Only the
+	// roles are swapped, never the vectors themselves, so the caller keeps
+	// the vector it passed in, with its allocator and registration.
+
+	uint32_t **cur  = out_p;
+	uint32_t **next = &temp;
+
+	bool ok = vx_set_intersect_u32(cur, order[0], order[1]);
+	for (size_t i = 2; ok && i < n && vx_tag_count(vx_tag(*cur)); i++) {
+		ok = vx_set_intersect_u32(next, *cur, order[i]);
+		if (ok) {
+			uint32_t **swap = cur;
+			cur             = next;
+			next            = swap;
+		}
+	}
+
+	if (ok && cur != out_p) {
+		size_t count = vx_tag_count(vx_tag(temp));
+		ok           = vx_set_prepare(out_p, count);
+		if (ok) {
+			memcpy(*out_p, temp, count * sizeof(uint32_t));
+			vx_tag_set_count(vx_tag(*out_p), count);
+		}
+	}
+
+	free(order);
+	vx_free_((void **)&temp);
+
+	return ok;
+}
+
+// A cursor into one input of a k-way union, ordered in a min-heap by the id it
+// points to.
+struct vx_set_cursor {
+	const uint32_t *pos;
+	const uint32_t *end;
+};
+
+static void
+vx_set_cursor_down(struct vx_set_cursor *heap, size_t count, size_t i)
+{
+	struct vx_set_cursor value = heap[i];
+
+	for (;;) {
+		size_t child = 2 * i + 1;
+		if (child >= count) {
+			break;
+		}
+		if (child + 1 < count
+		    && *heap[child + 1].pos < *heap[child].pos) {
+			child++;
+		}
+		if (*value.pos <= *heap[child].pos) {
+			break;
+		}
+		heap[i] = heap[child];
+		i       = child;
+	}
+	heap[i] = value;
+}
+
+bool vx_set_union_many_u32(uint32_t             **out_p,
+                           const uint32_t *const *sets,
+                           size_t                 n)
+{
+	struct vx_set_cursor *heap = (struct vx_set_cursor *)malloc(
+	    (n ? n : 1) * sizeof(struct vx_set_cursor));
+	if (!heap) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error allocating set union.\n");
+#endif
+		return false;
+	}
+
+	size_t total = 0, count = 0;
+	for (size_t i = 0; i < n; i++) {
+		size_t set_count = vx_tag_count(vx_tag(sets[i]));
+		if (set_count) {
+			heap[count].pos   = sets[i];
+			heap[count].end   = sets[i] + set_count;
+			total            += set_count;
+			count++;
+		}
+	}
+
+	if (!vx_set_prepare(out_p, total)) {
+		free(heap);
+		return false;
+	}
+
+	for (size_t i = count / 2; i-- > 0;) {
+		vx_set_cursor_down(heap, count, i);
+	}
+
+	uint32_t *out = *out_p;
+	size_t    k   = 0;
+
+	while (count) {
+		uint32_t id = *heap[0].pos++;
+		if (!k || out[k - 1] != id) {
+			out[k++] = id;
+		}
+		if (heap[0].pos == heap[0].end) {
+			heap[0] = heap[--count];
+		}
+		vx_set_cursor_down(heap, count, 0);
+	}
+
+	free(heap);
+	vx_tag_set_count(vx_tag(out), k);
+
+	return true;
+}
+
+// Merging
+// =======
+// The tree has a node for each run: node 0 holds the overall winner, and each
+// of nodes 1 to n - 1 holds the loser of the match played there, between the
+// winners of its children 2i and 2i + 1, where node n + r stands for run 'r'.
+// When the winner's run advances, only the matches on the path from its leaf
+// to the root are replayed, each against the loser stored there.
+
+// Returns whether run 'a' wins against run 'b', an exhausted run losing to
+// any other.
+static bool vx_merge_beats(const struct vx_merge *merge, size_t a, size_t b)
+{
+	const struct vx_merge_run *run_a = &merge->runs[a];
+	const struct vx_merge_run *run_b = &merge->runs[b];
+
+	if (run_a->pos == run_a->end) {
+		return false;
+	}
+	if (run_b->pos == run_b->end) {
+		return true;
+	}
+
+	int order = merge->cmp(run_a->pos, run_b->pos);
+
+	return order < 0 || (!order && a < b);
+}
+
+static size_t vx_merge_build(struct vx_merge *merge, size_t node)
+{
+	if (node >= merge->n) {
+		return node - merge->n;
+	}
+
+	size_t left  = vx_merge_build(merge, 2 * node);
+	size_t right = vx_merge_build(merge, 2 * node + 1);
+
+	if (vx_merge_beats(merge, right, left)) {
+		merge->tree[node] = left;
+		return right;
+	}
+	merge->tree[node] = right;
+	return left;
+}
+
+static void vx_merge_replay(struct vx_merge *merge, size_t winner)
+{
+	for (size_t node = (merge->n + winner) / 2; node; node /= 2) {
+		if (vx_merge_beats(merge, merge->tree[node], winner)) {
+			size_t swap       = merge->tree[node];
+			merge->tree[node] = winner;
+			winner            = swap;
+		}
+	}
+	merge->tree[0] = winner;
+}
+
+static void vx_merge_refill(struct vx_merge *merge, size_t r)
+{
+	struct vx_merge_run    *run    = &merge->runs[r];
+	struct vx_merge_source *source = &merge->sources[r];
+
+	size_t count = source->read(source->ctx, run->buf, merge->chunk);
+
+	run->pos = run->buf;
+	run->end = run->buf + merge->unit * count;
+}
+
+static bool vx_merge_setup(struct vx_merge *merge,
+                           size_t           unit,
+                           size_t           n,
+                           int (*cmp)(const void *, const void *),
+                           unsigned flags)
+{
+	merge->unit     = unit;
+	merge->n        = n;
+	merge->chunk    = 0;
+	merge->flags    = flags;
+	merge->cmp      = cmp;
+	merge->sources  = NULL;
+	merge->has_last = false;
+
+	merge->runs = (struct vx_merge_run *)calloc(
+	    n ? n : 1, sizeof(struct vx_merge_run));
+	merge->tree = (size_t *)malloc((n ? n : 1) * sizeof(size_t));
+	merge->last = (unsigned char *)malloc(unit);
+
+	if (!merge->runs || !merge->tree || !merge->last) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error allocating merge.\n");
+#endif
+		vx_merge_free(merge);
+		return false;
+	}
+
+	return true;
+}
+
+static void vx_merge_start(struct vx_merge *merge)
+{
+	if (merge->n) {
+		merge->tree[0] = vx_merge_build(merge, 1);
+	}
+}
+
+bool vx_merge_init_(struct vx_merge              *merge,
+                    size_t                        unit,
+                    const struct vx_merge_source *sources,
+                    size_t                        n,
+                    size_t                        chunk,
+                    int (*cmp)(const void *, const void *),
+                    unsigned flags)
+{
+	if (!vx_merge_setup(merge, unit, n, cmp, flags)) {
+		return false;
+	}
+
+	merge->chunk   = chunk ? chunk : 1;
+	merge->sources = (struct vx_merge_source *)malloc(
+	    (n ? n : 1) * sizeof(struct vx_merge_source));
+	if (!merge->sources) {
+		vx_merge_free(merge);
+		return false;
+	}
+	if (n) {
+		memcpy(merge->sources,
+		       sources,
+		       n * sizeof(struct vx_merge_source));
+	}
+
+	for (size_t r = 0; r < n; r++) {
+		struct vx_merge_run *run = &merge->runs[r];
+
+		run->buf = (unsigned char *)malloc(unit * merge->chunk);
+		if (!run->buf) {
+#ifdef VX_USER_ERRORS
+			fprintf(stderr, "Error allocating merge buffer.\n");
+#endif
+			vx_merge_free(merge);
+			return false;
+		}
+		vx_merge_refill(merge, r);
+	}
+
+	vx_merge_start(merge);
+
+	return true;
+}
+
+bool vx_merge_next_(struct vx_merge *merge, void **out_p, size_t max)
+{
+	struct vx_tag *tag      = vx_tag(*out_p);
+	size_t         unit     = merge->unit;
+	size_t         start    = vx_tag_count(tag);
+	size_t         capacity = vx_tag_capacity(tag);
+	size_t         k        = start;
+	unsigned char *out      = (unsigned char *)*out_p;
+	bool           dedup    = merge->flags & VX_MERGE_DEDUP;
+
+	while (merge->n && k - start < max) {
+		size_t               winner = merge->tree[0];
+		struct vx_merge_run *run    = &merge->runs[winner];
+
+		if (run->pos == run->end) {
+			break;
+		}
+
+		// Within a call, the last unit output is compared where it lies
+		// in 'out'; it is only copied aside between calls.
+
+		const void *last = k > start ? out + unit * (k - 1)
+		                   : merge->has_last ? merge->last
+		                                     : NULL;
+
+		if (!dedup || !last || merge->cmp(last, run->pos)) {
+			if (k == capacity) {
+				vx_tag_set_count(tag, k);
+				if (!vx_expand_(out_p, k + 1)) {
+					return false;
+				}
+				tag      = vx_tag(*out_p);
+				capacity = vx_tag_capacity(tag);
+				out      = (unsigned char *)*out_p;
+			}
+			memcpy(out + unit * k++, run->pos, unit);
+		}
+
+		run->pos += unit;
+		if (run->pos == run->end && merge->sources) {
+			vx_merge_refill(merge, winner);
+		}
+		vx_merge_replay(merge, winner);
+	}
+
+	vx_tag_set_count(tag, k);
+
+	if (dedup && k > start) {
+		memcpy(merge->last, out + unit * (k - 1), unit);
+		merge->has_last = true;
+	}
+
+	return true;
+}
+
+bool vx_merge_done(const struct vx_merge *merge)
+{
+	if (!merge->n) {
+		return true;
+	}
+
+	const struct vx_merge_run *run = &merge->runs[merge->tree[0]];
+
+	return run->pos == run->end;
+}
+
+void vx_merge_free(struct vx_merge *merge)
+{
+	if (merge->runs && merge->sources) {
+		for (size_t r = 0; r < merge->n; r++) {
+			free(merge->runs[r].buf);
+		}
+	}
+
+	free(merge->runs);
+	free(merge->tree);
+	free(merge->last);
+	free(merge->sources);
+
+	merge->runs    = NULL;
+	merge->tree    = NULL;
+	merge->last    = NULL;
+	merge->sources = NULL;
+}
+
+bool vx_merge_k_(void             **out_p,
+                 const void *const *runs,
+                 size_t             n,
+                 int (*cmp)(const void *, const void *),
+                 unsigned flags)
+{
+	struct vx_tag  *tag  = vx_tag(*out_p);
+	size_t          unit = vx_tag_unit(tag);
+	struct vx_merge merge;
+
+	if (!vx_merge_setup(&merge, unit, n, cmp, flags)) {
+		return false;
+	}
+
+	size_t total = 0;
+	for (size_t r = 0; r < n; r++) {
+		size_t count       = vx_tag_count(vx_tag(runs[r]));
+		merge.runs[r].pos  = (const unsigned char *)runs[r];
+		merge.runs[r].end  = merge.runs[r].pos + unit * count;
+		total             += count;
+	}
+	vx_merge_start(&merge);
+
+	// Everything is reserved at once, so the merge itself never grows the
+	// output.
+
+	size_t count = vx_tag_count(tag);
+	bool   ok    = count + total <= vx_tag_capacity(tag)
+	          || vx_reserve_(out_p, count + total);
+
+	ok = ok && vx_merge_next_(&merge, out_p, total);
+	vx_merge_free(&merge);
+
+	return ok;
+}
+
+// Deduplication
+// =============
+
+// Sets the count of 'vx' after units have been removed, applying the shrink
+// policy as vx_shift_() does.
+static bool vx_dedup_finish(void **vx_p, size_t count)
+{
+	vx_tag_set_count(vx_tag(*vx_p), count);
+#ifdef VX_SHRINK_POLICY
+	return vx_shrink_policy_apply_(vx_p);
+#else
+	return true;
+#endif
+}
+
+bool vx_unique_(void **vx_p, int (*cmp)(const void *, const void *))
+{
+	struct vx_tag *tag   = vx_tag(*vx_p);
+	size_t         unit  = vx_tag_unit(tag);
+	size_t         count = vx_tag_count(tag);
+	unsigned char *data  = (unsigned char *)*vx_p;
+
+	void (*unit_free)(void *) = vx_tag_unit_free(tag);
+
+	if (!count) {
+		return true;
+	}
+
+	// Each unit is compared against the last one kept, which lies at w - 1.
+
+	size_t w = 1;
+	for (size_t i = 1; i < count; i++) {
+		unsigned char *src = data + unit * i;
+
+		if (!cmp(data + unit * (w - 1), src)) {
+			if (unit_free && vx_unit_nonempty(tag, i)) {
+				unit_free(src);
+			}
+			continue;
+		}
+		if (w != i) {
+			memcpy(data + unit * w, src, unit);
+		}
+		w++;
+	}
+
+	return w == count || vx_dedup_finish(vx_p, w);
+}
+
+#define VX_DEDUP_PARALLEL_MIN 65536
+
+struct vx_dedup_slot {
+	uint64_t hash;
+	size_t   pos;
+};
+
+static uint64_t vx_hash_mix(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDull;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ull;
+
+	return h ^ (h >> 33);
+}
+
+// The common unit sizes are loaded with a fixed-size memcpy(), which is
+// compiled to a single load, rather than a call which would stall the probes
+// of the hash table behind it.
+
+static bool vx_unit_equal(const unsigned char *a,
+                          const unsigned char *b,
+                          size_t               unit)
+{
+	uint16_t a16, b16;
+	uint32_t a32, b32;
+	uint64_t a64, b64;
+
+	switch (unit) {
+	case 1:
+		return *a == *b;
+	case 2:
+		memcpy(&a16, a, 2);
+		memcpy(&b16, b, 2);
+		return a16 == b16;
+	case 4:
+		memcpy(&a32, a, 4);
+		memcpy(&b32, b, 4);
+		return a32 == b32;
+	case 8:
+		memcpy(&a64, a, 8);
+		memcpy(&b64, b, 8);
+		return a64 == b64;
+	}
+
+	return !memcmp(a, b, unit);
+}
+
+static uint64_t vx_hash_unit(const unsigned char *src, size_t unit)
+{
+	uint64_t h = unit;
+	size_t   i = 0;
+
+	uint8_t  u8;
+	uint16_t u16;
+	uint32_t u32;
+	uint64_t u64;
+
+	switch (unit) {
+	case 1:
+		memcpy(&u8, src, 1);
+		return vx_hash_mix(h ^ u8);
+	case 2:
+		memcpy(&u16, src, 2);
+		return vx_hash_mix(h ^ u16);
+	case 4:
+		memcpy(&u32, src, 4);
+		return vx_hash_mix(h ^ u32);
+	case 8:
+		memcpy(&u64, src, 8);
+		return vx_hash_mix(h ^ u64);
+	}
+
+	for (; i + 8 <= unit; i += 8) {
+		uint64_t word;
+		memcpy(&word, src + i, 8);
+		h = vx_hash_mix(h ^ word);
+	}
+	if (i < unit) {
+		uint64_t word = 0;
+		memcpy(&word, src + i, unit - i);
+		h = vx_hash_mix(h ^ word);
+	}
+
+	return h;
+}
+
+// Allocates a table of a power of two slots, at least half again 'count', so
+// that probe sequences stay short, and sets '*mask' to its size less one.
+static struct vx_dedup_slot *vx_dedup_table(size_t count, size_t *mask)
+{
+	size_t size = 16;
+	while (size < count + count / 2) {
+		size *= 2;
+	}
+	*mask = size - 1;
+
+	return (struct vx_dedup_slot *)calloc(size,
+	                                      sizeof(struct vx_dedup_slot));
+}
+
+// Looks up the unit 'src' in the table, whose slots hold the positions plus
+// one of units in 'data', and returns whether it is new, in which case 'pos'
+// is recorded for it.
+static bool vx_dedup_insert(struct vx_dedup_slot *slots,
+                            size_t                mask,
+                            const unsigned char  *data,
+                            size_t                unit,
+                            const unsigned char  *src,
+                            uint64_t              hash,
+                            size_t                pos)
+{
+	size_t i = (size_t)hash & mask;
+
+	for (; slots[i].pos; i = (i + 1) & mask) {
+		const unsigned char *kept = data + unit * (slots[i].pos - 1);
+		if (slots[i].hash == hash && vx_unit_equal(kept, src, unit)) {
+			return false;
+		}
+	}
+
+	slots[i].hash = hash;
+	slots[i].pos  = pos + 1;
+
+	return true;
+}
+
+bool vx_dedup_hash_(void **vx_p)
+{
+	struct vx_tag *tag   = vx_tag(*vx_p);
+	size_t         unit  = vx_tag_unit(tag);
+	size_t         count = vx_tag_count(tag);
+	unsigned char *data  = (unsigned char *)*vx_p;
+	size_t         mask;
+
+	struct vx_dedup_slot *slots = vx_dedup_table(count, &mask);
+	if (!slots) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error allocating dedup table.\n");
+#endif
+		return false;
+	}
+
+	// Units are kept by moving them down to 'w', which only overwrites
+	// units already visited, so the table records where each kept unit
+	// now lies.
+
+	size_t w = 0;
+	for (size_t i = 0; i < count; i++) {
+		unsigned char *src  = data + unit * i;
+		uint64_t       hash = vx_hash_unit(src, unit);
+
+		if (vx_dedup_insert(slots, mask, data, unit, src, hash, w)) {
+			if (w != i) {
+				memcpy(data + unit * w, src, unit);
+			}
+			w++;
+		}
+	}
+
+	free(slots);
+
+	return w == count || vx_dedup_finish(vx_p, w);
+}
+
+#ifdef _OPENMP
+// Maps the high bits of 'hash' to one of 'parts' partitions; the table slot
+// is taken from the low bits.
+static size_t vx_dedup_part(uint64_t hash, int parts)
+{
+	return (size_t)(((hash >> 32) * (uint64_t)parts) >> 32);
+}
+#endif
+
+bool vx_dedup_hash_parallel_(void **vx_p)
+{
+#ifdef _OPENMP
+	struct vx_tag *tag   = vx_tag(*vx_p);
+	size_t         unit  = vx_tag_unit(tag);
+	size_t         count = vx_tag_count(tag);
+	unsigned char *data  = (unsigned char *)*vx_p;
+	int            parts = omp_get_max_threads();
+
+	if (count < VX_DEDUP_PARALLEL_MIN || parts < 2) {
+		return vx_dedup_hash_(vx_p);
+	}
+
+	uint64_t *hashes = (uint64_t *)malloc(count * sizeof(uint64_t));
+	size_t   *order  = (size_t *)malloc(count * sizeof(size_t));
+	size_t   *starts = (size_t *)calloc((size_t)parts + 1, sizeof(size_t));
+	bool     *keep   = (bool *)malloc(count * sizeof(bool));
+	bool      ok     = hashes && order && starts && keep;
+
+	if (ok) {
+#pragma omp parallel for schedule(static)
+		for (ptrdiff_t i = 0; i < (ptrdiff_t)count; i++) {
+			hashes[i] = vx_hash_unit(data + unit * i, unit);
+		}
+
+		// Indices are bucketed by partition in increasing order, so
+		// each partition meets its first occurrences first.
+
+		for (size_t i = 0; i < count; i++) {
+			starts[vx_dedup_part(hashes[i], parts) + 1]++;
+		}
+		for (int p = 0; p < parts; p++) {
+			starts[p + 1] += starts[p];
+		}
+		for (size_t i = 0; i < count; i++) {
+			order[starts[vx_dedup_part(hashes[i], parts)]++] = i;
+		}
+		for (int p = parts; p > 0; p--) {
+			starts[p] = starts[p - 1];
+		}
+		starts[0] = 0;
+
+		int failed = 0;
+
+#pragma omp parallel for schedule(dynamic, 1)
+		for (int p = 0; p < parts; p++) {
+			size_t mask;
+			size_t n = starts[p + 1] - starts[p];
+
+			struct vx_dedup_slot *slots = vx_dedup_table(n, &mask);
+			if (!slots) {
+#pragma omp atomic write
+				failed = 1;
+				continue;
+			}
+
+			for (size_t j = starts[p]; j < starts[p + 1]; j++) {
+				size_t i = order[j];
+				keep[i]  = vx_dedup_insert(slots,
+				                           mask,
+				                           data,
+				                           unit,
+				                           data + unit * i,
+				                           hashes[i],
+				                           i);
+			}
+
+			free(slots);
+		}
+
+		ok = !failed;
+	}
+
+	size_t w = 0;
+	if (ok) {
+		for (size_t i = 0; i < count; i++) {
+			if (!keep[i]) {
+				continue;
+			}
+			if (w != i) {
+				memcpy(data + unit * w, data + unit * i, unit);
+			}
+			w++;
+		}
+	} else {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error allocating dedup table.\n");
+#endif
+	}
+
+	free(hashes);
+	free(order);
+	free(starts);
+	free(keep);
+
+	return ok && (w == count || vx_dedup_finish(vx_p, w));
+#else
+	return vx_dedup_hash_(vx_p);
+#endif
+}
+
+// Interleaving and gathering
+// ==========================
+// An interleaved unit holds 'k' fields of 'width' bytes. The fields are
+// copied with memcpy() of a fixed size for each width, which compiles to
+// plain loads and stores.
+
+#define VX_FIELD_COPY_(width)                                                  \
+	for (size_t i = 0; i < count; i++) {                                   \
+		memcpy(dest + dest_step * i, src + src_step * i, width);       \
+	}                                                                      \
+	break;
+
+static void vx_field_copy(unsigned char       *dest,
+                          size_t               dest_step,
+                          const unsigned char *src,
+                          size_t               src_step,
+                          size_t               count,
+                          size_t               width)
+{
+	switch (width) {
+	case 2:
+		VX_FIELD_COPY_(2)
+	case 4:
+		VX_FIELD_COPY_(4)
+	case 8:
+		VX_FIELD_COPY_(8)
+	default:
+		VX_FIELD_COPY_(16)
+	}
+}
+
+// The units are taken a block at a time, each field in turn, so that every
+// field is written in a sequential pass while the block stays in cache.
+#define VX_INTERLEAVE_BLOCK 256
+
+void vx_deinterleave_scalar(const unsigned char *src,
+                            void *const         *fields,
+                            size_t               count,
+                            size_t               width,
+                            size_t               k)
+{
+	for (size_t i = 0; i < count; i += VX_INTERLEAVE_BLOCK) {
+		size_t n = count - i;
+		if (n > VX_INTERLEAVE_BLOCK) {
+			n = VX_INTERLEAVE_BLOCK;
+		}
+
+		for (size_t f = 0; f < k; f++) {
+			unsigned char *field = (unsigned char *)fields[f];
+
+			vx_field_copy(field + width * i,
+			              width,
+			              src + width * (k * i + f),
+			              width * k,
+			              n,
+			              width);
+		}
+	}
+}
+
+void vx_interleave_scalar(unsigned char *dest,
+                          void *const   *fields,
+                          size_t         count,
+                          size_t         width,
+                          size_t         k)
+{
+	for (size_t i = 0; i < count; i += VX_INTERLEAVE_BLOCK) {
+		size_t n = count - i;
+		if (n > VX_INTERLEAVE_BLOCK) {
+			n = VX_INTERLEAVE_BLOCK;
+		}
+
+		for (size_t f = 0; f < k; f++) {
+			const unsigned char *field = (unsigned char *)fields[f];
+
+			vx_field_copy(dest + width * (k * i + f),
+			              width * k,
+			              field + width * i,
+			              width,
+			              n,
+			              width);
+		}
+	}
+}
+
+#ifdef VX_SIMD_X86
+// Pairs of 4- and 8-byte fields, and quads of 4-byte fields, are split and
+// joined with shuffles, four units at a time (two for 8-byte fields), which
+// move the bits of each lane unchanged. The other layouts, and the last few
+// units, are left to the scalar kernels.
+void vx_deinterleave_sse2(const unsigned char *src,
+                          void *const         *fields,
+                          size_t               count,
+                          size_t               width,
+                          size_t               k)
+{
+	size_t i = 0;
+
+	if (width == 4 && k == 2) {
+		const float *in = (const float *)src;
+		float       *a  = (float *)fields[0];
+		float       *b  = (float *)fields[1];
+
+		for (; i + 4 <= count; i += 4) {
+			__m128 lo = _mm_loadu_ps(in + 2 * i);
+			__m128 hi = _mm_loadu_ps(in + 2 * i + 4);
+			_mm_storeu_ps(a + i, _mm_shuffle_ps(lo, hi, 0x88));
+			_mm_storeu_ps(b + i, _mm_shuffle_ps(lo, hi, 0xDD));
+		}
+	} else if (width == 4 && k == 4) {
+		const float *in = (const float *)src;
+
+		for (; i + 4 <= count; i += 4) {
+			__m128 r0 = _mm_loadu_ps(in + 4 * i);
+			__m128 r1 = _mm_loadu_ps(in + 4 * i + 4);
+			__m128 r2 = _mm_loadu_ps(in + 4 * i + 8);
+			__m128 r3 = _mm_loadu_ps(in + 4 * i + 12);
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_mm_storeu_ps((float *)fields[0] + i, r0);
+			_mm_storeu_ps((float *)fields[1] + i, r1);
+			_mm_storeu_ps((float *)fields[2] + i, r2);
+			_mm_storeu_ps((float *)fields[3] + i, r3);
+		}
+	} else if (width == 8 && k == 2) {
+		const double *in = (const double *)src;
+		double       *a  = (double *)fields[0];
+		double       *b  = (double *)fields[1];
+
+		for (; i + 2 <= count; i += 2) {
+			__m128d lo = _mm_loadu_pd(in + 2 * i);
+			__m128d hi = _mm_loadu_pd(in + 2 * i + 2);
+			_mm_storeu_pd(a + i, _mm_unpacklo_pd(lo, hi));
+			_mm_storeu_pd(b + i, _mm_unpackhi_pd(lo, hi));
+		}
+	} else {
+		vx_deinterleave_scalar(src, fields, count, width, k);
+		return;
+	}
+
+	void *rest[4];
+	for (size_t f = 0; f < k; f++) {
+		rest[f] = (unsigned char *)fields[f] + width * i;
+	}
+	vx_deinterleave_scalar(src + width * k * i, rest, count - i, width, k);
+}
+
+void vx_interleave_sse2(unsigned char *dest,
+                        void *const   *fields,
+                        size_t         count,
+                        size_t         width,
+                        size_t         k)
+{
+	size_t i = 0;
+
+	if (width == 4 && k == 2) {
+		float       *out = (float *)dest;
+		const float *a   = (const float *)fields[0];
+		const float *b   = (const float *)fields[1];
+
+		for (; i + 4 <= count; i += 4) {
+			__m128 x = _mm_loadu_ps(a + i);
+			__m128 y = _mm_loadu_ps(b + i);
+			_mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(x, y));
+			_mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(x, y));
+		}
+	} else if (width == 4 && k == 4) {
+		float *out = (float *)dest;
+
+		for (; i + 4 <= count; i += 4) {
+			__m128 r0 = _mm_loadu_ps((const float *)fields[0] + i);
+			__m128 r1 = _mm_loadu_ps((const float *)fields[1] + i);
+			__m128 r2 = _mm_loadu_ps((const float *)fields[2] + i);
+			__m128 r3 = _mm_loadu_ps((const float *)fields[3] + i);
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_mm_storeu_ps(out + 4 * i, r0);
+			_mm_storeu_ps(out + 4 * i + 4, r1);
+			_mm_storeu_ps(out + 4 * i + 8, r2);
+			_mm_storeu_ps(out + 4 * i + 12, r3);
+		}
+	} else if (width == 8 && k == 2) {
+		double       *out = (double *)dest;
+		const double *a   = (const double *)fields[0];
+		const double *b   = (const double *)fields[1];
+
+		for (; i + 2 <= count; i += 2) {
+			__m128d x = _mm_loadu_pd(a + i);
+			__m128d y = _mm_loadu_pd(b + i);
+			_mm_storeu_pd(out + 2 * i, _mm_unpacklo_pd(x, y));
+			_mm_storeu_pd(out + 2 * i + 2, _mm_unpackhi_pd(x, y));
+		}
+	} else {
+		vx_interleave_scalar(dest, fields, count, width, k);
+		return;
+	}
+
+	void *rest[4];
+	for (size_t f = 0; f < k; f++) {
+		rest[f] = (unsigned char *)fields[f] + width * i;
+	}
+	vx_interleave_scalar(dest + width * k * i, rest, count - i, width, k);
+}
+#endif
+
+static bool vx_field_width(size_t width)
+{
+	return width == 2 || width == 4 || width == 8 || width == 16;
+}
+
+bool vx_deinterleave(const void *vx, size_t width, void **fields)
+{
+	struct vx_tag *tag   = vx_tag(vx);
+	size_t         unit  = vx_tag_unit(tag);
+	size_t         count = vx_tag_count(tag);
+
+	if (!vx_field_width(width) || unit % width) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error deinterleaving: bad field width.\n");
+#endif
 		return false;
 	}
 
-	struct vx_tag *tag = vx_tag(*vx_p);
-	va_start(args, fmt);
-	vsnprintf((char *)tag->data + prev_count - 1, len + 1, fmt, args);
-	va_end(args);
+	size_t k  = unit / width;
+	bool   ok = true;
+
+	// The fields are reserved rather than created with their count, so
+	// that they are not zeroed only to be overwritten.
+
+	for (size_t f = 0; f < k; f++) {
+		fields[f] = vx_new_(width, 0, NULL);
+		ok        = ok && fields[f] && vx_reserve_(&fields[f], count);
+	}
+	if (!ok) {
+		for (size_t f = 0; f < k; f++) {
+			vx_free_(&fields[f]);
+		}
+		return false;
+	}
+
+	vx_simd_level();
+	vx_kernels.deinterleave(
+	    (const unsigned char *)vx, fields, count, width, k);
+	for (size_t f = 0; f < k; f++) {
+		vx_tag_set_count(vx_tag(fields[f]), count);
+	}
 
 	return true;
 }
 
-bool vx_str_emplace_(char **vx_p, size_t index, const char *fmt, ...)
+void *vx_interleave(void *const *fields, size_t n)
 {
-	va_list args;
+	size_t width = n ? vx_tag_unit(vx_tag(fields[0])) : 0;
+	size_t count = n ? vx_tag_count(vx_tag(fields[0])) : 0;
+	bool   ok    = vx_field_width(width);
 
-	va_start(args, fmt);
-	size_t len = vsnprintf(NULL, 0, fmt, args);
-	va_end(args);
+	for (size_t f = 1; ok && f < n; f++) {
+		struct vx_tag *tag = vx_tag(fields[f]);
+		ok = vx_tag_unit(tag) == width && vx_tag_count(tag) == count;
+	}
+	if (!ok) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error interleaving: mismatched fields.\n");
+#endif
+		return NULL;
+	}
 
-	if (!vx_shift_((void **)vx_p, index, len)) {
+	void *vx = vx_new_(width * n, 0, NULL);
+	if (!vx || !vx_reserve_(&vx, count)) {
+		vx_free_(&vx);
+		return NULL;
+	}
+
+	vx_simd_level();
+	vx_kernels.interleave((unsigned char *)vx, fields, count, width, n);
+	vx_tag_set_count(vx_tag(vx), count);
+
+	return vx;
+}
+
+#define VX_GATHER_COPY_(width)                                                 \
+	for (size_t i = 0; i < n; i++) {                                       \
+		memcpy(out + width * i, src + width * (size_t)idx[i], width);  \
+	}                                                                      \
+	break;
+
+void vx_gather_scalar(const unsigned char *src,
+                      const uint32_t      *idx,
+                      size_t               n,
+                      size_t               unit,
+                      unsigned char       *out)
+{
+	switch (unit) {
+	case 1:
+		VX_GATHER_COPY_(1)
+	case 2:
+		VX_GATHER_COPY_(2)
+	case 4:
+		VX_GATHER_COPY_(4)
+	case 8:
+		VX_GATHER_COPY_(8)
+	default:
+		VX_GATHER_COPY_(unit)
+	}
+}
+
+#ifdef VX_SIMD_X86
+// The gather instructions take signed 32-bit indices, so the source must
+// hold at most INT32_MAX units, which vx_gather_() ensures.
+__attribute__((target("avx2"))) void
+vx_gather_avx2(const unsigned char *src,
+               const uint32_t      *idx,
+               size_t               n,
+               size_t               unit,
+               unsigned char       *out)
+{
+	size_t i = 0;
+
+	if (unit == 4) {
+		const int     *base = (const int *)src;
+		const __m256i *at   = (const __m256i *)idx;
+
+		for (; i + 8 <= n; i += 8) {
+			__m256i x = _mm256_loadu_si256(at + i / 8);
+			__m256i y = _mm256_i32gather_epi32(base, x, 4);
+			_mm256_storeu_si256((__m256i *)(out + 4 * i), y);
+		}
+	} else if (unit == 8) {
+		const long long *base = (const long long *)src;
+		const __m128i   *at   = (const __m128i *)idx;
+
+		for (; i + 4 <= n; i += 4) {
+			__m128i x = _mm_loadu_si128(at + i / 4);
+			__m256i y = _mm256_i32gather_epi64(base, x, 8);
+			_mm256_storeu_si256((__m256i *)(out + 8 * i), y);
+		}
+	}
+
+	vx_gather_scalar(src, idx + i, n - i, unit, out + unit * i);
+}
+#endif
+
+// Indices are taken a block at a time, prefetching the units of the next
+// block while the current one is copied, so that many misses are in flight
+// at once.
+#define VX_GATHER_BLOCK 64
+
+static void vx_gather_prefetch(const unsigned char *src,
+                               const uint32_t      *idx,
+                               size_t               n,
+                               size_t               unit,
+                               unsigned char       *out)
+{
+	for (size_t i = 0; i < n; i += VX_GATHER_BLOCK) {
+		size_t here = n - i < VX_GATHER_BLOCK ? n - i : VX_GATHER_BLOCK;
+		size_t next = n - i - here;
+
+		if (next > VX_GATHER_BLOCK) {
+			next = VX_GATHER_BLOCK;
+		}
+		for (size_t j = 0; j < next; j++) {
+			VX_PREFETCH(src + unit * (size_t)idx[i + here + j]);
+		}
+		vx_gather_scalar(src, idx + i, here, unit, out + unit * i);
+	}
+}
+
+bool vx_gather_(const void *src, const uint32_t *idx, void **out_p)
+{
+	struct vx_tag *tag   = vx_tag(src);
+	size_t         unit  = vx_tag_unit(tag);
+	size_t         count = vx_tag_count(tag);
+	size_t         n     = vx_tag_count(vx_tag(idx));
+
+	if (vx_tag_unit(vx_tag(*out_p)) != unit) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error gathering: unit sizes differ.\n");
+#endif
+		return false;
+	}
+	if (vx_tag_capacity(vx_tag(*out_p)) < n && !vx_reserve_(out_p, n)) {
 		return false;
 	}
 
-	char c = (*vx_p)[index];
+	const unsigned char *data = (const unsigned char *)src;
+	unsigned char       *out  = (unsigned char *)*out_p;
 
-	va_start(args, fmt);
-	(*vx_p)[index + vsprintf(*vx_p + index, fmt, args)] = c;
-	va_end(args);
+	if (unit * count > VX_GATHER_PREFETCH_MIN || count > INT32_MAX) {
+		vx_gather_prefetch(data, idx, n, unit, out);
+	} else {
+		vx_simd_level();
+		vx_kernels.gather(data, idx, n, unit, out);
+	}
+	vx_tag_set_count(vx_tag(*out_p), n);
+
+	return true;
+}
+
+#define VX_SCATTER_COPY_(width)                                                \
+	for (size_t i = 0; i < n; i++) {                                       \
+		memcpy(out + width * (size_t)idx[i], data + width * i, width); \
+	}                                                                      \
+	break;
+
+bool vx_scatter(const void *src, const uint32_t *idx, void *dest)
+{
+	struct vx_tag *tag  = vx_tag(src);
+	size_t         unit = vx_tag_unit(tag);
+	size_t         n    = vx_tag_count(tag);
+
+	if (vx_tag_unit(vx_tag(dest)) != unit
+	    || vx_tag_count(vx_tag(idx)) != n) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error scattering: mismatched vectors.\n");
+#endif
+		return false;
+	}
+
+	const unsigned char *data = (const unsigned char *)src;
+	unsigned char       *out  = (unsigned char *)dest;
+
+	// Large destinations are prefetched a block of indices ahead, as for
+	// vx_gather_prefetch().
+
+	if (unit * vx_tag_count(vx_tag(dest)) > VX_GATHER_PREFETCH_MIN) {
+		size_t done = n > VX_GATHER_BLOCK ? n - VX_GATHER_BLOCK : 0;
+
+		for (size_t i = 0; i < done; i++) {
+			size_t at   = idx[i];
+			size_t next = idx[i + VX_GATHER_BLOCK];
+
+			VX_PREFETCH(out + unit * next);
+			memcpy(out + unit * at, data + unit * i, unit);
+		}
+		data += unit * done;
+		idx  += done;
+		n    -= done;
+	}
+
+	switch (unit) {
+	case 1:
+		VX_SCATTER_COPY_(1)
+	case 2:
+		VX_SCATTER_COPY_(2)
+	case 4:
+		VX_SCATTER_COPY_(4)
+	case 8:
+		VX_SCATTER_COPY_(8)
+	default:
+		VX_SCATTER_COPY_(unit)
+	}
+
+	return true;
+}
+
+// Permutation
+// ===========
+
+// Marks each index of 'perm' in 'seen', failing if any is out of range or
+// repeated, and clears 'seen' again before returning.
+static bool vx_permutation_valid(const uint32_t *perm,
+                                 size_t          count,
+                                 uint64_t       *seen)
+{
+	size_t i = 0;
+
+	for (; i < count; i++) {
+		size_t   k   = perm[i];
+		uint64_t bit = (uint64_t)1 << (k % 64);
+
+		if (k >= count || seen[k / 64] & bit) {
+			break;
+		}
+		seen[k / 64] |= bit;
+	}
+	memset(seen, 0, (count + 63) / 64 * sizeof(uint64_t));
+
+	return i == count;
+}
+
+// Each cycle starts at an unplaced index 'i', whose unit is held in 'tmp'
+// while each index in turn takes the unit of the index it points to, until
+// the cycle leads back to 'i'.
+#define VX_PERMUTE_CYCLES_(width)                                              \
+	for (size_t i = 0; i < count; i++) {                                   \
+		if (placed[i / 64] & (uint64_t)1 << (i % 64)) {                \
+			continue;                                              \
+		}                                                              \
+		memcpy(tmp, data + width * i, width);                          \
+                                                                               \
+		size_t j = i;                                                  \
+		for (size_t k = perm[j]; k != i; j = k, k = perm[k]) {         \
+			memcpy(data + width * j, data + width * k, width);     \
+			placed[j / 64] |= (uint64_t)1 << (j % 64);             \
+		}                                                              \
+		memcpy(data + width * j, tmp, width);                          \
+		placed[j / 64] |= (uint64_t)1 << (j % 64);                     \
+	}                                                                      \
+	break;
+
+bool vx_permute_inplace(void *vx, const uint32_t *perm)
+{
+	struct vx_tag *tag   = vx_tag(vx);
+	size_t         unit  = vx_tag_unit(tag);
+	size_t         count = vx_tag_count(tag);
+	unsigned char *data  = (unsigned char *)vx;
+
+	if (vx_tag_count(vx_tag(perm)) != count) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error permuting: counts differ.\n");
+#endif
+		return false;
+	}
+
+	size_t         words  = (count + 64) / 64;
+	uint64_t      *placed = (uint64_t *)calloc(words, sizeof(uint64_t));
+	unsigned char *tmp    = (unsigned char *)malloc(unit);
+	if (!placed || !tmp) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error allocating permutation.\n");
+#endif
+		free(placed);
+		free(tmp);
+		return false;
+	}
+
+	bool ok = vx_permutation_valid(perm, count, placed);
+	if (!ok) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error permuting: not a permutation.\n");
+#endif
+	} else {
+		switch (unit) {
+		case 1:
+			VX_PERMUTE_CYCLES_(1)
+		case 2:
+			VX_PERMUTE_CYCLES_(2)
+		case 4:
+			VX_PERMUTE_CYCLES_(4)
+		case 8:
+			VX_PERMUTE_CYCLES_(8)
+		default:
+			VX_PERMUTE_CYCLES_(unit)
+		}
+	}
+
+	free(placed);
+	free(tmp);
+
+	return ok;
+}
+
+bool vx_permute_into_(const void *vx, const uint32_t *perm, void **out_p)
+{
+	if (vx_tag_count(vx_tag(perm)) != vx_tag_count(vx_tag(vx))) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error permuting: counts differ.\n");
+#endif
+		return false;
+	}
+
+	return vx_gather_(vx, perm, out_p);
+}
+
+bool vx_stable_partition(void *vx,
+                         bool (*pred)(const void *, void *),
+                         void   *ctx,
+                         size_t *split)
+{
+	struct vx_tag *tag   = vx_tag(vx);
+	size_t         unit  = vx_tag_unit(tag);
+	size_t         count = vx_tag_count(tag);
+	unsigned char *data  = (unsigned char *)vx;
+
+	// The units before the first false one are already in place.
+
+	size_t w = 0;
+	while (w < count && pred(data + unit * w, ctx)) {
+		w++;
+	}
+	if (w == count) {
+		*split = count;
+		return true;
+	}
+
+	unsigned char *scratch = (unsigned char *)malloc(unit * (count - w));
+	if (!scratch) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error allocating partition scratch.\n");
+#endif
+		return false;
+	}
+
+	// True units move down to 'w', which only overwrites units already
+	// visited, and false units are appended to the scratch buffer.
+
+	size_t r = 0;
+	for (size_t i = w; i < count; i++) {
+		unsigned char *src = data + unit * i;
+
+		if (pred(src, ctx)) {
+			memcpy(data + unit * w++, src, unit);
+		} else {
+			memcpy(scratch + unit * r++, src, unit);
+		}
+	}
+	memcpy(data + unit * w, scratch, unit * r);
+	free(scratch);
+
+	*split = w;
+
+	return true;
+}
+
+#ifdef VX_REGISTRY
+void ***vx_registry;
+size_t  vx_budget;
+
+bool vx_register_(void **vx_p)
+{
+	struct vx_tag *tag = vx_tag(*vx_p);
+	if (tag->reg_index != (size_t)-1) {
+		return true;
+	}
+
+	if (!vx_registry) {
+		vx_registry = vx_new(void **, 0, NULL);
+		if (!vx_registry) {
+			return false;
+		}
+	}
+
+	if (!vx_push(vx_registry, vx_p)) {
+		return false;
+	}
+	tag->reg_index = vx_tag(vx_registry)->count - 1;
 
 	return true;
 }
 
+void vx_unregister_(void *vx)
+{
+	struct vx_tag *tag = vx_tag(vx);
+	if (tag->reg_index == (size_t)-1) {
+		return;
+	}
+
+	// Swap the last entry into the vacated slot, so that removal is O(1).
+
+	struct vx_tag *reg  = vx_tag(vx_registry);
+	size_t         last = reg->count - 1;
+
+	if (tag->reg_index != last) {
+		vx_registry[tag->reg_index]            = vx_registry[last];
+		vx_tag(*vx_registry[last])->reg_index = tag->reg_index;
+	}
+	tag->reg_index = (size_t)-1;
+	reg->count--;
+}
+
+size_t vx_registry_bytes(void)
+{
+	if (!vx_registry) {
+		return 0;
+	}
+
+	size_t bytes = 0;
+	for (size_t i = 0; i < vx_tag(vx_registry)->count; i++) {
+		struct vx_tag *tag = vx_tag(*vx_registry[i]);
+		bytes += VX_TAG_SIZE + tag->unit * tag->capacity;
+	}
+
+	return bytes;
+}
+
+size_t vx_registry_slack(void)
+{
+	if (!vx_registry) {
+		return 0;
+	}
+
+	size_t slack = 0;
+	for (size_t i = 0; i < vx_tag(vx_registry)->count; i++) {
+		struct vx_tag *tag = vx_tag(*vx_registry[i]);
+		slack += tag->unit * (tag->capacity - tag->count);
+	}
+
+	return slack;
+}
+
+void vx_set_budget(size_t bytes)
+{
+	vx_budget = bytes;
+}
+
+struct vx_trim_entry {
+	size_t slack;
+	void **vx_p;
+};
+
+int vx_trim_compare(const void *a, const void *b)
+{
+	size_t slack_a = ((const struct vx_trim_entry *)a)->slack;
+	size_t slack_b = ((const struct vx_trim_entry *)b)->slack;
+
+	return (slack_a < slack_b) - (slack_a > slack_b);
+}
+
+size_t vx_trim_all(size_t target)
+{
+	size_t bytes = vx_registry_bytes();
+	if (bytes <= target) {
+		return 0;
+	}
+
+	size_t                count   = vx_tag(vx_registry)->count;
+	struct vx_trim_entry *entries = malloc(sizeof(*entries) * count);
+	if (!entries) {
+#ifdef VX_USER_ERRORS
+		perror(strerror(errno));
+#endif
+		return 0;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		struct vx_tag *tag = vx_tag(*vx_registry[i]);
+		entries[i].slack   = tag->unit * (tag->capacity - tag->count);
+		entries[i].vx_p    = vx_registry[i];
+	}
+	qsort(entries, count, sizeof(*entries), vx_trim_compare);
+
+	size_t released = 0;
+	for (size_t i = 0; i < count && bytes - released > target; i++) {
+		if (!entries[i].slack) {
+			break;
+		}
+		if (vx_shrink_(entries[i].vx_p)) {
+			released += entries[i].slack;
+		}
+	}
+
+	free(entries);
+
+	return released;
+}
+
+size_t vx_trim_budget(void)
+{
+	if (!vx_budget) {
+		return 0;
+	}
+
+	return vx_trim_all(vx_budget);
+}
+
+#ifdef __linux__
+int vx_psi_open(unsigned stall_us, unsigned window_us)
+{
+	char trigger[64];
+	int  len = snprintf(
+	    trigger, sizeof(trigger), "some %u %u", stall_us, window_us);
+
+	int fd = open("/proc/pressure/memory", O_RDWR | O_NONBLOCK);
+	if (fd < 0) {
+#ifdef VX_USER_ERRORS
+		perror(strerror(errno));
+#endif
+		return -1;
+	}
+
+	if (write(fd, trigger, len + 1) < 0) {
+#ifdef VX_USER_ERRORS
+		perror(strerror(errno));
+#endif
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+#endif
+#endif
+
+void vx_simd_resolve(enum vx_simd level)
+{
+	vx_kernels.scan          = vx_scan_scalar;
+	vx_kernels.intersect_u32 = vx_intersect_u32_scalar;
+	vx_kernels.deinterleave  = vx_deinterleave_scalar;
+	vx_kernels.interleave    = vx_interleave_scalar;
+	vx_kernels.gather        = vx_gather_scalar;
+
+#ifdef VX_SIMD_X86
+	if (level >= VX_SIMD_SSE2) {
+		vx_kernels.scan         = vx_scan_sse2;
+		vx_kernels.deinterleave = vx_deinterleave_sse2;
+		vx_kernels.interleave   = vx_interleave_sse2;
+	}
+	if (level >= VX_SIMD_SSE42) {
+		vx_kernels.intersect_u32 = vx_intersect_u32_ssse3;
+	}
+	if (level >= VX_SIMD_AVX2) {
+		vx_kernels.scan   = vx_scan_avx2;
+		vx_kernels.gather = vx_gather_avx2;
+	}
+	if (level >= VX_SIMD_AVX512) {
+		vx_kernels.scan = vx_scan_avx512;
+	}
+#endif
+
+	vx_simd_current = level;
+}
+
+#endif
+
+#ifdef __cplusplus
+}
 #endif
 
 #endif
@@ -0,0 +1,535 @@
+// vx.hpp - C++ wrapper for vx.h
+// http://github.com/auul/vx.h
+//
+// License: Public Domain (www.unlicense.org); see vx.h
+// ==========================================
+//
+// Linking:
+//      Requires C++17. The implementation of vx.h must still be compiled as C,
+//      by defining VX_IMPLEMENT in ONE .c file, with the same configuration
+//      macros (VX_COMPACT, VX_OUTLINE, etc.) as any C++ file including this
+//      header.
+//
+// Usage:
+//      vx::vector<T> owns a single vx vector of 'T', freeing it upon
+//      destruction, so vectors are not leaked when exceptions are thrown. The
+//      wrapper may be moved, which transfers the underlying vector without
+//      copying, but must be copied explicitly with clone().
+//
+//      Trivially copyable types are resized and copied with realloc() and
+//      memcpy(), exactly as in C. Other types are constructed, moved and
+//      destroyed in place, in which case the vector must not be resized via
+//      the C API, since that would move the units bitwise. Such vectors never
+//      have unit_free() set, as destructors are run instead.
+//
+//      Allocation failures throw std::bad_alloc.
+//
+//      Units may be aligned to at most 16 bytes, or VX_ALIGN with VX_OUTLINE;
+//      over-aligned types are rejected at compile time.
+//
+// API:
+// ====
+// vx::vector<T>::unit
+//      The size of each unit, as a constant expression.
+// vx::vector<T>::vector(size_t count) / vector(std::initializer_list<T>)
+//      Creates a vector of 'count' value-initialized units, or of a list.
+// vx::vector<T>::vector(vector &&) / operator=(vector &&)
+//      Takes over the vector held by another wrapper, leaving it empty.
+// vector vx::vector<T>::clone() const
+//      Returns a copy of the vector.
+// T *vx::vector<T>::get() / T *release() / static vector adopt(T *vx)
+//      Exchange the underlying vector with C code; get() keeps ownership,
+//      release() gives it up, and adopt() takes ownership of a vector made by
+//      vx_new().
+// size(), capacity(), empty(), data(), operator[], front(), back(), begin(),
+// end(), reserve(), shrink_to_fit(), clear(), resize(), push_back(),
+// emplace_back(), pop_back(), insert(), erase()
+//      As for std::vector.
+// operator std::span<T>()
+//      (C++20) Views the vector as a span.
+// vx::vector<T>::vector(std::pmr::memory_resource *resource)
+//      When compiled with VX_ALLOCATOR, creates an empty vector whose memory,
+//      including that of any clone(), comes from 'resource'.
+// std::pmr::memory_resource *vx::vector<T>::resource() const
+//      Returns the resource the vector allocates from, or NULL for malloc().
+// struct vx_allocator vx::pmr_allocator(std::pmr::memory_resource *resource)
+//      Returns a vx.h allocator drawing from 'resource', for use with
+//      vx_new_with() on vectors of any type.
+
+#ifndef VX_HPP
+#define VX_HPP
+
+#include "vx.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#if __cplusplus >= 202002L && __has_include(<span>)
+#include <span>
+#define VX_HPP_SPAN
+#endif
+
+#if defined(VX_ALLOCATOR) && __has_include(<memory_resource>)
+#include <memory_resource>
+#define VX_HPP_PMR
+#endif
+
+namespace vx {
+
+#ifdef VX_HPP_PMR
+inline void *
+pmr_resize(void *ctx, void *ptr, std::size_t old_size, std::size_t new_size)
+{
+	constexpr std::size_t align = alignof(std::max_align_t);
+
+	auto *resource = static_cast<std::pmr::memory_resource *>(ctx);
+	void *block    = nullptr;
+
+	if (new_size) {
+		try {
+			block = resource->allocate(new_size, align);
+		} catch (...) {
+			return nullptr;
+		}
+		if (ptr) {
+			std::memcpy(block, ptr, std::min(old_size, new_size));
+		}
+	}
+	if (ptr) {
+		resource->deallocate(ptr, old_size, align);
+	}
+
+	return block;
+}
+
+inline struct vx_allocator pmr_allocator(std::pmr::memory_resource *resource)
+{
+	return {pmr_resize, resource};
+}
+#endif
+
+template <typename T> class vector {
+	// Units are stored at the data pointer of a vx vector, which is only
+	// aligned to VX_ALIGN when outlined, and otherwise to the 16 bytes the
+	// tag is padded to and malloc() or pmr_resize() provide.
+#ifdef VX_OUTLINE
+	static_assert(alignof(T) <= VX_ALIGN,
+	              "vx::vector units may not be aligned beyond VX_ALIGN");
+#else
+	static_assert(alignof(T) <= 16,
+	              "vx::vector units may not be aligned beyond 16 bytes");
+#endif
+
+  public:
+	using value_type      = T;
+	using size_type       = std::size_t;
+	using difference_type = std::ptrdiff_t;
+	using reference       = T &;
+	using const_reference = const T &;
+	using pointer         = T *;
+	using const_pointer   = const T *;
+	using iterator        = T *;
+	using const_iterator  = const T *;
+
+	static constexpr std::size_t unit = sizeof(T);
+
+	vector() noexcept = default;
+
+	explicit vector(std::size_t count)
+	{
+		resize(count);
+	}
+
+#ifdef VX_HPP_PMR
+	explicit vector(std::pmr::memory_resource *resource)
+	    : vx_(static_cast<T *>(
+	          vx_new_with_(unit, 0, nullptr, pmr_allocator(resource))))
+	{
+		if (!vx_) {
+			throw std::bad_alloc();
+		}
+	}
+
+	std::pmr::memory_resource *resource() const noexcept
+	{
+		if (!vx_ || vx_tag(vx_)->alloc.resize != pmr_resize) {
+			return nullptr;
+		}
+		return static_cast<std::pmr::memory_resource *>(
+		    vx_tag(vx_)->alloc.ctx);
+	}
+#endif
+
+	vector(std::initializer_list<T> list)
+	{
+		reserve(list.size());
+		for (const T &value : list) {
+			push_back(value);
+		}
+	}
+
+	vector(const vector &)            = delete;
+	vector &operator=(const vector &) = delete;
+
+	vector(vector &&other) noexcept
+	    : vx_(std::exchange(other.vx_, nullptr))
+	{
+	}
+
+	vector &operator=(vector &&other) noexcept
+	{
+		if (this != &other) {
+			destroy();
+			vx_ = std::exchange(other.vx_, nullptr);
+		}
+		return *this;
+	}
+
+	~vector()
+	{
+		destroy();
+	}
+
+	vector clone() const
+	{
+		vector copy;
+		std::size_t count = size();
+
+		if (vx_) {
+			copy.vx_ = static_cast<T *>(new_vx(0));
+		}
+
+		copy.reserve(count);
+		if constexpr (std::is_trivially_copyable_v<T>) {
+			if (count) {
+				std::memcpy(copy.vx_, vx_, count * unit);
+			}
+			copy.set_size(count);
+		} else {
+			for (std::size_t i = 0; i < count; i++) {
+				copy.push_back(vx_[i]);
+			}
+		}
+
+		return copy;
+	}
+
+	static vector adopt(T *vx) noexcept
+	{
+		vector v;
+		v.vx_ = vx;
+		return v;
+	}
+
+	T *get() const noexcept
+	{
+		return vx_;
+	}
+
+	T *release() noexcept
+	{
+		return std::exchange(vx_, nullptr);
+	}
+
+	std::size_t size() const noexcept
+	{
+		return vx_ ? vx_tag_count(vx_tag(vx_)) : 0;
+	}
+
+	std::size_t capacity() const noexcept
+	{
+		return vx_ ? vx_tag_capacity(vx_tag(vx_)) : 0;
+	}
+
+	bool empty() const noexcept
+	{
+		return !size();
+	}
+
+	T *data() noexcept
+	{
+		return vx_;
+	}
+
+	const T *data() const noexcept
+	{
+		return vx_;
+	}
+
+	T &operator[](std::size_t index) noexcept
+	{
+		return vx_[index];
+	}
+
+	const T &operator[](std::size_t index) const noexcept
+	{
+		return vx_[index];
+	}
+
+	T &front() noexcept
+	{
+		return vx_[0];
+	}
+
+	const T &front() const noexcept
+	{
+		return vx_[0];
+	}
+
+	T &back() noexcept
+	{
+		return vx_[size() - 1];
+	}
+
+	const T &back() const noexcept
+	{
+		return vx_[size() - 1];
+	}
+
+	iterator begin() noexcept
+	{
+		return vx_;
+	}
+
+	iterator end() noexcept
+	{
+		return vx_ + size();
+	}
+
+	const_iterator begin() const noexcept
+	{
+		return vx_;
+	}
+
+	const_iterator end() const noexcept
+	{
+		return vx_ + size();
+	}
+
+	const_iterator cbegin() const noexcept
+	{
+		return begin();
+	}
+
+	const_iterator cend() const noexcept
+	{
+		return end();
+	}
+
+#ifdef VX_HPP_SPAN
+	operator std::span<T>() noexcept
+	{
+		return std::span<T>(vx_, size());
+	}
+
+	operator std::span<const T>() const noexcept
+	{
+		return std::span<const T>(vx_, size());
+	}
+#endif
+
+	void reserve(std::size_t new_capacity)
+	{
+		if (new_capacity > capacity()) {
+			reallocate(new_capacity);
+		}
+	}
+
+	void shrink_to_fit()
+	{
+		if (vx_ && capacity() > size()) {
+			reallocate(size());
+		}
+	}
+
+	void clear() noexcept
+	{
+		truncate(0);
+	}
+
+	void resize(std::size_t count)
+	{
+		std::size_t prev_count = size();
+
+		if (count <= prev_count) {
+			truncate(count);
+			return;
+		}
+
+		reserve(count);
+		for (std::size_t i = prev_count; i < count; i++) {
+			new (vx_ + i) T();
+			set_size(i + 1);
+		}
+	}
+
+	void push_back(const T &value)
+	{
+		emplace_back(value);
+	}
+
+	void push_back(T &&value)
+	{
+		emplace_back(std::move(value));
+	}
+
+	template <typename... Args> T &emplace_back(Args &&...args)
+	{
+		std::size_t count = size();
+
+		if (count == capacity()) {
+			// The arguments may refer to units of this vector, so the
+			// new unit is built before the old storage goes away.
+			T value(std::forward<Args>(args)...);
+			expand(count + 1);
+			new (vx_ + count) T(std::move(value));
+		} else {
+			new (vx_ + count) T(std::forward<Args>(args)...);
+		}
+		set_size(count + 1);
+
+		return vx_[count];
+	}
+
+	void pop_back() noexcept
+	{
+		truncate(size() - 1);
+	}
+
+	iterator insert(const_iterator pos, const T &value)
+	{
+		std::size_t index = pos - vx_;
+
+		emplace_back(value);
+		std::rotate(vx_ + index, end() - 1, end());
+
+		return vx_ + index;
+	}
+
+	iterator erase(const_iterator first, const_iterator last)
+	{
+		std::size_t index = first - vx_;
+		std::size_t count = last - first;
+
+		std::move(vx_ + index + count, end(), vx_ + index);
+		truncate(size() - count);
+
+		return vx_ + index;
+	}
+
+	iterator erase(const_iterator pos)
+	{
+		return erase(pos, pos + 1);
+	}
+
+  private:
+	T *vx_ = nullptr;
+
+	// Creates an empty vector with the given capacity, allocated the same
+	// way as this one.
+	void *new_vx(std::size_t capacity) const
+	{
+		void *vx;
+
+#ifdef VX_ALLOCATOR
+		if (vx_ && vx_tag(vx_)->alloc.resize) {
+			vx = vx_new_with_(
+			    unit, capacity, nullptr, vx_tag(vx_)->alloc);
+		} else {
+			vx = vx_new_(unit, capacity, nullptr);
+		}
+#else
+		vx = vx_new_(unit, capacity, nullptr);
+#endif
+		if (!vx) {
+			throw std::bad_alloc();
+		}
+
+		struct vx_tag *tag = vx_tag(vx);
+		vx_tag_set_count(tag, 0);
+
+		return vx;
+	}
+
+	void set_size(std::size_t count) noexcept
+	{
+		struct vx_tag *tag = vx_tag(vx_);
+		vx_tag_set_count(tag, count);
+	}
+
+	void truncate(std::size_t count) noexcept
+	{
+		if constexpr (!std::is_trivially_destructible_v<T>) {
+			for (std::size_t i = count; i < size(); i++) {
+				vx_[i].~T();
+			}
+		}
+		if (vx_) {
+			set_size(count);
+		}
+	}
+
+	void destroy() noexcept
+	{
+		truncate(0);
+		vx_free_(reinterpret_cast<void **>(&vx_));
+	}
+
+	void expand(std::size_t min_capacity)
+	{
+		std::size_t new_capacity = capacity() * 2;
+
+		reallocate(std::max({new_capacity,
+		                     min_capacity,
+		                     static_cast<std::size_t>(VX_CHUNK_COUNT)}));
+	}
+
+	void reallocate(std::size_t new_capacity)
+	{
+		if constexpr (std::is_trivially_copyable_v<T>) {
+			void *vx = vx_ ? vx_ : new_vx(0);
+			if (!vx_reserve_(&vx, new_capacity)) {
+				if (vx != vx_) {
+					vx_free_(&vx);
+				}
+				throw std::bad_alloc();
+			}
+			vx_ = static_cast<T *>(vx);
+		} else {
+			// Non-trivial units cannot be moved by realloc(), so they
+			// are moved into a new vector one at a time.
+
+			void *vx = new_vx(new_capacity);
+
+			T          *dest  = static_cast<T *>(vx);
+			std::size_t count = size();
+			std::size_t i     = 0;
+
+			try {
+				for (; i < count; i++) {
+					new (dest + i)
+					    T(std::move_if_noexcept(vx_[i]));
+				}
+			} catch (...) {
+				while (i--) {
+					dest[i].~T();
+				}
+				vx_free_(&vx);
+				throw;
+			}
+
+			destroy();
+			vx_ = dest;
+			set_size(count);
+		}
+	}
+};
+
+} // namespace vx
+
+#endif
@@ -0,0 +1,610 @@
+// vx_bits.h - bitmaps with rank and select for vx.h
+// http://github.com/auul/vx.h
+//
+// License: Public Domain (www.unlicense.org); see vx.h
+// ==========================================
+//
+// Linking:
+//      Include this header in place of vx.h, which it includes. The
+//      implementation is compiled along with that of vx.h, in the ONE .c file
+//      which defines VX_IMPLEMENT.
+//
+// Usage:
+//      A bitmap packs a growable array of bits into a vector of uint64_t
+//      words, bit (i % 64) of word (i / 64) holding bit 'i', with the bits
+//      past the last always clear. This is the layout of the bitmaps
+//      returned by vx_table_scan_bits(), and 'bits.words' may be read
+//      directly, or walked a word at a time.
+//
+//      Counting and combining bitmaps runs over whole words, with AVX2 or
+//      POPCNT kernels where available (see SIMD in vx.h). Iteration skips
+//      to each set bit by counting trailing zeros, so costs one step per set
+//      bit and per empty word.
+//
+//      Rank and select are answered from a separate index, built once over
+//      a bitmap which is then left unchanged. It holds the number of set bits
+//      before each block of 512 bits, adding an eighth to the size of the
+//      bitmap, so that a rank counts the bits of at most eight words. Select
+//      also samples the block of every VX_BITS_SELECT_SAMPLE-th (4096th) set
+//      bit, and binary searches the blocks between two samples, so takes
+//      constant time unless the set bits are very sparse.
+//
+// API:
+// ====
+// bool vx_bits_init(struct vx_bits *bits, size_t count)
+//      Initializes 'bits' with 'count' clear bits. Returns a bool indicating
+//      success or failure.
+// void vx_bits_free(struct vx_bits *bits)
+//      Frees the words of 'bits'.
+// size_t vx_bits_count(const struct vx_bits *bits)
+//      Returns the number of bits in 'bits'.
+// bool vx_bits_resize(struct vx_bits *bits, size_t count)
+//      Sets the number of bits to 'count', clearing any added bits. Returns a
+//      bool indicating success or failure.
+// bool vx_bits_push(struct vx_bits *bits, bool value)
+//      Appends a bit of 'value'. Returns a bool indicating success or failure.
+// bool vx_bits_test(const struct vx_bits *bits, size_t i)
+// void vx_bits_set(struct vx_bits *bits, size_t i)
+// void vx_bits_clear(struct vx_bits *bits, size_t i)
+// void vx_bits_flip(struct vx_bits *bits, size_t i)
+//      Test, set, clear or flip bit 'i', which must be less than the count.
+// size_t vx_bits_popcount(const struct vx_bits *bits)
+//      Returns the number of set bits.
+// void vx_bits_and(struct vx_bits *dest, const struct vx_bits *src)
+// void vx_bits_or(struct vx_bits *dest, const struct vx_bits *src)
+// void vx_bits_xor(struct vx_bits *dest, const struct vx_bits *src)
+// void vx_bits_andnot(struct vx_bits *dest, const struct vx_bits *src)
+//      Combine each bit of 'dest' with the same bit of 'src', setting it to
+//      'dest & src', 'dest | src', 'dest ^ src' or 'dest & ~src'. The bits of
+//      'src' past its count are taken as clear, and the count of 'dest' is
+//      unchanged.
+// size_t vx_bits_next(const struct vx_bits *bits, size_t from)
+//      Returns the index of the first set bit from 'from' on, or SIZE_MAX if
+//      there is none, so that the set bits are visited by:
+//              for (size_t i = vx_bits_next(&bits, 0); i != SIZE_MAX;
+//                   i = vx_bits_next(&bits, i + 1))
+// bool vx_bits_rank_init(struct vx_bits_rank *rank,
+//                        const struct vx_bits *bits)
+//      Builds the rank and select index of 'bits', which must not change
+//      while it is in use. Returns a bool indicating success or failure.
+// void vx_bits_rank_free(struct vx_bits_rank *rank)
+//      Frees the index 'rank'.
+// size_t vx_bits_rank(const struct vx_bits_rank *rank,
+//                     const struct vx_bits *bits, size_t i)
+//      Returns the number of set bits before bit 'i', which must be at most
+//      the count.
+// size_t vx_bits_select(const struct vx_bits_rank *rank,
+//                       const struct vx_bits *bits, size_t k)
+//      Returns the index of the set bit with 'k' set bits before it, or
+//      SIZE_MAX if there are no more than 'k' set bits.
+
+#ifndef VX_BITS_H
+#define VX_BITS_H
+
+#include "vx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef VX_BITS_SELECT_SAMPLE
+#define VX_BITS_SELECT_SAMPLE 4096
+#endif
+
+struct vx_bits {
+	uint64_t *words;
+	size_t    count;
+};
+
+struct vx_bits_rank {
+	uint64_t *blocks;
+	uint64_t *samples;
+};
+
+bool   vx_bits_init(struct vx_bits *bits, size_t count);
+void   vx_bits_free(struct vx_bits *bits);
+size_t vx_bits_count(const struct vx_bits *bits);
+bool   vx_bits_resize(struct vx_bits *bits, size_t count);
+bool   vx_bits_push(struct vx_bits *bits, bool value);
+size_t vx_bits_popcount(const struct vx_bits *bits);
+void   vx_bits_and(struct vx_bits *dest, const struct vx_bits *src);
+void   vx_bits_or(struct vx_bits *dest, const struct vx_bits *src);
+void   vx_bits_xor(struct vx_bits *dest, const struct vx_bits *src);
+void   vx_bits_andnot(struct vx_bits *dest, const struct vx_bits *src);
+size_t vx_bits_next(const struct vx_bits *bits, size_t from);
+bool   vx_bits_rank_init(struct vx_bits_rank  *rank,
+                         const struct vx_bits *bits);
+void   vx_bits_rank_free(struct vx_bits_rank *rank);
+size_t vx_bits_rank(const struct vx_bits_rank *rank,
+                    const struct vx_bits      *bits,
+                    size_t                     i);
+size_t vx_bits_select(const struct vx_bits_rank *rank,
+                      const struct vx_bits      *bits,
+                      size_t                     k);
+
+static inline bool vx_bits_test(const struct vx_bits *bits, size_t i)
+{
+	return (bits->words[i / 64] >> (i % 64)) & 1;
+}
+
+static inline void vx_bits_set(struct vx_bits *bits, size_t i)
+{
+	bits->words[i / 64] |= (uint64_t)1 << (i % 64);
+}
+
+static inline void vx_bits_clear(struct vx_bits *bits, size_t i)
+{
+	bits->words[i / 64] &= ~((uint64_t)1 << (i % 64));
+}
+
+static inline void vx_bits_flip(struct vx_bits *bits, size_t i)
+{
+	bits->words[i / 64] ^= (uint64_t)1 << (i % 64);
+}
+
+#ifdef VX_IMPLEMENT
+
+#define VX_BITS_BLOCK 8
+
+enum vx_bits_op {
+	VX_BITS_AND,
+	VX_BITS_OR,
+	VX_BITS_XOR,
+	VX_BITS_ANDNOT,
+};
+
+static unsigned vx_bits_ctz(uint64_t word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return (unsigned)__builtin_ctzll(word);
+#else
+	unsigned n = 0;
+	for (; !(word & 1); word >>= 1) {
+		n++;
+	}
+	return n;
+#endif
+}
+
+static unsigned vx_bits_popcount64(uint64_t word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return (unsigned)__builtin_popcountll(word);
+#else
+	word = word - ((word >> 1) & 0x5555555555555555ull);
+	word = (word & 0x3333333333333333ull)
+	     + ((word >> 2) & 0x3333333333333333ull);
+	word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+	return (unsigned)((word * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+// Counts
+// ======
+
+static size_t vx_bits_popcount_scalar(const uint64_t *words, size_t n)
+{
+	size_t total = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		total += vx_bits_popcount64(words[i]);
+	}
+
+	return total;
+}
+
+#ifdef VX_SIMD_X86
+__attribute__((target("popcnt"))) static size_t
+vx_bits_popcount_popcnt(const uint64_t *words, size_t n)
+{
+	size_t total = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		total += (size_t)__builtin_popcountll(words[i]);
+	}
+
+	return total;
+}
+
+// Each byte is counted by looking up its two nibbles in a table of 16 counts,
+// and the byte counts are summed into four 64-bit lanes by _mm256_sad_epu8.
+__attribute__((target("avx2"))) static size_t
+vx_bits_popcount_avx2(const uint64_t *words, size_t n)
+{
+	const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+	                                       1, 2, 2, 3, 2, 3, 3, 4,
+	                                       0, 1, 1, 2, 1, 2, 2, 3,
+	                                       1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low   = _mm256_set1_epi8(0x0F);
+	__m256i       sums  = _mm256_setzero_si256();
+	size_t        i     = 0;
+
+	for (; i + 4 <= n; i += 4) {
+		__m256i v  = _mm256_loadu_si256((const __m256i *)(words + i));
+		__m256i lo = _mm256_and_si256(v, low);
+		__m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+
+		lo = _mm256_shuffle_epi8(table, lo);
+		hi = _mm256_shuffle_epi8(table, hi);
+		sums = _mm256_add_epi64(
+		    sums,
+		    _mm256_sad_epu8(_mm256_add_epi8(lo, hi),
+		                    _mm256_setzero_si256()));
+	}
+
+	uint64_t lanes[4];
+	_mm256_storeu_si256((__m256i *)lanes, sums);
+
+	return (size_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3])
+	     + vx_bits_popcount_popcnt(words + i, n - i);
+}
+#endif
+
+static size_t vx_bits_popcount_words(const uint64_t *words, size_t n)
+{
+#ifdef VX_SIMD_X86
+	enum vx_simd level = vx_simd_level();
+
+	if (level >= VX_SIMD_AVX2) {
+		return vx_bits_popcount_avx2(words, n);
+	}
+	if (level >= VX_SIMD_SSE42) {
+		return vx_bits_popcount_popcnt(words, n);
+	}
+#endif
+
+	return vx_bits_popcount_scalar(words, n);
+}
+
+// Bitmaps
+// =======
+
+static size_t vx_bits_words(size_t count)
+{
+	return (count + 63) / 64;
+}
+
+// Clears the bits of the last word past the count.
+static void vx_bits_trim(struct vx_bits *bits)
+{
+	if (bits->count % 64) {
+		bits->words[bits->count / 64] &=
+		    ~(uint64_t)0 >> (64 - bits->count % 64);
+	}
+}
+
+bool vx_bits_init(struct vx_bits *bits, size_t count)
+{
+	bits->count = count;
+	bits->words = vx_new(uint64_t, vx_bits_words(count), NULL);
+
+	return bits->words != NULL;
+}
+
+void vx_bits_free(struct vx_bits *bits)
+{
+	vx_free(bits->words);
+	bits->count = 0;
+}
+
+size_t vx_bits_count(const struct vx_bits *bits)
+{
+	return bits->count;
+}
+
+bool vx_bits_resize(struct vx_bits *bits, size_t count)
+{
+	struct vx_tag *tag = vx_tag(bits->words);
+	size_t         old = vx_tag_count(tag);
+	size_t         n   = vx_bits_words(count);
+
+	if (n > old) {
+		// Growing doubles the capacity, so that repeated pushes are
+		// amortized O(1); vx_grow_() then zeroes the new words.
+
+		if (n > vx_tag_capacity(tag)
+		    && !vx_expand_((void **)&bits->words, n)) {
+			return false;
+		}
+		vx_grow_((void **)&bits->words, n - old);
+	} else {
+		vx_tag_set_count(tag, n);
+	}
+
+	bits->count = count;
+	vx_bits_trim(bits);
+
+	return true;
+}
+
+bool vx_bits_push(struct vx_bits *bits, bool value)
+{
+	size_t i = bits->count;
+
+	if (!vx_bits_resize(bits, i + 1)) {
+		return false;
+	}
+	if (value) {
+		vx_bits_set(bits, i);
+	}
+
+	return true;
+}
+
+size_t vx_bits_popcount(const struct vx_bits *bits)
+{
+	return vx_bits_popcount_words(bits->words,
+	                              vx_tag_count(vx_tag(bits->words)));
+}
+
+// Each of these combines the first 'n' words of 'a' with those of 'b' by
+// 'op', storing the result in 'a'.
+#define VX_BITS_APPLY_(expr)                                                   \
+	for (size_t i = 0; i < n; i++) {                                       \
+		a[i] = expr;                                                   \
+	}                                                                      \
+	break;
+
+static void vx_bits_apply_scalar(uint64_t       *a,
+                                 const uint64_t *b,
+                                 size_t          n,
+                                 enum vx_bits_op op)
+{
+	switch (op) {
+	case VX_BITS_AND:
+		VX_BITS_APPLY_(a[i] & b[i])
+	case VX_BITS_OR:
+		VX_BITS_APPLY_(a[i] | b[i])
+	case VX_BITS_XOR:
+		VX_BITS_APPLY_(a[i] ^ b[i])
+	case VX_BITS_ANDNOT:
+		VX_BITS_APPLY_(a[i] & ~b[i])
+	}
+}
+
+#ifdef VX_SIMD_X86
+#define VX_BITS_APPLY_AVX2_(expr)                                              \
+	for (; i + 4 <= n; i += 4) {                                           \
+		__m256i x = _mm256_loadu_si256((const __m256i *)(a + i));      \
+		__m256i y = _mm256_loadu_si256((const __m256i *)(b + i));      \
+		_mm256_storeu_si256((__m256i *)(a + i), expr);                 \
+	}                                                                      \
+	break;
+
+__attribute__((target("avx2"))) static size_t vx_bits_apply_avx2(
+    uint64_t *a, const uint64_t *b, size_t n, enum vx_bits_op op)
+{
+	size_t i = 0;
+
+	switch (op) {
+	case VX_BITS_AND:
+		VX_BITS_APPLY_AVX2_(_mm256_and_si256(x, y))
+	case VX_BITS_OR:
+		VX_BITS_APPLY_AVX2_(_mm256_or_si256(x, y))
+	case VX_BITS_XOR:
+		VX_BITS_APPLY_AVX2_(_mm256_xor_si256(x, y))
+	case VX_BITS_ANDNOT:
+		VX_BITS_APPLY_AVX2_(_mm256_andnot_si256(y, x))
+	}
+
+	return i;
+}
+#endif
+
+static void vx_bits_apply(struct vx_bits       *dest,
+                          const struct vx_bits *src,
+                          enum vx_bits_op       op)
+{
+	size_t    n = vx_tag_count(vx_tag(dest->words));
+	size_t    m = vx_tag_count(vx_tag(src->words));
+	size_t    k = n < m ? n : m;
+	size_t    i = 0;
+	uint64_t *a = dest->words;
+
+#ifdef VX_SIMD_X86
+	if (vx_simd_level() >= VX_SIMD_AVX2) {
+		i = vx_bits_apply_avx2(a, src->words, k, op);
+	}
+#endif
+	vx_bits_apply_scalar(a + i, src->words + i, k - i, op);
+
+	// Past the words of 'src', AND clears 'dest' and the rest leave it
+	// unchanged; a shorter 'dest' may have taken bits past its count.
+
+	if (op == VX_BITS_AND && n > k) {
+		memset(a + k, 0, (n - k) * sizeof(uint64_t));
+	}
+	vx_bits_trim(dest);
+}
+
+void vx_bits_and(struct vx_bits *dest, const struct vx_bits *src)
+{
+	vx_bits_apply(dest, src, VX_BITS_AND);
+}
+
+void vx_bits_or(struct vx_bits *dest, const struct vx_bits *src)
+{
+	vx_bits_apply(dest, src, VX_BITS_OR);
+}
+
+void vx_bits_xor(struct vx_bits *dest, const struct vx_bits *src)
+{
+	vx_bits_apply(dest, src, VX_BITS_XOR);
+}
+
+void vx_bits_andnot(struct vx_bits *dest, const struct vx_bits *src)
+{
+	vx_bits_apply(dest, src, VX_BITS_ANDNOT);
+}
+
+size_t vx_bits_next(const struct vx_bits *bits, size_t from)
+{
+	if (from >= bits->count) {
+		return SIZE_MAX;
+	}
+
+	size_t   n    = vx_tag_count(vx_tag(bits->words));
+	size_t   i    = from / 64;
+	uint64_t word = bits->words[i] & (~(uint64_t)0 << (from % 64));
+
+	while (!word) {
+		if (++i == n) {
+			return SIZE_MAX;
+		}
+		word = bits->words[i];
+	}
+
+	return 64 * i + vx_bits_ctz(word);
+}
+
+// Rank and select
+// ===============
+// blocks[b] holds the number of set bits before block 'b' of VX_BITS_BLOCK
+// words, with one more entry holding the total. samples[s] holds the block
+// of the set bit with s * VX_BITS_SELECT_SAMPLE set bits before it.
+
+bool vx_bits_rank_init(struct vx_bits_rank *rank, const struct vx_bits *bits)
+{
+	size_t n      = vx_tag_count(vx_tag(bits->words));
+	size_t blocks = (n + VX_BITS_BLOCK - 1) / VX_BITS_BLOCK;
+
+	rank->blocks  = vx_new(uint64_t, blocks + 1, NULL);
+	rank->samples = NULL;
+	if (!rank->blocks) {
+		return false;
+	}
+
+	uint64_t total = 0;
+	for (size_t b = 0; b < blocks; b++) {
+		size_t w = VX_BITS_BLOCK * b;
+		size_t k = n - w < VX_BITS_BLOCK ? n - w : VX_BITS_BLOCK;
+
+		rank->blocks[b]  = total;
+		total           += vx_bits_popcount_words(bits->words + w, k);
+	}
+	rank->blocks[blocks] = total;
+
+	// With the total known, the samples are allocated at once and filled
+	// from the block counts, rather than appended one at a time.
+
+	size_t samples = (total + VX_BITS_SELECT_SAMPLE - 1)
+	               / VX_BITS_SELECT_SAMPLE;
+
+	rank->samples = vx_new(uint64_t, samples, NULL);
+	if (!rank->samples) {
+		vx_bits_rank_free(rank);
+		return false;
+	}
+
+	// A sample falls in block 'b' for each multiple of the sample rate in
+	// [blocks[b], blocks[b + 1]).
+
+	size_t s = 0;
+	for (size_t b = 0; b < blocks; b++) {
+		for (; s < samples
+		       && s * VX_BITS_SELECT_SAMPLE < rank->blocks[b + 1];
+		     s++) {
+			rank->samples[s] = b;
+		}
+	}
+
+	return true;
+}
+
+void vx_bits_rank_free(struct vx_bits_rank *rank)
+{
+	vx_free(rank->blocks);
+	vx_free(rank->samples);
+}
+
+size_t vx_bits_rank(const struct vx_bits_rank *rank,
+                    const struct vx_bits      *bits,
+                    size_t                     i)
+{
+	size_t w     = i / 64;
+	size_t b     = w / VX_BITS_BLOCK;
+	size_t total = (size_t)rank->blocks[b];
+
+	for (size_t j = VX_BITS_BLOCK * b; j < w; j++) {
+		total += vx_bits_popcount64(bits->words[j]);
+	}
+	if (i % 64) {
+		total += vx_bits_popcount64(bits->words[w]
+		                            & (~(uint64_t)0 >> (64 - i % 64)));
+	}
+
+	return total;
+}
+
+// Returns the index of the set bit of 'word' with 'r' set bits before it,
+// finding its byte by the counts of the bytes before it.
+static unsigned vx_bits_select64(uint64_t word, unsigned r)
+{
+	unsigned shift = 0;
+
+	for (;; shift += 8) {
+		unsigned ones = vx_bits_popcount64((word >> shift) & 0xFF);
+		if (r < ones) {
+			break;
+		}
+		r -= ones;
+	}
+
+	uint64_t byte = (word >> shift) & 0xFF;
+	for (; r; r--) {
+		byte &= byte - 1;
+	}
+
+	return shift + vx_bits_ctz(byte);
+}
+
+size_t vx_bits_select(const struct vx_bits_rank *rank,
+                      const struct vx_bits      *bits,
+                      size_t                     k)
+{
+	size_t blocks = vx_tag_count(vx_tag(rank->blocks)) - 1;
+	size_t n      = vx_tag_count(vx_tag(bits->words));
+
+	if (k >= rank->blocks[blocks]) {
+		return SIZE_MAX;
+	}
+
+	// The bit lies in the last block, between those of the samples before
+	// and after it, which has no more than 'k' set bits before it.
+
+	size_t s  = k / VX_BITS_SELECT_SAMPLE;
+	size_t lo = (size_t)rank->samples[s];
+	size_t hi = s + 1 < vx_tag_count(vx_tag(rank->samples))
+	              ? (size_t)rank->samples[s + 1]
+	              : blocks - 1;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo + 1) / 2;
+		if (rank->blocks[mid] <= k) {
+			lo = mid;
+		} else {
+			hi = mid - 1;
+		}
+	}
+
+	size_t left = k - (size_t)rank->blocks[lo];
+	size_t w    = VX_BITS_BLOCK * lo;
+
+	for (;; w++) {
+		size_t ones = vx_bits_popcount64(bits->words[w]);
+		if (left < ones || w + 1 == n) {
+			break;
+		}
+		left -= ones;
+	}
+
+	return 64 * w + vx_bits_select64(bits->words[w], (unsigned)left);
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,344 @@
+// vx_extsort.h - external-memory sorting for vx.h
+// http://github.com/auul/vx.h
+//
+// License: Public Domain (www.unlicense.org); see vx.h
+// ==========================================
+//
+// Linking:
+//      Include this header in place of vx.h, which it includes. The
+//      implementation is compiled along with that of vx.h, in the ONE .c file
+//      which defines VX_IMPLEMENT.
+//
+// Usage:
+//      An external sort orders a vector too large to hold in memory, stored in
+//      a file in the format of vx_write(). The units are read a memory budget
+//      at a time, and each batch is sorted with qsort() and written to a
+//      temporary file as a sorted run. The runs are then merged, through the
+//      streaming merge of vx.h, into the output file, with every file read and
+//      written sequentially in large blocks. Input which fits within the
+//      budget is sorted in memory, without temporary files.
+//
+//      Each run is held open while the runs are merged, so the size of the
+//      input divided by the budget must stay within the number of files the
+//      process may open. Temporary files are named vx_extsort_* and removed
+//      once the sort completes or fails.
+//
+// API:
+// ====
+// bool vx_external_sort(FILE *in, FILE *out,
+//                       int (*cmp)(const void *, const void *),
+//                       const struct vx_extsort_config *config)
+//      Reads the vector written by vx_write() at the current position of
+//      'in', and writes it to 'out' in the same format, sorted by 'cmp' as for
+//      qsort(). The result may be read back with vx_read() if it fits in
+//      memory. 'config' may be NULL, and any of its members zero, for the
+//      defaults:
+//              'memory'   bytes of units held in memory at once, by default
+//                         VX_EXTSORT_MEMORY (256 MiB)
+//              'temp_dir' directory for the runs, by default $TMPDIR, or /tmp
+//                         if it is unset
+//      Returns a bool indicating success or failure.
+
+#ifndef VX_EXTSORT_H
+#define VX_EXTSORT_H
+
+#include "vx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef VX_EXTSORT_MEMORY
+#define VX_EXTSORT_MEMORY ((size_t)256 << 20)
+#endif
+
+struct vx_extsort_config {
+	size_t      memory;
+	const char *temp_dir;
+};
+
+bool vx_external_sort(FILE *in,
+                      FILE *out,
+                      int (*cmp)(const void *, const void *),
+                      const struct vx_extsort_config *config);
+
+#ifdef VX_IMPLEMENT
+
+#include <time.h>
+
+#define VX_EXTSORT_ATTEMPTS 100
+
+struct vx_extsort_reader {
+	FILE  *file;
+	size_t unit;
+	size_t left;
+};
+
+// The vector of run paths frees each path with this, so that freeing the
+// vector also removes the runs.
+static void vx_extsort_remove(void *unit)
+{
+	char *path = *(char **)unit;
+
+	remove(path);
+	vx_free(path);
+}
+
+// Creates a new temporary file in 'dir' for run number 'run', which is opened
+// with "x" so that an existing file is never reused, and retried under another
+// name if it exists.
+static FILE *vx_extsort_create(const char *dir, size_t run, char **path_p)
+{
+	unsigned long stamp = (unsigned long)time(NULL)
+	                    ^ (unsigned long)(uintptr_t)path_p;
+
+	for (unsigned attempt = 0; attempt < VX_EXTSORT_ATTEMPTS; attempt++) {
+		char *path = vx_str_new(
+		    "%s/vx_extsort_%lx_%zu_%u", dir, stamp, run, attempt);
+		if (!path) {
+			return NULL;
+		}
+
+		FILE *file = fopen(path, "wbx");
+		if (file) {
+			*path_p = path;
+			return file;
+		}
+		vx_free(path);
+	}
+
+#ifdef VX_USER_ERRORS
+	fprintf(stderr, "Error creating sort run in %s.\n", dir);
+#endif
+	return NULL;
+}
+
+static bool vx_extsort_fill(FILE *in, void *vx, size_t count)
+{
+	size_t unit = vx_tag_unit(vx_tag(vx));
+
+	if (fread(vx, unit, count, in) != count) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error reading sort input.\n");
+#endif
+		return false;
+	}
+	vx_tag_set_count(vx_tag(vx), count);
+
+	return true;
+}
+
+// Sorts the units of 'vx' and writes them to a new run, whose path is added
+// to 'paths' before anything is written, so that it is removed along with the
+// other runs on failure.
+static bool vx_extsort_spill(void       *vx,
+                             const char *dir,
+                             char     ***paths_p,
+                             int (*cmp)(const void *, const void *))
+{
+	struct vx_tag *tag = vx_tag(vx);
+
+	qsort(vx, vx_tag_count(tag), vx_tag_unit(tag), cmp);
+
+	size_t run = vx_tag_count(vx_tag(*paths_p));
+	char  *path;
+	FILE  *file = vx_extsort_create(dir, run, &path);
+	if (!file) {
+		return false;
+	}
+	if (!vx_append_((void **)paths_p, &path, 1)) {
+		fclose(file);
+		remove(path);
+		vx_free(path);
+		return false;
+	}
+
+	bool ok = vx_write(vx, file);
+
+	if (fclose(file) && ok) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error writing sort run.\n");
+#endif
+		ok = false;
+	}
+
+	return ok;
+}
+
+static size_t vx_extsort_read(void *ctx, void *dest, size_t max)
+{
+	struct vx_extsort_reader *reader = (struct vx_extsort_reader *)ctx;
+
+	size_t count = max < reader->left ? max : reader->left;
+
+	count         = fread(dest, reader->unit, count, reader->file);
+	reader->left -= count;
+
+	return count;
+}
+
+static bool vx_extsort_open(struct vx_extsort_reader *reader,
+                            const char               *path,
+                            size_t                    unit)
+{
+	size_t file_unit;
+
+	reader->unit = unit;
+	reader->file = fopen(path, "rb");
+	if (!reader->file) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error opening sort run %s.\n", path);
+#endif
+		return false;
+	}
+
+	return vx_read_header(reader->file, &file_unit, &reader->left)
+	    && file_unit == unit;
+}
+
+// Merges the runs into 'out', holding a block of each run and a block of
+// output in memory, so that each block takes an equal share of the budget.
+static bool vx_extsort_merge(char **paths,
+                             size_t unit,
+                             size_t count,
+                             size_t memory,
+                             FILE  *out,
+                             int (*cmp)(const void *, const void *))
+{
+	size_t n     = vx_tag_count(vx_tag(paths));
+	size_t block = memory / (n + 1) / unit;
+	if (!block) {
+		block = 1;
+	}
+
+	struct vx_extsort_reader *readers =
+	    (struct vx_extsort_reader *)calloc(n, sizeof(*readers));
+	struct vx_merge_source *sources =
+	    (struct vx_merge_source *)malloc(n * sizeof(*sources));
+	void *batch = vx_new_(unit, 0, NULL);
+
+	bool ok = readers && sources && batch && vx_reserve_(&batch, block);
+	if (!ok) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error allocating sort merge.\n");
+#endif
+	}
+
+	size_t total = 0;
+	for (size_t r = 0; ok && r < n; r++) {
+		ok              = vx_extsort_open(&readers[r], paths[r], unit);
+		total          += readers[r].left;
+		sources[r].read = vx_extsort_read;
+		sources[r].ctx  = &readers[r];
+	}
+
+	struct vx_merge merge;
+
+	ok = ok && total == count
+	  && vx_merge_init_(&merge, unit, sources, n, block, cmp, 0);
+
+	if (ok) {
+		ok = vx_write_header(out, unit, count);
+
+		while (ok && !vx_merge_done(&merge)) {
+			vx_tag_set_count(vx_tag(batch), 0);
+			ok = vx_merge_next_(&merge, &batch, block);
+
+			size_t k = vx_tag_count(vx_tag(batch));
+			if (ok && fwrite(batch, unit, k, out) != k) {
+#ifdef VX_USER_ERRORS
+				fprintf(stderr, "Error writing sort output.\n");
+#endif
+				ok = false;
+			}
+		}
+
+		vx_merge_free(&merge);
+	}
+
+	// A run which ended early was truncated, or failed to read.
+
+	for (size_t r = 0; readers && r < n; r++) {
+		if (readers[r].file) {
+			ok = ok && !readers[r].left && !ferror(readers[r].file);
+			fclose(readers[r].file);
+		}
+	}
+
+	free(readers);
+	free(sources);
+	vx_free_(&batch);
+
+	return ok;
+}
+
+bool vx_external_sort(FILE *in,
+                      FILE *out,
+                      int (*cmp)(const void *, const void *),
+                      const struct vx_extsort_config *config)
+{
+	size_t      memory   = VX_EXTSORT_MEMORY;
+	const char *temp_dir = getenv("TMPDIR");
+
+	if (!temp_dir || !*temp_dir) {
+		temp_dir = "/tmp";
+	}
+	if (config && config->memory) {
+		memory = config->memory;
+	}
+	if (config && config->temp_dir) {
+		temp_dir = config->temp_dir;
+	}
+
+	size_t unit, count;
+	if (!vx_read_header(in, &unit, &count)) {
+		return false;
+	}
+
+	size_t chunk = memory / unit ? memory / unit : 1;
+	if (chunk > count) {
+		chunk = count;
+	}
+
+	void *buf = vx_new_(unit, chunk, NULL);
+	if (!buf) {
+		return false;
+	}
+
+	if (count == chunk) {
+		bool ok = vx_extsort_fill(in, buf, count);
+		if (ok) {
+			qsort(buf, count, unit, cmp);
+			ok = vx_write(buf, out);
+		}
+		vx_free_(&buf);
+		return ok;
+	}
+
+	char **paths = vx_new(char *, 0, vx_extsort_remove);
+	bool   ok    = paths != NULL;
+
+	for (size_t done = 0; ok && done < count; done += chunk) {
+		size_t n = count - done < chunk ? count - done : chunk;
+		ok       = vx_extsort_fill(in, buf, n)
+		  && vx_extsort_spill(buf, temp_dir, &paths, cmp);
+	}
+
+	// The input buffer is freed before merging, which holds the budget in
+	// blocks of its own.
+
+	vx_free_(&buf);
+
+	ok = ok && vx_extsort_merge(paths, unit, count, memory, out, cmp);
+	vx_free(paths);
+
+	return ok;
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,468 @@
+// vx_flatmap.h - sorted flat maps and sets for vx.h
+// http://github.com/auul/vx.h
+//
+// License: Public Domain (www.unlicense.org); see vx.h
+// ==========================================
+//
+// Linking:
+//      Include this header in place of vx.h, which it includes. The
+//      implementation is compiled along with that of vx.h, in the ONE .c file
+//      which defines VX_IMPLEMENT.
+//
+// Usage:
+//      A flat map keeps its keys sorted in one vector and its values in a
+//      second, parallel vector, so that lookups binary search a dense array of
+//      keys alone. This beats a hash map for small and medium maps, and for
+//      maps which are built once and read often. Inserting a single key moves
+//      all the keys after it, so many keys should be added at once with
+//      vx_flatmap_build() or vx_flatmap_merge().
+//
+//      The vectors may be read directly as 'map.keys' and 'map.values', e.g.
+//      to iterate over the map in order, but must only be modified via the
+//      functions below. Keys and values are copied bitwise, and the map frees
+//      nothing they point to. A flat set is a flat map with no values, whose
+//      'values' vector is NULL.
+//
+// API:
+// ====
+// bool vx_flatmap_init(struct vx_flatmap *map, KEY_TYPE, VALUE_TYPE,
+//                      int (*cmp)(const void *, const void *))
+// bool vx_flatset_init(struct vx_flatmap *map, KEY_TYPE,
+//                      int (*cmp)(const void *, const void *))
+//      Initializes an empty map or set, ordered by 'cmp' as for qsort().
+//      Returns a bool indicating success or failure.
+// void vx_flatmap_free(struct vx_flatmap *map)
+//      Frees the vectors of 'map'.
+// size_t vx_flatmap_count(const struct vx_flatmap *map)
+//      Returns the number of keys in 'map'.
+// void *vx_flatmap_get(const struct vx_flatmap *map, const void *key)
+//      Returns a pointer to the value of 'key' (or, for a set, to the key
+//      itself), or NULL if it is absent. The pointer is invalidated by any
+//      modification of the map.
+// bool vx_flatmap_contains(const struct vx_flatmap *map, const void *key)
+//      Returns whether 'key' is present in 'map'.
+// bool vx_flatmap_put(struct vx_flatmap *map, const void *key,
+//                     const void *value)
+//      Inserts 'key' with 'value' (NULL for a set), replacing the value of an
+//      existing key. Returns a bool indicating success or failure.
+// bool vx_flatmap_remove(struct vx_flatmap *map, const void *key)
+//      Removes 'key' from 'map', and returns whether it was present.
+// bool vx_flatmap_build(struct vx_flatmap *map, const void *keys,
+//                       const void *values, size_t count)
+//      Replaces the contents of 'map' with the 'count' keys and values of the
+//      arrays 'keys' and 'values' (NULL for a set), which need not be sorted.
+//      Where a key is repeated, the last of its values is kept. Returns a bool
+//      indicating success or failure, in which case 'map' is unchanged.
+// bool vx_flatmap_merge(struct vx_flatmap *map, const void *keys,
+//                       const void *values, size_t count)
+//      As vx_flatmap_build(), but adds the keys and values to those already in
+//      'map', replacing the values of existing keys. The batch is sorted and
+//      merged from the back in one pass, so each existing key moves at most
+//      once. Returns a bool indicating success or failure, in which case 'map'
+//      is unchanged.
+
+#ifndef VX_FLATMAP_H
+#define VX_FLATMAP_H
+
+#include "vx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct vx_flatmap {
+	void *keys;
+	void *values;
+	int (*cmp)(const void *, const void *);
+};
+
+#define vx_flatmap_init(map, key_type, value_type, cmp) \
+	vx_flatmap_init_(map, sizeof(key_type), sizeof(value_type), cmp)
+#define vx_flatset_init(map, key_type, cmp) \
+	vx_flatmap_init_(map, sizeof(key_type), 0, cmp)
+
+bool   vx_flatmap_init_(struct vx_flatmap *map,
+                        size_t             key_unit,
+                        size_t             value_unit,
+                        int (*cmp)(const void *, const void *));
+void   vx_flatmap_free(struct vx_flatmap *map);
+size_t vx_flatmap_count(const struct vx_flatmap *map);
+void  *vx_flatmap_get(const struct vx_flatmap *map, const void *key);
+bool   vx_flatmap_contains(const struct vx_flatmap *map, const void *key);
+bool   vx_flatmap_put(struct vx_flatmap *map,
+                      const void        *key,
+                      const void        *value);
+bool   vx_flatmap_remove(struct vx_flatmap *map, const void *key);
+bool   vx_flatmap_build(struct vx_flatmap *map,
+                        const void        *keys,
+                        const void        *values,
+                        size_t             count);
+bool   vx_flatmap_merge(struct vx_flatmap *map,
+                        const void        *keys,
+                        const void        *values,
+                        size_t             count);
+
+#ifdef VX_IMPLEMENT
+
+bool vx_flatmap_init_(struct vx_flatmap *map,
+                      size_t             key_unit,
+                      size_t             value_unit,
+                      int (*cmp)(const void *, const void *))
+{
+	map->cmp    = cmp;
+	map->values = NULL;
+
+	map->keys = vx_new_(key_unit, 0, NULL);
+	if (!map->keys) {
+		return false;
+	}
+
+	if (value_unit) {
+		map->values = vx_new_(value_unit, 0, NULL);
+		if (!map->values) {
+			vx_free_(&map->keys);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void vx_flatmap_free(struct vx_flatmap *map)
+{
+	vx_free_(&map->keys);
+	vx_free_(&map->values);
+}
+
+size_t vx_flatmap_count(const struct vx_flatmap *map)
+{
+	return vx_tag_count(vx_tag(map->keys));
+}
+
+// Returns the index of 'key' in 'map', or SIZE_MAX if it is absent.
+static size_t vx_flatmap_index(const struct vx_flatmap *map, const void *key)
+{
+	struct vx_tag *tag   = vx_tag(map->keys);
+	size_t         unit  = vx_tag_unit(tag);
+	size_t         count = vx_tag_count(tag);
+	size_t         index = vx_lower_bound(map->keys, key, map->cmp);
+
+	if (index == count
+	    || map->cmp(key, (unsigned char *)map->keys + unit * index)) {
+		return SIZE_MAX;
+	}
+
+	return index;
+}
+
+void *vx_flatmap_get(const struct vx_flatmap *map, const void *key)
+{
+	size_t index = vx_flatmap_index(map, key);
+	if (index == SIZE_MAX) {
+		return NULL;
+	}
+
+	void *vx = map->values ? map->values : map->keys;
+
+	return (unsigned char *)vx + vx_tag_unit(vx_tag(vx)) * index;
+}
+
+bool vx_flatmap_contains(const struct vx_flatmap *map, const void *key)
+{
+	return vx_flatmap_index(map, key) != SIZE_MAX;
+}
+
+// Ensures that both vectors of 'map' can hold 'count' keys, so that neither
+// can fail to grow after the other has been modified.
+static bool vx_flatmap_reserve(struct vx_flatmap *map, size_t count)
+{
+	if (count > vx_tag_capacity(vx_tag(map->keys))
+	    && !vx_expand_(&map->keys, count)) {
+		return false;
+	}
+	if (map->values && count > vx_tag_capacity(vx_tag(map->values))
+	    && !vx_expand_(&map->values, count)) {
+		return false;
+	}
+
+	return true;
+}
+
+bool vx_flatmap_put(struct vx_flatmap *map, const void *key, const void *value)
+{
+	struct vx_tag *tag   = vx_tag(map->keys);
+	size_t         unit  = vx_tag_unit(tag);
+	size_t         count = vx_tag_count(tag);
+	size_t         index = vx_lower_bound(map->keys, key, map->cmp);
+
+	if (index == count
+	    || map->cmp(key, (unsigned char *)map->keys + unit * index)) {
+		if (!vx_flatmap_reserve(map, count + 1)
+		    || !vx_shift_(&map->keys, index, 1)
+		    || (map->values && !vx_shift_(&map->values, index, 1))) {
+			return false;
+		}
+		memcpy((unsigned char *)map->keys + unit * index, key, unit);
+	}
+
+	if (map->values) {
+		size_t value_unit = vx_tag_unit(vx_tag(map->values));
+		memcpy((unsigned char *)map->values + value_unit * index,
+		       value,
+		       value_unit);
+	}
+
+	return true;
+}
+
+bool vx_flatmap_remove(struct vx_flatmap *map, const void *key)
+{
+	size_t index = vx_flatmap_index(map, key);
+	if (index == SIZE_MAX) {
+		return false;
+	}
+
+	vx_shift_(&map->keys, index + 1, -1);
+	if (map->values) {
+		vx_shift_(&map->values, index + 1, -1);
+	}
+
+	return true;
+}
+
+// Stable bottom-up merge sort of the indices 'order' by the keys they refer
+// to, using 'temp' as scratch space. qsort() can neither be told to keep equal
+// keys in order, which is needed to keep the last value of repeated keys, nor
+// sort one array by the contents of another.
+static void vx_flatmap_sort(size_t              *order,
+                            size_t              *temp,
+                            size_t               count,
+                            const unsigned char *keys,
+                            size_t               unit,
+                            int (*cmp)(const void *, const void *))
+{
+	size_t *src  = order;
+	size_t *dest = temp;
+
+	for (size_t width = 1; width < count; width *= 2) {
+		for (size_t lo = 0; lo < count; lo += 2 * width) {
+			size_t mid = lo + width < count ? lo + width : count;
+			size_t hi  = mid + width < count ? mid + width : count;
+			size_t i = lo, j = mid, k = lo;
+
+			while (i < mid && j < hi) {
+				const void *left  = keys + unit * src[i];
+				const void *right = keys + unit * src[j];
+				if (cmp(right, left) < 0) {
+					dest[k++] = src[j++];
+				} else {
+					dest[k++] = src[i++];
+				}
+			}
+			while (i < mid) {
+				dest[k++] = src[i++];
+			}
+			while (j < hi) {
+				dest[k++] = src[j++];
+			}
+		}
+
+		size_t *swap = src;
+		src          = dest;
+		dest         = swap;
+	}
+
+	if (src != order) {
+		memcpy(order, src, count * sizeof(size_t));
+	}
+}
+
+// Creates new vectors holding the keys and values of the arrays, sorted and
+// without repeated keys.
+static bool vx_flatmap_sorted(const struct vx_flatmap *map,
+                              const unsigned char     *keys,
+                              const unsigned char     *values,
+                              size_t                   count,
+                              void                   **keys_p,
+                              void                   **values_p)
+{
+	size_t unit       = vx_tag_unit(vx_tag(map->keys));
+	size_t value_unit = map->values ? vx_tag_unit(vx_tag(map->values)) : 0;
+
+	size_t *order = (size_t *)malloc(2 * count * sizeof(size_t) + 1);
+	if (!order) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error allocating flat map batch.\n");
+#endif
+		return false;
+	}
+
+	*keys_p   = vx_new_(unit, count, NULL);
+	*values_p = value_unit ? vx_new_(value_unit, count, NULL) : NULL;
+	if (!*keys_p || (value_unit && !*values_p)) {
+		vx_free_(keys_p);
+		vx_free_(values_p);
+		free(order);
+		return false;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		order[i] = i;
+	}
+	vx_flatmap_sort(order, order + count, count, keys, unit, map->cmp);
+
+	// Equal keys are adjacent and in their original order, so each
+	// overwrites the one before it, and the last value wins.
+
+	unsigned char *dest_keys   = (unsigned char *)*keys_p;
+	unsigned char *dest_values = (unsigned char *)*values_p;
+	size_t         n           = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		const unsigned char *key = keys + unit * order[i];
+		if (!n || map->cmp(dest_keys + unit * (n - 1), key)) {
+			n++;
+		}
+		memcpy(dest_keys + unit * (n - 1), key, unit);
+		if (value_unit) {
+			memcpy(dest_values + value_unit * (n - 1),
+			       values + value_unit * order[i],
+			       value_unit);
+		}
+	}
+
+	free(order);
+
+	vx_tag_set_count(vx_tag(*keys_p), n);
+	if (value_unit) {
+		vx_tag_set_count(vx_tag(*values_p), n);
+	}
+
+	return true;
+}
+
+bool vx_flatmap_build(struct vx_flatmap *map,
+                      const void        *keys,
+                      const void        *values,
+                      size_t             count)
+{
+	void *sorted_keys, *sorted_values;
+
+	if (!vx_flatmap_sorted(map,
+	                       (const unsigned char *)keys,
+	                       (const unsigned char *)values,
+	                       count,
+	                       &sorted_keys,
+	                       &sorted_values)) {
+		return false;
+	}
+
+	vx_flatmap_free(map);
+	map->keys   = sorted_keys;
+	map->values = sorted_values;
+
+	return true;
+}
+
+bool vx_flatmap_merge(struct vx_flatmap *map,
+                      const void        *keys,
+                      const void        *values,
+                      size_t             count)
+{
+	void *batch_keys, *batch_values;
+
+	if (!vx_flatmap_sorted(map,
+	                       (const unsigned char *)keys,
+	                       (const unsigned char *)values,
+	                       count,
+	                       &batch_keys,
+	                       &batch_values)) {
+		return false;
+	}
+
+	size_t n = vx_tag_count(vx_tag(map->keys));
+	size_t m = vx_tag_count(vx_tag(batch_keys));
+
+	if (!vx_flatmap_reserve(map, n + m)) {
+		vx_free_(&batch_keys);
+		vx_free_(&batch_values);
+		return false;
+	}
+
+	size_t unit       = vx_tag_unit(vx_tag(map->keys));
+	size_t value_unit = map->values ? vx_tag_unit(vx_tag(map->values)) : 0;
+
+	unsigned char *dest_keys   = (unsigned char *)map->keys;
+	unsigned char *dest_values = (unsigned char *)map->values;
+	unsigned char *src_keys    = (unsigned char *)batch_keys;
+	unsigned char *src_values  = (unsigned char *)batch_values;
+
+	// Merging from the back writes each key into space past the end of
+	// those not yet merged, so the existing keys need no room made for
+	// them. Once the batch runs out, the keys left at the front are already
+	// in place, and the merged keys are moved down over any gap left by
+	// keys present in both.
+
+	size_t i = n, j = m, w = n + m, repeats = 0;
+
+	while (j) {
+		int order = i ? map->cmp(dest_keys + unit * (i - 1),
+		                         src_keys + unit * (j - 1))
+		              : -1;
+		w--;
+		if (order > 0) {
+			i--;
+			memcpy(dest_keys + unit * w,
+			       dest_keys + unit * i,
+			       unit);
+			if (value_unit) {
+				memcpy(dest_values + value_unit * w,
+				       dest_values + value_unit * i,
+				       value_unit);
+			}
+		} else {
+			if (!order) {
+				i--;
+				repeats++;
+			}
+			j--;
+			memcpy(dest_keys + unit * w,
+			       src_keys + unit * j,
+			       unit);
+			if (value_unit) {
+				memcpy(dest_values + value_unit * w,
+				       src_values + value_unit * j,
+				       value_unit);
+			}
+		}
+	}
+
+	if (repeats) {
+		memmove(dest_keys + unit * i,
+		        dest_keys + unit * w,
+		        unit * (n + m - w));
+		if (value_unit) {
+			memmove(dest_values + value_unit * i,
+			        dest_values + value_unit * w,
+			        value_unit * (n + m - w));
+		}
+	}
+
+	vx_tag_set_count(vx_tag(map->keys), n + m - repeats);
+	if (value_unit) {
+		vx_tag_set_count(vx_tag(map->values), n + m - repeats);
+	}
+
+	vx_free_(&batch_keys);
+	vx_free_(&batch_values);
+
+	return true;
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
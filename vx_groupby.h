@@ -0,0 +1,615 @@
+// vx_groupby.h - hash group-by and aggregation for vx.h
+// http://github.com/auul/vx.h
+//
+// License: Public Domain (www.unlicense.org); see vx.h
+// ==========================================
+//
+// Linking:
+//      Include this header in place of vx.h, which it includes. The
+//      implementation is compiled along with that of vx.h, in the ONE .c file
+//      which defines VX_IMPLEMENT.
+//
+// Usage:
+//      A group-by takes a vector of keys and a parallel vector of values, and
+//      aggregates the values of each distinct key. Keys may be of any type,
+//      and are hashed and compared bytewise, as vx_find() compares them.
+//
+//      Each key is looked up in an open-addressing hash table, whose slots
+//      hold the hash alongside the group, so that probing rarely touches the
+//      keys themselves. The table grows with the number of groups, so stays
+//      in cache while they are few. Once there are more groups than
+//      VX_GROUPBY_PARTITION (32768), the rows are instead partitioned by the
+//      high bits of their hashes, one partition for each VX_GROUPBY_PARTITION
+//      rows, and each partition is grouped with its own table. As no group
+//      spans two partitions, partitions are grouped and aggregated
+//      independently, across threads when compiled with OpenMP. Groups are
+//      numbered by partition, and within each partition in order of first
+//      appearance; without partitioning, this is the order of first
+//      appearance.
+//
+// API:
+// ====
+// bool vx_groupby_T(struct vx_groupby *out, const void *keys,
+//                   const TYPE *values, unsigned aggs)
+// bool vx_groupby_parallel_T(struct vx_groupby *out, const void *keys,
+//                            const TYPE *values, unsigned aggs)
+//      Groups the vector 'values' by the parallel vector 'keys', of the same
+//      count, where T is one of i32, u32, i64, u64 or f64 for values of
+//      int32_t, uint32_t, int64_t, uint64_t or double. 'aggs' selects the
+//      aggregates to compute, as a combination of VX_AGG_COUNT, VX_AGG_SUM,
+//      VX_AGG_MIN and VX_AGG_MAX. Sets the members of 'out' to new vectors,
+//      with one unit per group:
+//              'keys'   the key of each group
+//              'counts' the number of rows of each group, as uint64_t
+//              'sums'   the sum of each group, as int64_t for signed values,
+//                       uint64_t for unsigned values, or double
+//              'mins'   the least value of each group, as TYPE
+//              'maxs'   the greatest value of each group, as TYPE
+//      Aggregates not selected are left NULL. When compiled with OpenMP,
+//      vx_groupby_parallel_T() always partitions the rows, and groups and
+//      aggregates the partitions across threads; otherwise it is equivalent
+//      to vx_groupby_T(). Returns a bool indicating success or failure, in
+//      which case every member of 'out' is NULL. At most UINT32_MAX rows may
+//      be grouped at once.
+// void vx_groupby_free(struct vx_groupby *out)
+//      Frees the vectors of 'out'.
+
+#ifndef VX_GROUPBY_H
+#define VX_GROUPBY_H
+
+#include "vx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef VX_GROUPBY_PARTITION
+#define VX_GROUPBY_PARTITION 32768
+#endif
+
+#define VX_AGG_COUNT 1
+#define VX_AGG_SUM 2
+#define VX_AGG_MIN 4
+#define VX_AGG_MAX 8
+
+struct vx_groupby {
+	void     *keys;
+	uint64_t *counts;
+	void     *sums;
+	void     *mins;
+	void     *maxs;
+};
+
+#define VX_GROUPBY_PROTOTYPES_(suffix, type)                                   \
+	bool vx_groupby_##suffix(struct vx_groupby *out,                       \
+	                         const void        *keys,                      \
+	                         const type        *values,                    \
+	                         unsigned           aggs);                     \
+	bool vx_groupby_parallel_##suffix(struct vx_groupby *out,              \
+	                                  const void        *keys,             \
+	                                  const type        *values,           \
+	                                  unsigned           aggs);
+
+VX_GROUPBY_PROTOTYPES_(i32, int32_t)
+VX_GROUPBY_PROTOTYPES_(u32, uint32_t)
+VX_GROUPBY_PROTOTYPES_(i64, int64_t)
+VX_GROUPBY_PROTOTYPES_(u64, uint64_t)
+VX_GROUPBY_PROTOTYPES_(f64, double)
+
+void vx_groupby_free(struct vx_groupby *out);
+
+#ifdef VX_IMPLEMENT
+
+#define VX_GROUPBY_MAX_PARTS 4096
+
+// The rows of partition 'p' are order[starts[p]] to order[starts[p + 1] - 1],
+// in increasing order, and its groups are numbered from bases[p]. The first
+// row of group 'g' is firsts[g]. Without partitioning, 'order' is NULL and
+// the single partition holds every row in turn.
+struct vx_groupby_plan {
+	size_t    count;
+	size_t    parts;
+	size_t    groups;
+	uint32_t *ids;
+	uint32_t *order;
+	uint32_t *firsts;
+	size_t   *starts;
+	size_t   *bases;
+};
+
+struct vx_groupby_slot {
+	uint64_t hash;
+	uint32_t row;
+	uint32_t group;
+};
+
+static void vx_groupby_plan_free(struct vx_groupby_plan *plan)
+{
+	free(plan->ids);
+	free(plan->order);
+	free(plan->firsts);
+	free(plan->starts);
+	free(plan->bases);
+}
+
+// Doubles the size of the table, moving each group to its slot in the new one
+// by its hash alone, as the groups are known to be distinct.
+static struct vx_groupby_slot *
+vx_groupby_grow(struct vx_groupby_slot *slots, size_t *size)
+{
+	size_t mask = 2 * *size - 1;
+	struct vx_groupby_slot *grown = (struct vx_groupby_slot *)calloc(
+	    2 * *size, sizeof(struct vx_groupby_slot));
+
+	if (grown) {
+		for (size_t j = 0; j < *size; j++) {
+			if (!slots[j].row) {
+				continue;
+			}
+			size_t i = (size_t)slots[j].hash & mask;
+			while (grown[i].row) {
+				i = (i + 1) & mask;
+			}
+			grown[i] = slots[j];
+		}
+		*size *= 2;
+	}
+
+	free(slots);
+
+	return grown;
+}
+
+// Groups the rows of partition 'p', numbering its groups from 0 in 'ids',
+// and recording the first row of each in 'firsts', from starts[p] on. The
+// table starts small and grows with the groups, so that it stays in cache
+// while they are few. Returns the number of groups, SIZE_MAX if the table
+// cannot be allocated, or 'limit' + 1 once there are more than 'limit'.
+static size_t vx_groupby_part(struct vx_groupby_plan *plan,
+                              const unsigned char    *keys,
+                              size_t                  unit,
+                              const uint64_t         *hashes,
+                              size_t                  p,
+                              size_t                  limit)
+{
+	size_t size   = 64;
+	size_t groups = 0;
+
+	struct vx_groupby_slot *slots = (struct vx_groupby_slot *)calloc(
+	    size, sizeof(struct vx_groupby_slot));
+
+	for (size_t j = plan->starts[p]; slots && j < plan->starts[p + 1];
+	     j++) {
+		size_t               row  = plan->order ? plan->order[j] : j;
+		const unsigned char *key  = keys + unit * row;
+		uint64_t             hash = hashes[row];
+		size_t               mask = size - 1;
+		size_t               i    = (size_t)hash & mask;
+
+		for (; slots[i].row; i = (i + 1) & mask) {
+			const unsigned char *first =
+			    keys + unit * (slots[i].row - 1);
+			if (slots[i].hash == hash
+			    && vx_unit_equal(first, key, unit)) {
+				break;
+			}
+		}
+
+		if (!slots[i].row) {
+			if (groups == limit) {
+				free(slots);
+				return limit + 1;
+			}
+
+			slots[i].hash  = hash;
+			slots[i].row   = (uint32_t)row + 1;
+			slots[i].group = (uint32_t)groups;
+
+			plan->firsts[plan->starts[p] + groups] = (uint32_t)row;
+			groups++;
+		}
+		plan->ids[row] = slots[i].group;
+
+		// The table is kept at most two thirds full.
+
+		if (3 * groups > 2 * size) {
+			slots = vx_groupby_grow(slots, &size);
+		}
+	}
+
+	if (!slots) {
+		return SIZE_MAX;
+	}
+	free(slots);
+
+	return groups;
+}
+
+// Returns the partition of 'hash' among 2^'bits', taken from its high bits;
+// the table slot is taken from the low bits.
+static size_t vx_groupby_part_of(uint64_t hash, unsigned bits)
+{
+	return bits ? (size_t)(hash >> (64 - bits)) : 0;
+}
+
+// Splits the rows into 2^'bits' partitions, replacing any split before.
+static bool vx_groupby_split(struct vx_groupby_plan *plan,
+                             const uint64_t         *hashes,
+                             unsigned                bits)
+{
+	size_t count = plan->count;
+
+	free(plan->order);
+	free(plan->starts);
+	free(plan->bases);
+
+	plan->parts  = (size_t)1 << bits;
+	plan->order  = NULL;
+	plan->starts = (size_t *)calloc(plan->parts + 1, sizeof(size_t));
+	plan->bases  = (size_t *)calloc(plan->parts + 1, sizeof(size_t));
+	if (bits) {
+		plan->order = (uint32_t *)malloc(count * sizeof(uint32_t));
+	}
+
+	if (!plan->starts || !plan->bases || (bits && !plan->order)) {
+		return false;
+	}
+
+	if (!bits) {
+		plan->starts[1] = count;
+		return true;
+	}
+
+	// Rows are bucketed by partition in increasing order, so that groups
+	// are still numbered by first appearance within each partition.
+
+	for (size_t i = 0; i < count; i++) {
+		plan->starts[vx_groupby_part_of(hashes[i], bits) + 1]++;
+	}
+	for (size_t p = 0; p < plan->parts; p++) {
+		plan->starts[p + 1] += plan->starts[p];
+	}
+	for (size_t i = 0; i < count; i++) {
+		size_t p = vx_groupby_part_of(hashes[i], bits);
+		plan->order[plan->starts[p]++] = (uint32_t)i;
+	}
+	for (size_t p = plan->parts; p > 0; p--) {
+		plan->starts[p] = plan->starts[p - 1];
+	}
+	plan->starts[0] = 0;
+
+	return true;
+}
+
+// Groups each partition, with at most 'limit' groups in any, and numbers the
+// groups of all partitions in turn. Returns 1 on success, 0 on failure, or -1
+// if a partition has more than 'limit' groups.
+static int vx_groupby_group(struct vx_groupby_plan *plan,
+                            const unsigned char    *keys,
+                            size_t                  unit,
+                            const uint64_t         *hashes,
+                            size_t                  limit,
+                            bool                    parallel)
+{
+	// Each partition counts its groups into bases[p + 1], which are then
+	// summed into the number of the first group of each partition.
+
+	int failed = 0;
+	int over   = 0;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1) if (parallel)
+#else
+	(void)parallel;
+#endif
+	for (ptrdiff_t p = 0; p < (ptrdiff_t)plan->parts; p++) {
+		size_t groups =
+		    vx_groupby_part(plan, keys, unit, hashes, p, limit);
+		if (groups == SIZE_MAX) {
+#ifdef _OPENMP
+#pragma omp atomic write
+#endif
+			failed = 1;
+		} else if (groups > limit) {
+#ifdef _OPENMP
+#pragma omp atomic write
+#endif
+			over = 1;
+		} else {
+			plan->bases[p + 1] = groups;
+		}
+	}
+
+	if (failed || over) {
+		return failed ? 0 : -1;
+	}
+
+	// The first rows of each partition's groups are moved down to follow
+	// those of the partitions before it.
+
+	for (size_t p = 0; p < plan->parts; p++) {
+		size_t groups = plan->bases[p + 1];
+
+		plan->bases[p + 1] = plan->bases[p] + groups;
+		memmove(plan->firsts + plan->bases[p],
+		        plan->firsts + plan->starts[p],
+		        groups * sizeof(uint32_t));
+	}
+	plan->groups = plan->bases[plan->parts];
+
+	return 1;
+}
+
+// Groups the rows by key. Unless partitions are wanted for threads, the rows
+// are first grouped with a single table, which is abandoned for partitioning
+// once it holds more than VX_GROUPBY_PARTITION groups, in which case there is
+// a partition for each VX_GROUPBY_PARTITION rows.
+static bool vx_groupby_plan(struct vx_groupby_plan *plan,
+                            const void             *keys,
+                            size_t                  count,
+                            bool                    parallel)
+{
+	const unsigned char *data = (const unsigned char *)keys;
+	size_t               unit = vx_tag_unit(vx_tag(keys));
+	size_t               rows = count ? count : 1;
+
+#ifdef _OPENMP
+	size_t min_parts = parallel ? 4 * (size_t)omp_get_max_threads() : 1;
+#else
+	size_t min_parts = 1;
+#endif
+
+	memset(plan, 0, sizeof(*plan));
+	plan->count = count;
+
+	uint64_t *hashes = (uint64_t *)malloc(rows * sizeof(uint64_t));
+
+	plan->ids    = (uint32_t *)malloc(rows * sizeof(uint32_t));
+	plan->firsts = (uint32_t *)malloc(rows * sizeof(uint32_t));
+
+	bool ok = hashes && plan->ids && plan->firsts;
+
+	if (ok) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if (parallel)
+#endif
+		for (ptrdiff_t i = 0; i < (ptrdiff_t)count; i++) {
+			hashes[i] = vx_hash_unit(data + unit * i, unit);
+		}
+	}
+
+	int result = -1;
+
+	if (ok && min_parts == 1) {
+		ok     = vx_groupby_split(plan, hashes, 0);
+		result = ok ? vx_groupby_group(plan,
+		                               data,
+		                               unit,
+		                               hashes,
+		                               VX_GROUPBY_PARTITION,
+		                               parallel)
+		            : 0;
+	}
+
+	if (ok && result < 0) {
+		unsigned bits = 0;
+		for (size_t parts = 1; parts < VX_GROUPBY_MAX_PARTS
+		                       && (parts * VX_GROUPBY_PARTITION < count
+		                           || parts < min_parts);
+		     parts *= 2) {
+			bits++;
+		}
+
+		ok     = vx_groupby_split(plan, hashes, bits);
+		result = ok ? vx_groupby_group(plan,
+		                               data,
+		                               unit,
+		                               hashes,
+		                               SIZE_MAX - 1,
+		                               parallel)
+		            : 0;
+	}
+
+	free(hashes);
+
+	if (!ok || result != 1) {
+		vx_groupby_plan_free(plan);
+		return false;
+	}
+
+	return true;
+}
+
+void vx_groupby_free(struct vx_groupby *out)
+{
+	vx_free_(&out->keys);
+	vx_free_((void **)&out->counts);
+	vx_free_(&out->sums);
+	vx_free_(&out->mins);
+	vx_free_(&out->maxs);
+}
+
+// Allocates the selected outputs of 'out' for the groups of 'plan', filling
+// in the keys, and the minima and maxima with the first value of each group.
+static bool vx_groupby_outputs(struct vx_groupby            *out,
+                               const struct vx_groupby_plan *plan,
+                               const void                   *keys,
+                               const void                   *values,
+                               size_t                        sum_unit,
+                               unsigned                      aggs)
+{
+	size_t groups     = plan->groups;
+	size_t unit       = vx_tag_unit(vx_tag(keys));
+	size_t value_unit = vx_tag_unit(vx_tag(values));
+
+	out->keys = vx_new_(unit, groups, NULL);
+	if (aggs & VX_AGG_COUNT) {
+		out->counts =
+		    (uint64_t *)vx_new_(sizeof(uint64_t), groups, NULL);
+	}
+	if (aggs & VX_AGG_SUM) {
+		out->sums = vx_new_(sum_unit, groups, NULL);
+	}
+	if (aggs & VX_AGG_MIN) {
+		out->mins = vx_new_(value_unit, groups, NULL);
+	}
+	if (aggs & VX_AGG_MAX) {
+		out->maxs = vx_new_(value_unit, groups, NULL);
+	}
+
+	if (!out->keys || (aggs & VX_AGG_COUNT && !out->counts)
+	    || (aggs & VX_AGG_SUM && !out->sums)
+	    || (aggs & VX_AGG_MIN && !out->mins)
+	    || (aggs & VX_AGG_MAX && !out->maxs)) {
+		vx_groupby_free(out);
+		return false;
+	}
+
+	for (size_t g = 0; g < groups; g++) {
+		size_t row = plan->firsts[g];
+
+		memcpy((unsigned char *)out->keys + unit * g,
+		       (const unsigned char *)keys + unit * row,
+		       unit);
+		if (out->mins) {
+			memcpy((unsigned char *)out->mins + value_unit * g,
+			       (const unsigned char *)values + value_unit * row,
+			       value_unit);
+		}
+		if (out->maxs) {
+			memcpy((unsigned char *)out->maxs + value_unit * g,
+			       (const unsigned char *)values + value_unit * row,
+			       value_unit);
+		}
+	}
+
+	return true;
+}
+
+// Groups the rows, allocates the outputs, and calls 'aggregate' once for each
+// partition, which touches only the groups of that partition.
+static bool vx_groupby_run(struct vx_groupby *out,
+                           const void        *keys,
+                           const void        *values,
+                           size_t             sum_unit,
+                           unsigned           aggs,
+                           bool               parallel,
+                           void (*aggregate)(struct vx_groupby *,
+                                             const struct vx_groupby_plan *,
+                                             const void *,
+                                             size_t))
+{
+	size_t count = vx_tag_count(vx_tag(keys));
+
+	memset(out, 0, sizeof(*out));
+
+	if (count != vx_tag_count(vx_tag(values)) || count > UINT32_MAX - 1) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error grouping: bad number of rows.\n");
+#endif
+		return false;
+	}
+
+	struct vx_groupby_plan plan;
+
+	if (!vx_groupby_plan(&plan, keys, count, parallel)) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error allocating group-by.\n");
+#endif
+		return false;
+	}
+	if (!vx_groupby_outputs(out, &plan, keys, values, sum_unit, aggs)) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error allocating group-by results.\n");
+#endif
+		vx_groupby_plan_free(&plan);
+		return false;
+	}
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1) if (parallel)
+#endif
+	for (ptrdiff_t p = 0; p < (ptrdiff_t)plan.parts; p++) {
+		aggregate(out, &plan, values, p);
+	}
+
+	vx_groupby_plan_free(&plan);
+
+	return true;
+}
+
+#define VX_GROUPBY_DEFINE_(suffix, type, sum_type)                             \
+	static void vx_groupby_aggregate_##suffix(                             \
+	    struct vx_groupby            *out,                                 \
+	    const struct vx_groupby_plan *plan,                                \
+	    const void                   *values,                              \
+	    size_t                        p)                                   \
+	{                                                                      \
+		const type *vals   = (const type *)values;                     \
+		uint64_t   *counts = out->counts;                              \
+		sum_type   *sums   = (sum_type *)out->sums;                    \
+		type       *mins   = (type *)out->mins;                        \
+		type       *maxs   = (type *)out->maxs;                        \
+                                                                               \
+		for (size_t j = plan->starts[p]; j < plan->starts[p + 1];      \
+		     j++) {                                                    \
+			size_t row = plan->order ? plan->order[j] : j;         \
+			size_t g   = plan->bases[p] + plan->ids[row];          \
+			type   v   = vals[row];                                \
+                                                                               \
+			if (counts) {                                          \
+				counts[g]++;                                   \
+			}                                                      \
+			if (sums) {                                            \
+				sums[g] += v;                                  \
+			}                                                      \
+			if (mins && v < mins[g]) {                             \
+				mins[g] = v;                                   \
+			}                                                      \
+			if (maxs && v > maxs[g]) {                             \
+				maxs[g] = v;                                   \
+			}                                                      \
+		}                                                              \
+	}                                                                      \
+                                                                               \
+	bool vx_groupby_##suffix(struct vx_groupby *out,                       \
+	                         const void        *keys,                      \
+	                         const type        *values,                    \
+	                         unsigned           aggs)                      \
+	{                                                                      \
+		return vx_groupby_run(out,                                     \
+		                      keys,                                    \
+		                      values,                                  \
+		                      sizeof(sum_type),                        \
+		                      aggs,                                    \
+		                      false,                                   \
+		                      vx_groupby_aggregate_##suffix);          \
+	}                                                                      \
+                                                                               \
+	bool vx_groupby_parallel_##suffix(struct vx_groupby *out,              \
+	                                  const void        *keys,             \
+	                                  const type        *values,           \
+	                                  unsigned           aggs)             \
+	{                                                                      \
+		return vx_groupby_run(out,                                     \
+		                      keys,                                    \
+		                      values,                                  \
+		                      sizeof(sum_type),                        \
+		                      aggs,                                    \
+		                      true,                                    \
+		                      vx_groupby_aggregate_##suffix);          \
+	}
+
+VX_GROUPBY_DEFINE_(i32, int32_t, int64_t)
+VX_GROUPBY_DEFINE_(u32, uint32_t, uint64_t)
+VX_GROUPBY_DEFINE_(i64, int64_t, int64_t)
+VX_GROUPBY_DEFINE_(u64, uint64_t, uint64_t)
+VX_GROUPBY_DEFINE_(f64, double, double)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1281 @@
+// vx_roaring.h - compressed bitmaps for vx.h
+// http://github.com/auul/vx.h
+//
+// License: Public Domain (www.unlicense.org); see vx.h
+// ==========================================
+//
+// Linking:
+//      Include this header in place of vx.h, which it includes along with
+//      vx_bits.h. The implementation is compiled along with that of vx.h, in
+//      the ONE .c file which defines VX_IMPLEMENT.
+//
+// Usage:
+//      A compressed bitmap holds a set of 32-bit unsigned integers, such as
+//      row ids, split by their high 16 bits into chunks of up to 65536 ids.
+//      The vector 'roaring.chunks' holds a struct vx_roaring_chunk for each
+//      non-empty chunk, in ascending order of 'key', the high bits shared by
+//      its ids. The low bits of its 'count' ids are held in the vector 'data'
+//      in one of three kinds of container:
+//
+//      VX_ROARING_ARRAY    a vector of uint16_t, in strictly ascending order
+//      VX_ROARING_BITMAP   a vector of 1024 uint64_t words, laid out as in
+//                          vx_bits.h
+//      VX_ROARING_RUN      a vector of struct vx_roaring_run, each holding
+//                          the 'start' and 'last' of a range of ids, in
+//                          ascending order
+//
+//      The chunks built by each function below are held in whichever
+//      container is smallest: an array while the chunk holds at most
+//      VX_ROARING_ARRAY_MAX (4096) ids, a bitmap beyond that, and runs
+//      wherever four bytes a range take less than either. Adding and
+//      removing single ids only switches between arrays and bitmaps, so
+//      chunks may be compacted into runs after a series of them with
+//      vx_roaring_optimize().
+//
+//      Intersections and unions combine the chunks present in both inputs
+//      by the kinds of their containers. Arrays are merged, intersections
+//      comparing blocks of eight ids at a time (at VX_SIMD_SSE42 and above),
+//      or the ids of the smaller are searched for in the larger where it is
+//      more than VX_GALLOP_RATIO (32) times the size (see Set operations in
+//      vx.h). The ids of an array are looked up directly in bitmaps and
+//      runs. Runs are merged range by range, and anything else is combined
+//      as bitmaps, a word at a time, with the AVX2 kernels of vx_bits.h
+//      where available.
+//
+//      Compressed bitmaps are stored in files as a series of vectors in the
+//      binary format of vx_write() (see Files in vx.h): first a vector of
+//      uint64_t holding the key, kind and count of each chunk, in bits 0-15,
+//      16-31 and 32-63, then the container of each chunk in turn.
+//
+// API:
+// ====
+// bool vx_roaring_init(struct vx_roaring *roaring)
+//      Initializes 'roaring' as an empty set. Returns a bool indicating
+//      success or failure.
+// void vx_roaring_free(struct vx_roaring *roaring)
+//      Frees the chunks of 'roaring'.
+// size_t vx_roaring_count(const struct vx_roaring *roaring)
+//      Returns the number of ids in 'roaring'.
+// bool vx_roaring_contains(const struct vx_roaring *roaring, uint32_t id)
+//      Returns whether 'id' is in 'roaring'.
+// bool vx_roaring_add(struct vx_roaring *roaring, uint32_t id)
+// bool vx_roaring_remove(struct vx_roaring *roaring, uint32_t id)
+//      Add 'id' to, or remove it from, 'roaring'. Return a bool indicating
+//      success or failure.
+// bool vx_roaring_optimize(struct vx_roaring *roaring)
+//      Moves each chunk of 'roaring' into its smallest kind of container.
+//      Returns a bool indicating success or failure.
+// bool vx_roaring_from_u32(struct vx_roaring *roaring, const uint32_t *ids)
+//      Replaces the contents of 'roaring' with the ids of the vector 'ids',
+//      sorted in strictly ascending order. Returns a bool indicating success
+//      or failure.
+// bool vx_roaring_to_u32(uint32_t **out_p, const struct vx_roaring *roaring)
+//      Replaces the contents of the vector '*out_p' with the ids of
+//      'roaring', in ascending order, growing it as needed. Returns a bool
+//      indicating success or failure.
+// bool vx_roaring_and(struct vx_roaring *out, const struct vx_roaring *a,
+//                     const struct vx_roaring *b)
+// bool vx_roaring_or(struct vx_roaring *out, const struct vx_roaring *a,
+//                    const struct vx_roaring *b)
+//      Replace the contents of 'out', which must not be one of the inputs,
+//      with the ids present in both 'a' and 'b', or in either. Return a bool
+//      indicating success or failure.
+// bool vx_roaring_write(const struct vx_roaring *roaring, FILE *file)
+//      Writes 'roaring' to 'file'. Returns a bool indicating success or
+//      failure.
+// bool vx_roaring_read(struct vx_roaring *roaring, FILE *file)
+//      Initializes 'roaring' from a compressed bitmap written to 'file' by
+//      vx_roaring_write(), checking that each chunk is well formed. Returns a
+//      bool indicating success or failure.
+
+#ifndef VX_ROARING_H
+#define VX_ROARING_H
+
+#include "vx_bits.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef VX_ROARING_ARRAY_MAX
+#define VX_ROARING_ARRAY_MAX 4096
+#endif
+
+enum vx_roaring_kind {
+	VX_ROARING_ARRAY,
+	VX_ROARING_BITMAP,
+	VX_ROARING_RUN,
+};
+
+struct vx_roaring_run {
+	uint16_t start;
+	uint16_t last;
+};
+
+struct vx_roaring_chunk {
+	uint16_t key;
+	uint16_t kind;
+	uint32_t count;
+	void    *data;
+};
+
+struct vx_roaring {
+	struct vx_roaring_chunk *chunks;
+};
+
+bool   vx_roaring_init(struct vx_roaring *roaring);
+void   vx_roaring_free(struct vx_roaring *roaring);
+size_t vx_roaring_count(const struct vx_roaring *roaring);
+bool   vx_roaring_contains(const struct vx_roaring *roaring, uint32_t id);
+bool   vx_roaring_add(struct vx_roaring *roaring, uint32_t id);
+bool   vx_roaring_remove(struct vx_roaring *roaring, uint32_t id);
+bool   vx_roaring_optimize(struct vx_roaring *roaring);
+bool   vx_roaring_from_u32(struct vx_roaring *roaring, const uint32_t *ids);
+bool   vx_roaring_to_u32(uint32_t **out_p, const struct vx_roaring *roaring);
+bool   vx_roaring_and(struct vx_roaring       *out,
+                      const struct vx_roaring *a,
+                      const struct vx_roaring *b);
+bool   vx_roaring_or(struct vx_roaring       *out,
+                     const struct vx_roaring *a,
+                     const struct vx_roaring *b);
+bool   vx_roaring_write(const struct vx_roaring *roaring, FILE *file);
+bool   vx_roaring_read(struct vx_roaring *roaring, FILE *file);
+
+#ifdef VX_IMPLEMENT
+
+#define VX_ROARING_IDS 65536
+#define VX_ROARING_WORDS (VX_ROARING_IDS / 64)
+
+// Chunks
+// ======
+
+static void vx_roaring_chunk_free(void *unit)
+{
+	struct vx_roaring_chunk *chunk = (struct vx_roaring_chunk *)unit;
+
+	vx_free(chunk->data);
+}
+
+// Returns the index of the first chunk of 'roaring' whose key is not less
+// than 'key'.
+static size_t vx_roaring_find(const struct vx_roaring *roaring, uint16_t key)
+{
+	size_t lo = 0;
+	size_t hi = vx_tag_count(vx_tag(roaring->chunks));
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (roaring->chunks[mid].key < key) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+// Returns the index of the first of the 'count' values which is not less
+// than 'value'.
+static size_t
+vx_roaring_lower(const uint16_t *values, size_t count, uint16_t value)
+{
+	size_t lo = 0;
+	size_t hi = count;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (values[mid] < value) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+static bool vx_roaring_chunk_contains(const struct vx_roaring_chunk *chunk,
+                                      uint16_t                       value)
+{
+	switch (chunk->kind) {
+	case VX_ROARING_ARRAY: {
+		const uint16_t *values = (const uint16_t *)chunk->data;
+		size_t          n      = chunk->count;
+		size_t          i      = vx_roaring_lower(values, n, value);
+
+		return i < n && values[i] == value;
+	}
+	case VX_ROARING_BITMAP: {
+		const uint64_t *words = (const uint64_t *)chunk->data;
+
+		return (words[value / 64] >> (value % 64)) & 1;
+	}
+	default: {
+		const struct vx_roaring_run *runs =
+		    (const struct vx_roaring_run *)chunk->data;
+		size_t lo = 0;
+		size_t hi = vx_tag_count(vx_tag(runs));
+
+		// Finds the first run starting after 'value', so that it can
+		// only lie in the run before.
+
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			if (runs[mid].start <= value) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+
+		return lo && value <= runs[lo - 1].last;
+	}
+	}
+}
+
+// Sets the bits of 'words' from 'start' to 'last', inclusive.
+static void vx_roaring_fill(uint64_t *words, unsigned start, unsigned last)
+{
+	size_t   first = start / 64;
+	size_t   end   = last / 64;
+	uint64_t head  = ~(uint64_t)0 << (start % 64);
+	uint64_t tail  = ~(uint64_t)0 >> (63 - last % 64);
+
+	if (first == end) {
+		words[first] |= head & tail;
+		return;
+	}
+
+	words[first] |= head;
+	for (size_t i = first + 1; i < end; i++) {
+		words[i] = ~(uint64_t)0;
+	}
+	words[end] |= tail;
+}
+
+// Sets the bits of the bitmap 'words' for the values of 'chunk'.
+static void vx_roaring_or_into(uint64_t                      *words,
+                               const struct vx_roaring_chunk *chunk)
+{
+	switch (chunk->kind) {
+	case VX_ROARING_ARRAY: {
+		const uint16_t *values = (const uint16_t *)chunk->data;
+
+		for (size_t i = 0; i < chunk->count; i++) {
+			uint16_t v = values[i];
+			words[v / 64] |= (uint64_t)1 << (v % 64);
+		}
+		break;
+	}
+	case VX_ROARING_BITMAP: {
+		struct vx_bits dest = {words, VX_ROARING_IDS};
+		struct vx_bits src  = {(uint64_t *)chunk->data, VX_ROARING_IDS};
+
+		vx_bits_or(&dest, &src);
+		break;
+	}
+	default: {
+		const struct vx_roaring_run *runs =
+		    (const struct vx_roaring_run *)chunk->data;
+		size_t n = vx_tag_count(vx_tag(runs));
+
+		for (size_t i = 0; i < n; i++) {
+			vx_roaring_fill(words, runs[i].start, runs[i].last);
+		}
+		break;
+	}
+	}
+}
+
+// Returns a new bitmap of the values of 'chunk', or NULL on failure.
+static uint64_t *vx_roaring_bitmap(const struct vx_roaring_chunk *chunk)
+{
+	uint64_t *words = vx_new(uint64_t, VX_ROARING_WORDS, NULL);
+
+	if (words) {
+		vx_roaring_or_into(words, chunk);
+	}
+
+	return words;
+}
+
+// Returns the first value from 'from' on whose bit in 'words' differs from
+// that of 'flip', i.e. the next set bit for 0 and the next clear bit for ~0,
+// or VX_ROARING_IDS if there is none.
+static unsigned
+vx_roaring_next(const uint64_t *words, unsigned from, uint64_t flip)
+{
+	if (from >= VX_ROARING_IDS) {
+		return VX_ROARING_IDS;
+	}
+
+	size_t   i    = from / 64;
+	uint64_t word = (words[i] ^ flip) & (~(uint64_t)0 << (from % 64));
+
+	while (!word) {
+		if (++i == VX_ROARING_WORDS) {
+			return VX_ROARING_IDS;
+		}
+		word = words[i] ^ flip;
+	}
+
+	return 64 * (unsigned)i + vx_bits_ctz(word);
+}
+
+// Returns the number of runs of consecutive values in 'chunk', counting no
+// further once it reaches 'limit'.
+static size_t vx_roaring_runs(const struct vx_roaring_chunk *chunk,
+                              size_t                         limit)
+{
+	size_t runs = 0;
+
+	switch (chunk->kind) {
+	case VX_ROARING_ARRAY: {
+		const uint16_t *values = (const uint16_t *)chunk->data;
+
+		for (size_t i = 0; i < chunk->count && runs < limit; i++) {
+			runs += !i || values[i] != values[i - 1] + 1;
+		}
+		break;
+	}
+	case VX_ROARING_BITMAP: {
+		const uint64_t *words = (const uint64_t *)chunk->data;
+		uint64_t        carry = 0;
+
+		// A run starts at each set bit whose predecessor is clear.
+
+		for (size_t i = 0; i < VX_ROARING_WORDS && runs < limit; i++) {
+			runs += vx_bits_popcount64(words[i]
+			                           & ~(words[i] << 1 | carry));
+			carry = words[i] >> 63;
+		}
+		break;
+	}
+	default:
+		runs = vx_tag_count(vx_tag(chunk->data));
+		break;
+	}
+
+	return runs;
+}
+
+// Moves 'chunk' into a container of 'kind', by way of a bitmap where it is
+// not one already. On failure, 'chunk' is left as it was.
+static bool vx_roaring_convert(struct vx_roaring_chunk *chunk,
+                               enum vx_roaring_kind     kind)
+{
+	if (chunk->kind == kind) {
+		return true;
+	}
+
+	uint64_t *words = chunk->kind == VX_ROARING_BITMAP
+	                    ? (uint64_t *)chunk->data
+	                    : vx_roaring_bitmap(chunk);
+	void     *data  = words;
+
+	if (words && kind == VX_ROARING_ARRAY) {
+		uint16_t *values = vx_new(uint16_t, chunk->count, NULL);
+		size_t    k      = 0;
+
+		for (unsigned i = 0; values && i < VX_ROARING_WORDS; i++) {
+			unsigned base = 64 * i;
+
+			for (uint64_t w = words[i]; w; w &= w - 1) {
+				values[k++] = (uint16_t)(base + vx_bits_ctz(w));
+			}
+		}
+		data = values;
+	} else if (words && kind == VX_ROARING_RUN) {
+		struct vx_roaring_run *runs;
+		size_t                 k = 0;
+
+		runs = vx_new(struct vx_roaring_run,
+		              vx_roaring_runs(chunk, SIZE_MAX),
+		              NULL);
+
+		for (unsigned v = vx_roaring_next(words, 0, 0);
+		     runs && v < VX_ROARING_IDS;) {
+			unsigned end = vx_roaring_next(words, v, ~(uint64_t)0);
+
+			runs[k].start  = (uint16_t)v;
+			runs[k++].last = (uint16_t)(end - 1);
+			v              = vx_roaring_next(words, end, 0);
+		}
+		data = runs;
+	}
+
+	if (words != chunk->data && words != data) {
+		vx_free(words);
+	}
+	if (!data) {
+		return false;
+	}
+
+	vx_free(chunk->data);
+	chunk->data = data;
+	chunk->kind = (uint16_t)kind;
+
+	return true;
+}
+
+// Moves 'chunk' into whichever container is smallest: two bytes a value for
+// an array, 8 KiB for a bitmap, or four bytes a run.
+static bool vx_roaring_settle(struct vx_roaring_chunk *chunk)
+{
+	enum vx_roaring_kind kind  = VX_ROARING_ARRAY;
+	size_t               bytes = 2 * (size_t)chunk->count;
+
+	if (chunk->count > VX_ROARING_ARRAY_MAX) {
+		kind  = VX_ROARING_BITMAP;
+		bytes = 8 * VX_ROARING_WORDS;
+	}
+	if (4 * vx_roaring_runs(chunk, bytes / 4 + 1) < bytes) {
+		kind = VX_ROARING_RUN;
+	}
+
+	return vx_roaring_convert(chunk, kind);
+}
+
+// Settles 'chunk' and appends it to 'roaring', unless it is empty. Its data is
+// freed on failure.
+static bool vx_roaring_push(struct vx_roaring       *roaring,
+                            struct vx_roaring_chunk *chunk)
+{
+	struct vx_tag *tag   = vx_tag(roaring->chunks);
+	size_t         count = vx_tag_count(tag);
+
+	if (!chunk->count) {
+		vx_free(chunk->data);
+		return true;
+	}
+
+	if (!vx_roaring_settle(chunk)
+	    || (count == vx_tag_capacity(tag)
+	        && !vx_expand_((void **)&roaring->chunks, count + 1))
+	    || !vx_append_((void **)&roaring->chunks, chunk, 1)) {
+		vx_free(chunk->data);
+		return false;
+	}
+
+	return true;
+}
+
+// Sets 'chunk' to a copy of 'src'.
+static bool vx_roaring_copy(struct vx_roaring_chunk       *chunk,
+                            const struct vx_roaring_chunk *src)
+{
+	struct vx_tag *tag = vx_tag(src->data);
+
+	*chunk      = *src;
+	chunk->data = vx_new_(vx_tag_unit(tag), vx_tag_count(tag), NULL);
+	if (!chunk->data) {
+		return false;
+	}
+	memcpy(chunk->data, src->data, vx_tag_unit(tag) * vx_tag_count(tag));
+
+	return true;
+}
+
+static void vx_roaring_clear(struct vx_roaring *roaring)
+{
+	struct vx_tag *tag   = vx_tag(roaring->chunks);
+	size_t         count = vx_tag_count(tag);
+
+	for (size_t i = 0; i < count; i++) {
+		vx_free(roaring->chunks[i].data);
+	}
+	vx_tag_set_count(tag, 0);
+}
+
+// Bitmaps
+// =======
+
+bool vx_roaring_init(struct vx_roaring *roaring)
+{
+	roaring->chunks =
+	    vx_new(struct vx_roaring_chunk, 0, vx_roaring_chunk_free);
+
+	return roaring->chunks != NULL;
+}
+
+void vx_roaring_free(struct vx_roaring *roaring)
+{
+	vx_free(roaring->chunks);
+}
+
+size_t vx_roaring_count(const struct vx_roaring *roaring)
+{
+	size_t n     = vx_tag_count(vx_tag(roaring->chunks));
+	size_t total = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		total += roaring->chunks[i].count;
+	}
+
+	return total;
+}
+
+bool vx_roaring_contains(const struct vx_roaring *roaring, uint32_t id)
+{
+	uint16_t key = (uint16_t)(id >> 16);
+	size_t   i   = vx_roaring_find(roaring, key);
+
+	return i < vx_tag_count(vx_tag(roaring->chunks))
+	       && roaring->chunks[i].key == key
+	       && vx_roaring_chunk_contains(&roaring->chunks[i], (uint16_t)id);
+}
+
+bool vx_roaring_add(struct vx_roaring *roaring, uint32_t id)
+{
+	uint16_t       key   = (uint16_t)(id >> 16);
+	uint16_t       low   = (uint16_t)id;
+	size_t         i     = vx_roaring_find(roaring, key);
+	struct vx_tag *tag   = vx_tag(roaring->chunks);
+	size_t         count = vx_tag_count(tag);
+
+	if (i == count || roaring->chunks[i].key != key) {
+		struct vx_roaring_chunk chunk = {
+		    key, VX_ROARING_ARRAY, 1, NULL};
+
+		chunk.data = vx_new(uint16_t, 1, NULL);
+		if (!chunk.data
+		    || (count == vx_tag_capacity(tag)
+		        && !vx_expand_((void **)&roaring->chunks, count + 1))
+		    || !vx_shift_((void **)&roaring->chunks, i, 1)) {
+			vx_free(chunk.data);
+			return false;
+		}
+		*(uint16_t *)chunk.data = low;
+		roaring->chunks[i]      = chunk;
+
+		return true;
+	}
+
+	struct vx_roaring_chunk *chunk = &roaring->chunks[i];
+
+	if (chunk->kind == VX_ROARING_RUN) {
+		if (vx_roaring_chunk_contains(chunk, low)) {
+			return true;
+		}
+		if (!vx_roaring_convert(chunk,
+		                        chunk->count < VX_ROARING_ARRAY_MAX
+		                            ? VX_ROARING_ARRAY
+		                            : VX_ROARING_BITMAP)) {
+			return false;
+		}
+	}
+
+	if (chunk->kind == VX_ROARING_ARRAY) {
+		uint16_t *values = (uint16_t *)chunk->data;
+		size_t    j      = vx_roaring_lower(values, chunk->count, low);
+
+		if (j < chunk->count && values[j] == low) {
+			return true;
+		}
+
+		if (chunk->count < VX_ROARING_ARRAY_MAX) {
+			tag = vx_tag(values);
+			if ((chunk->count == vx_tag_capacity(tag)
+			     && !vx_expand_(&chunk->data, chunk->count + 1))
+			    || !vx_shift_(&chunk->data, j, 1)) {
+				return false;
+			}
+			((uint16_t *)chunk->data)[j] = low;
+			chunk->count++;
+
+			return true;
+		}
+
+		if (!vx_roaring_convert(chunk, VX_ROARING_BITMAP)) {
+			return false;
+		}
+	}
+
+	uint64_t *words = (uint64_t *)chunk->data;
+	uint64_t  bit   = (uint64_t)1 << (low % 64);
+
+	chunk->count += !(words[low / 64] & bit);
+	words[low / 64] |= bit;
+
+	return true;
+}
+
+bool vx_roaring_remove(struct vx_roaring *roaring, uint32_t id)
+{
+	uint16_t key = (uint16_t)(id >> 16);
+	uint16_t low = (uint16_t)id;
+	size_t   i   = vx_roaring_find(roaring, key);
+
+	if (i == vx_tag_count(vx_tag(roaring->chunks))
+	    || roaring->chunks[i].key != key
+	    || !vx_roaring_chunk_contains(&roaring->chunks[i], low)) {
+		return true;
+	}
+
+	struct vx_roaring_chunk *chunk = &roaring->chunks[i];
+
+	if (chunk->count == 1) {
+		return vx_erase(roaring->chunks, i, 1);
+	}
+	if (chunk->kind == VX_ROARING_RUN
+	    && !vx_roaring_convert(chunk,
+	                           chunk->count <= VX_ROARING_ARRAY_MAX + 1
+	                               ? VX_ROARING_ARRAY
+	                               : VX_ROARING_BITMAP)) {
+		return false;
+	}
+
+	if (chunk->kind == VX_ROARING_ARRAY) {
+		uint16_t *values = (uint16_t *)chunk->data;
+		size_t    j      = vx_roaring_lower(values, chunk->count, low);
+
+		chunk->count--;
+		return vx_shift_(&chunk->data, j + 1, -1);
+	}
+	chunk->count--;
+
+	uint64_t *words = (uint64_t *)chunk->data;
+
+	words[low / 64] &= ~((uint64_t)1 << (low % 64));
+
+	// A bitmap left holding no more than an array would is converted, but
+	// still holds the right ids if that fails.
+
+	return chunk->count > VX_ROARING_ARRAY_MAX
+	       || vx_roaring_convert(chunk, VX_ROARING_ARRAY);
+}
+
+bool vx_roaring_optimize(struct vx_roaring *roaring)
+{
+	size_t n = vx_tag_count(vx_tag(roaring->chunks));
+
+	for (size_t i = 0; i < n; i++) {
+		if (!vx_roaring_settle(&roaring->chunks[i])) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool vx_roaring_from_u32(struct vx_roaring *roaring, const uint32_t *ids)
+{
+	size_t n = vx_tag_count(vx_tag(ids));
+
+	vx_roaring_clear(roaring);
+
+	for (size_t i = 0, j; i < n; i = j) {
+		uint16_t key = (uint16_t)(ids[i] >> 16);
+
+		for (j = i + 1; j < n && ids[j] >> 16 == key; j++) {
+		}
+
+		struct vx_roaring_chunk chunk = {
+		    key, VX_ROARING_ARRAY, (uint32_t)(j - i), NULL};
+		uint16_t *values = vx_new(uint16_t, j - i, NULL);
+
+		if (!values) {
+			return false;
+		}
+		for (size_t k = i; k < j; k++) {
+			values[k - i] = (uint16_t)ids[k];
+		}
+		chunk.data = values;
+
+		if (!vx_roaring_push(roaring, &chunk)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool vx_roaring_to_u32(uint32_t **out_p, const struct vx_roaring *roaring)
+{
+	size_t n = vx_tag_count(vx_tag(roaring->chunks));
+
+	if (!vx_set_prepare(out_p, vx_roaring_count(roaring))) {
+		return false;
+	}
+
+	uint32_t *out = *out_p;
+	size_t    k   = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		const struct vx_roaring_chunk *chunk = &roaring->chunks[i];
+		uint32_t high = (uint32_t)chunk->key << 16;
+
+		switch (chunk->kind) {
+		case VX_ROARING_ARRAY: {
+			const uint16_t *values = (const uint16_t *)chunk->data;
+
+			for (size_t j = 0; j < chunk->count; j++) {
+				out[k++] = high | values[j];
+			}
+			break;
+		}
+		case VX_ROARING_BITMAP: {
+			const uint64_t *words = (const uint64_t *)chunk->data;
+
+			for (uint32_t j = 0; j < VX_ROARING_WORDS; j++) {
+				uint32_t base = high | 64 * j;
+
+				for (uint64_t w = words[j]; w; w &= w - 1) {
+					out[k++] = base + vx_bits_ctz(w);
+				}
+			}
+			break;
+		}
+		default: {
+			const struct vx_roaring_run *runs =
+			    (const struct vx_roaring_run *)chunk->data;
+			size_t m = vx_tag_count(vx_tag(runs));
+
+			for (size_t j = 0; j < m; j++) {
+				for (uint32_t v = runs[j].start;
+				     v <= runs[j].last;
+				     v++) {
+					out[k++] = high | v;
+				}
+			}
+			break;
+		}
+		}
+	}
+
+	vx_tag_set_count(vx_tag(out), k);
+
+	return true;
+}
+
+// Intersection and union
+// ======================
+// Each of these sets the container and count of 'chunk' to the combination
+// of those of 'x' and 'y', returning a bool indicating success or failure.
+
+static size_t vx_roaring_intersect_scalar(const uint16_t *a,
+                                          size_t          n,
+                                          const uint16_t *b,
+                                          size_t          m,
+                                          uint16_t       *out)
+{
+	size_t i = 0, j = 0, k = 0;
+
+	while (i < n && j < m) {
+		uint16_t u = a[i], v = b[j];
+		out[k]     = u;
+		k += u == v;
+		i += u <= v;
+		j += v <= u;
+	}
+
+	return k;
+}
+
+#ifdef VX_SIMD_X86
+// Compares a block of eight values from each array against all eight of the
+// other at once with _mm_cmpestrm(), stores those of 'a' which matched, then
+// advances past whichever block ends lower, as vx_intersect_u32_ssse3() does.
+__attribute__((target("sse4.2"))) static size_t
+vx_roaring_intersect_sse42(const uint16_t *a,
+                           size_t          n,
+                           const uint16_t *b,
+                           size_t          m,
+                           uint16_t       *out)
+{
+	size_t i = 0, j = 0, k = 0;
+
+	while (i + 8 <= n && j + 8 <= m) {
+		__m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i *)(b + j));
+		__m128i eq = _mm_cmpestrm(vb,
+		                          8,
+		                          va,
+		                          8,
+		                          _SIDD_UWORD_OPS | _SIDD_CMP_EQUAL_ANY
+		                              | _SIDD_BIT_MASK);
+
+		for (unsigned mask = (unsigned)_mm_cvtsi128_si32(eq); mask;
+		     mask &= mask - 1) {
+			out[k++] = a[i + vx_bits_ctz(mask)];
+		}
+
+		uint16_t a_max = a[i + 7], b_max = b[j + 7];
+		i += (a_max <= b_max) * 8;
+		j += (b_max <= a_max) * 8;
+	}
+
+	return k
+	       + vx_roaring_intersect_scalar(
+	           a + i, n - i, b + j, m - j, out + k);
+}
+#endif
+
+static size_t vx_roaring_intersect(const uint16_t *a,
+                                   size_t          n,
+                                   const uint16_t *b,
+                                   size_t          m,
+                                   uint16_t       *out)
+{
+#ifdef VX_SIMD_X86
+	if (vx_simd_level() >= VX_SIMD_SSE42) {
+		return vx_roaring_intersect_sse42(a, n, b, m, out);
+	}
+#endif
+
+	return vx_roaring_intersect_scalar(a, n, b, m, out);
+}
+
+static bool vx_roaring_array_and(struct vx_roaring_chunk       *chunk,
+                                 const struct vx_roaring_chunk *x,
+                                 const struct vx_roaring_chunk *y)
+{
+	if (x->count > y->count) {
+		const struct vx_roaring_chunk *swap = x;
+		x                                   = y;
+		y                                   = swap;
+	}
+
+	const uint16_t *a   = (const uint16_t *)x->data;
+	const uint16_t *b   = (const uint16_t *)y->data;
+	size_t          n   = x->count;
+	size_t          m   = y->count;
+	uint16_t       *out = vx_new(uint16_t, n, NULL);
+	size_t          i = 0, j = 0, k = 0;
+
+	if (!out) {
+		return false;
+	}
+
+	if (n * VX_GALLOP_RATIO < m) {
+		for (; i < n; i++) {
+			j += vx_roaring_lower(b + j, m - j, a[i]);
+			if (j == m) {
+				break;
+			}
+			out[k]  = a[i];
+			k      += b[j] == a[i];
+		}
+	} else {
+		k = vx_roaring_intersect(a, n, b, m, out);
+	}
+
+	vx_tag_set_count(vx_tag(out), k);
+	chunk->kind  = VX_ROARING_ARRAY;
+	chunk->count = (uint32_t)k;
+	chunk->data  = out;
+
+	return true;
+}
+
+static bool vx_roaring_array_or(struct vx_roaring_chunk       *chunk,
+                                const struct vx_roaring_chunk *x,
+                                const struct vx_roaring_chunk *y)
+{
+	const uint16_t *a   = (const uint16_t *)x->data;
+	const uint16_t *b   = (const uint16_t *)y->data;
+	size_t          n   = x->count;
+	size_t          m   = y->count;
+	uint16_t       *out = vx_new(uint16_t, n + m, NULL);
+	size_t          i = 0, j = 0, k = 0;
+
+	if (!out) {
+		return false;
+	}
+
+	while (i < n && j < m) {
+		uint16_t u = a[i], v = b[j];
+		out[k++]   = u <= v ? u : v;
+		i += u <= v;
+		j += v <= u;
+	}
+	memcpy(out + k, a + i, (n - i) * sizeof(uint16_t));
+	k += n - i;
+	memcpy(out + k, b + j, (m - j) * sizeof(uint16_t));
+	k += m - j;
+
+	// Any more than VX_ROARING_ARRAY_MAX values are moved to a bitmap when
+	// the chunk is settled.
+
+	vx_tag_set_count(vx_tag(out), k);
+	chunk->kind  = VX_ROARING_ARRAY;
+	chunk->count = (uint32_t)k;
+	chunk->data  = out;
+
+	return true;
+}
+
+// Keeps the values of the array 'x' which are also in 'y'.
+static bool vx_roaring_array_filter(struct vx_roaring_chunk       *chunk,
+                                    const struct vx_roaring_chunk *x,
+                                    const struct vx_roaring_chunk *y)
+{
+	const uint16_t *a   = (const uint16_t *)x->data;
+	uint16_t       *out = vx_new(uint16_t, x->count, NULL);
+	size_t          k   = 0;
+
+	if (!out) {
+		return false;
+	}
+
+	for (size_t i = 0; i < x->count; i++) {
+		out[k]  = a[i];
+		k      += vx_roaring_chunk_contains(y, a[i]);
+	}
+
+	vx_tag_set_count(vx_tag(out), k);
+	chunk->kind  = VX_ROARING_ARRAY;
+	chunk->count = (uint32_t)k;
+	chunk->data  = out;
+
+	return true;
+}
+
+static bool vx_roaring_runs_and(struct vx_roaring_chunk       *chunk,
+                                const struct vx_roaring_chunk *x,
+                                const struct vx_roaring_chunk *y)
+{
+	const struct vx_roaring_run *a = (const struct vx_roaring_run *)x->data;
+	const struct vx_roaring_run *b = (const struct vx_roaring_run *)y->data;
+	size_t                       n = vx_tag_count(vx_tag(a));
+	size_t                       m = vx_tag_count(vx_tag(b));
+	size_t                       i = 0, j = 0, k = 0;
+	uint32_t                     total = 0;
+
+	struct vx_roaring_run *out = vx_new(struct vx_roaring_run, n + m, NULL);
+	if (!out) {
+		return false;
+	}
+
+	// Each overlap of two runs is a run of the result, after which the run
+	// ending first can overlap no more.
+
+	while (i < n && j < m) {
+		unsigned start = a[i].start;
+		unsigned last  = a[i].last;
+
+		start = b[j].start > start ? b[j].start : start;
+		last  = b[j].last < last ? b[j].last : last;
+
+		if (start <= last) {
+			out[k].start    = (uint16_t)start;
+			out[k++].last   = (uint16_t)last;
+			total          += last - start + 1;
+		}
+		if (a[i].last < b[j].last) {
+			i++;
+		} else {
+			j++;
+		}
+	}
+
+	vx_tag_set_count(vx_tag(out), k);
+	chunk->kind  = VX_ROARING_RUN;
+	chunk->count = total;
+	chunk->data  = out;
+
+	return true;
+}
+
+static bool vx_roaring_runs_or(struct vx_roaring_chunk       *chunk,
+                               const struct vx_roaring_chunk *x,
+                               const struct vx_roaring_chunk *y)
+{
+	const struct vx_roaring_run *a = (const struct vx_roaring_run *)x->data;
+	const struct vx_roaring_run *b = (const struct vx_roaring_run *)y->data;
+	size_t                       n = vx_tag_count(vx_tag(a));
+	size_t                       m = vx_tag_count(vx_tag(b));
+	size_t                       i = 0, j = 0, k = 0;
+	uint32_t                     total = 0;
+
+	struct vx_roaring_run *out = vx_new(struct vx_roaring_run, n + m, NULL);
+	if (!out) {
+		return false;
+	}
+
+	// Runs are taken in order of their starts, each extending the last run
+	// of the result where it overlaps or adjoins it.
+
+	while (i < n || j < m) {
+		struct vx_roaring_run run =
+		    j == m || (i < n && a[i].start <= b[j].start) ? a[i++]
+		                                                  : b[j++];
+
+		if (k && run.start <= (unsigned)out[k - 1].last + 1) {
+			if (run.last > out[k - 1].last) {
+				total += run.last - out[k - 1].last;
+				out[k - 1].last = run.last;
+			}
+		} else {
+			out[k++]  = run;
+			total    += (unsigned)run.last - run.start + 1;
+		}
+	}
+
+	vx_tag_set_count(vx_tag(out), k);
+	chunk->kind  = VX_ROARING_RUN;
+	chunk->count = total;
+	chunk->data  = out;
+
+	return true;
+}
+
+static bool vx_roaring_chunk_and(struct vx_roaring_chunk       *chunk,
+                                 const struct vx_roaring_chunk *x,
+                                 const struct vx_roaring_chunk *y)
+{
+	if (y->kind == VX_ROARING_ARRAY) {
+		const struct vx_roaring_chunk *swap = x;
+		x                                   = y;
+		y                                   = swap;
+	}
+
+	if (x->kind == VX_ROARING_ARRAY) {
+		return y->kind == VX_ROARING_ARRAY
+		         ? vx_roaring_array_and(chunk, x, y)
+		         : vx_roaring_array_filter(chunk, x, y);
+	}
+	if (x->kind == VX_ROARING_RUN && y->kind == VX_ROARING_RUN) {
+		return vx_roaring_runs_and(chunk, x, y);
+	}
+
+	uint64_t *words = vx_roaring_bitmap(x);
+	uint64_t *temp  = y->kind == VX_ROARING_BITMAP ? (uint64_t *)y->data
+	                                               : vx_roaring_bitmap(y);
+
+	if (words && temp) {
+		struct vx_bits dest = {words, VX_ROARING_IDS};
+		struct vx_bits src  = {temp, VX_ROARING_IDS};
+
+		vx_bits_and(&dest, &src);
+		chunk->kind  = VX_ROARING_BITMAP;
+		chunk->count = (uint32_t)vx_bits_popcount(&dest);
+		chunk->data  = words;
+	} else {
+		vx_free(words);
+	}
+	if (temp != y->data) {
+		vx_free(temp);
+	}
+
+	return words != NULL;
+}
+
+static bool vx_roaring_chunk_or(struct vx_roaring_chunk       *chunk,
+                                const struct vx_roaring_chunk *x,
+                                const struct vx_roaring_chunk *y)
+{
+	if (x->kind == VX_ROARING_ARRAY && y->kind == VX_ROARING_ARRAY) {
+		return vx_roaring_array_or(chunk, x, y);
+	}
+	if (x->kind == VX_ROARING_RUN && y->kind == VX_ROARING_RUN) {
+		return vx_roaring_runs_or(chunk, x, y);
+	}
+
+	uint64_t *words = vx_roaring_bitmap(x);
+	if (!words) {
+		return false;
+	}
+
+	struct vx_bits bits = {words, VX_ROARING_IDS};
+
+	vx_roaring_or_into(words, y);
+	chunk->kind  = VX_ROARING_BITMAP;
+	chunk->count = (uint32_t)vx_bits_popcount(&bits);
+	chunk->data  = words;
+
+	return true;
+}
+
+bool vx_roaring_and(struct vx_roaring       *out,
+                    const struct vx_roaring *a,
+                    const struct vx_roaring *b)
+{
+	size_t n = vx_tag_count(vx_tag(a->chunks));
+	size_t m = vx_tag_count(vx_tag(b->chunks));
+	size_t i = 0, j = 0;
+
+	vx_roaring_clear(out);
+
+	while (i < n && j < m) {
+		const struct vx_roaring_chunk *x = &a->chunks[i];
+		const struct vx_roaring_chunk *y = &b->chunks[j];
+
+		if (x->key != y->key) {
+			i += x->key < y->key;
+			j += y->key < x->key;
+			continue;
+		}
+
+		struct vx_roaring_chunk chunk = {x->key, 0, 0, NULL};
+		if (!vx_roaring_chunk_and(&chunk, x, y)
+		    || !vx_roaring_push(out, &chunk)) {
+			return false;
+		}
+		i++;
+		j++;
+	}
+
+	return true;
+}
+
+bool vx_roaring_or(struct vx_roaring       *out,
+                   const struct vx_roaring *a,
+                   const struct vx_roaring *b)
+{
+	size_t n = vx_tag_count(vx_tag(a->chunks));
+	size_t m = vx_tag_count(vx_tag(b->chunks));
+	size_t i = 0, j = 0;
+
+	vx_roaring_clear(out);
+
+	while (i < n || j < m) {
+		const struct vx_roaring_chunk *x = i < n ? &a->chunks[i] : NULL;
+		const struct vx_roaring_chunk *y = j < m ? &b->chunks[j] : NULL;
+		struct vx_roaring_chunk        chunk;
+		bool                           ok;
+
+		if (!y || (x && x->key < y->key)) {
+			ok = vx_roaring_copy(&chunk, x);
+			i++;
+		} else if (!x || y->key < x->key) {
+			ok = vx_roaring_copy(&chunk, y);
+			j++;
+		} else {
+			chunk.key = x->key;
+			ok        = vx_roaring_chunk_or(&chunk, x, y);
+			i++;
+			j++;
+		}
+
+		if (!ok || !vx_roaring_push(out, &chunk)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Files
+// =====
+
+// Returns whether the container of 'chunk' holds 'count' values in order.
+static bool vx_roaring_valid(const struct vx_roaring_chunk *chunk)
+{
+	size_t n = vx_tag_count(vx_tag(chunk->data));
+
+	if (!chunk->count || chunk->count > VX_ROARING_IDS) {
+		return false;
+	}
+
+	switch (chunk->kind) {
+	case VX_ROARING_ARRAY: {
+		const uint16_t *values = (const uint16_t *)chunk->data;
+
+		for (size_t i = 1; i < n; i++) {
+			if (values[i] <= values[i - 1]) {
+				return false;
+			}
+		}
+		return n == chunk->count;
+	}
+	case VX_ROARING_BITMAP:
+		return n == VX_ROARING_WORDS
+		       && vx_bits_popcount_words((const uint64_t *)chunk->data,
+		                                 n)
+		              == chunk->count;
+	default: {
+		const struct vx_roaring_run *runs =
+		    (const struct vx_roaring_run *)chunk->data;
+		size_t total = 0;
+
+		for (size_t i = 0; i < n; i++) {
+			if (runs[i].last < runs[i].start
+			    || (i && runs[i].start <= runs[i - 1].last)) {
+				return false;
+			}
+			total += (size_t)runs[i].last - runs[i].start + 1;
+		}
+		return total == chunk->count;
+	}
+	}
+}
+
+bool vx_roaring_write(const struct vx_roaring *roaring, FILE *file)
+{
+	size_t    n     = vx_tag_count(vx_tag(roaring->chunks));
+	uint64_t *index = vx_new(uint64_t, n, NULL);
+
+	if (!index) {
+		return false;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		const struct vx_roaring_chunk *chunk = &roaring->chunks[i];
+
+		index[i] = chunk->key | (uint64_t)chunk->kind << 16
+		         | (uint64_t)chunk->count << 32;
+	}
+
+	bool ok = vx_write(index, file);
+	vx_free(index);
+
+	for (size_t i = 0; ok && i < n; i++) {
+		ok = vx_write(roaring->chunks[i].data, file);
+	}
+
+	return ok;
+}
+
+bool vx_roaring_read(struct vx_roaring *roaring, FILE *file)
+{
+	static const size_t units[] = {
+	    sizeof(uint16_t),
+	    sizeof(uint64_t),
+	    sizeof(struct vx_roaring_run),
+	};
+
+	uint64_t *index = vx_read(uint64_t, file, NULL);
+	if (!index) {
+		roaring->chunks = NULL;
+		return false;
+	}
+
+	size_t n = vx_tag_count(vx_tag(index));
+
+	roaring->chunks =
+	    vx_new(struct vx_roaring_chunk, n, vx_roaring_chunk_free);
+
+	bool ok = roaring->chunks != NULL;
+	for (size_t i = 0; ok && i < n; i++) {
+		struct vx_roaring_chunk *chunk = &roaring->chunks[i];
+
+		chunk->key   = (uint16_t)index[i];
+		chunk->kind  = (uint16_t)(index[i] >> 16);
+		chunk->count = (uint32_t)(index[i] >> 32);
+
+		ok = chunk->kind <= VX_ROARING_RUN
+		  && (!i || chunk->key > chunk[-1].key)
+		  && (chunk->data = vx_read_(units[chunk->kind], file, NULL))
+		  && vx_roaring_valid(chunk);
+	}
+	vx_free(index);
+
+	if (!ok) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error reading compressed bitmap.\n");
+#endif
+		vx_roaring_free(roaring);
+	}
+
+	return ok;
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,191 @@
+// vx_soa.h - struct-of-arrays vectors for vx.h
+// http://github.com/auul/vx.h
+//
+// License: Public Domain (www.unlicense.org); see vx.h
+// ==========================================
+//
+// Linking:
+//      Include this header in place of vx.h, which it includes. It defines
+//      only inline functions, so needs nothing compiled beyond vx.h itself.
+//
+// Usage:
+//      A struct-of-arrays vector holds each field of a struct in a vector of
+//      its own, so that a loop over one or two fields reads only those
+//      fields, in contiguous arrays suited to SIMD, rather than every field
+//      of every struct. The fields are listed once, as an X-macro taking
+//      the type and name of each:
+//
+//              #define PARTICLE_FIELDS(X) X(float, x) X(float, y) X(int, id)
+//
+//              VX_SOA_DECLARE(particle, PARTICLE_FIELDS)
+//
+//      which declares 'struct particle', with a member for each field, as the
+//      type of a single row, and 'struct particle_soa', with a vector for each
+//      field and the shared 'count' of rows, along with the functions below.
+//      The field vectors are ordinary vectors, each aligned as vx_new()
+//      aligns data, and may be read and written in place, e.g. as soa.x[i],
+//      but must only be resized via these functions, which keep the count of
+//      every field equal to 'count'. Each function which grows the vectors
+//      grows them all before it moves any row, so that a failure leaves the
+//      rows as they were.
+//
+// API:
+// ====
+// VX_SOA_DECLARE(name, FIELDS)
+//      Declares 'struct name', 'struct name_soa' and inline functions
+//      operating on the latter, which return a bool indicating success or
+//      failure where applicable:
+//              bool   name_init(struct name_soa *soa, size_t count)
+//              void   name_free(struct name_soa *soa)
+//              bool   name_reserve(struct name_soa *soa, size_t capacity)
+//              bool   name_push(struct name_soa *soa, struct name row)
+//              bool   name_insert(struct name_soa *soa, size_t index,
+//                                 struct name row)
+//              bool   name_erase(struct name_soa *soa, size_t index,
+//                                size_t count)
+//              struct name name_get(const struct name_soa *soa, size_t index)
+//              void   name_set(struct name_soa *soa, size_t index,
+//                              struct name row)
+//      name_init() initializes 'soa' with 'count' rows of zeros, and
+//      name_reserve() reserves room for 'capacity' rows in every field.
+
+#ifndef VX_SOA_H
+#define VX_SOA_H
+
+#include "vx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Each of these is applied to every field by the X-macro, within the
+// functions declared by VX_SOA_DECLARE(), whose locals they refer to.
+
+#define VX_SOA_MEMBER_(type, field) type field;
+#define VX_SOA_ARRAY_(type, field) type *field;
+#define VX_SOA_NEW_(type, field)                                 \
+	soa->field = (type *)vx_new_(sizeof(type), count, NULL); \
+	ok         = ok && soa->field;
+#define VX_SOA_FREE_(type, field) vx_free_((void **)&soa->field);
+#define VX_SOA_RESERVE_(type, field) \
+	ok = ok && vx_reserve_((void **)&soa->field, capacity);
+#define VX_SOA_EXPAND_(type, field)                           \
+	ok = ok                                               \
+	  && (vx_tag_capacity(vx_tag(soa->field)) >= capacity \
+	      || vx_expand_((void **)&soa->field, capacity));
+#define VX_SOA_SET_COUNT_(type, field) \
+	vx_tag_set_count(vx_tag(soa->field), soa->count);
+#define VX_SOA_SHRINK_(type, field) \
+	ok = vx_typed_shrink_(&soa->field) && ok;
+#define VX_SOA_SHIFT_UP_(type, field)   \
+	memmove(soa->field + index + 1, \
+	        soa->field + index,     \
+	        (soa->count - index) * sizeof(type));
+#define VX_SOA_SHIFT_DOWN_(type, field) \
+	memmove(soa->field + index,     \
+	        soa->field + index + n, \
+	        (soa->count - index - n) * sizeof(type));
+#define VX_SOA_GET_(type, field) row.field = soa->field[index];
+#define VX_SOA_SET_(type, field) soa->field[index] = row.field;
+
+#define VX_SOA_DECLARE(name, FIELDS)                                           \
+	struct name {                                                          \
+		FIELDS(VX_SOA_MEMBER_)                                         \
+	};                                                                     \
+                                                                               \
+	struct name##_soa {                                                    \
+		FIELDS(VX_SOA_ARRAY_)                                          \
+		size_t count;                                                  \
+	};                                                                     \
+                                                                               \
+	static inline void name##_free(struct name##_soa *soa)                 \
+	{                                                                      \
+		FIELDS(VX_SOA_FREE_)                                           \
+		soa->count = 0;                                                \
+	}                                                                      \
+                                                                               \
+	static inline bool name##_init(struct name##_soa *soa, size_t count)   \
+	{                                                                      \
+		bool ok = true;                                                \
+                                                                               \
+		FIELDS(VX_SOA_NEW_)                                            \
+		soa->count = count;                                            \
+		if (!ok) {                                                     \
+			name##_free(soa);                                      \
+		}                                                              \
+                                                                               \
+		return ok;                                                     \
+	}                                                                      \
+                                                                               \
+	static inline bool name##_reserve(struct name##_soa *soa,              \
+	                                  size_t             capacity)         \
+	{                                                                      \
+		bool ok = true;                                                \
+                                                                               \
+		FIELDS(VX_SOA_RESERVE_)                                        \
+                                                                               \
+		return ok;                                                     \
+	}                                                                      \
+                                                                               \
+	static inline void name##_set(struct name##_soa *soa,                  \
+	                              size_t             index,                \
+	                              struct name        row)                  \
+	{                                                                      \
+		FIELDS(VX_SOA_SET_)                                            \
+	}                                                                      \
+                                                                               \
+	static inline struct name name##_get(const struct name##_soa *soa,     \
+	                                     size_t                   index)   \
+	{                                                                      \
+		struct name row;                                               \
+                                                                               \
+		FIELDS(VX_SOA_GET_)                                            \
+                                                                               \
+		return row;                                                    \
+	}                                                                      \
+                                                                               \
+	static inline bool name##_insert(struct name##_soa *soa,               \
+	                                 size_t             index,             \
+	                                 struct name        row)               \
+	{                                                                      \
+		size_t capacity = soa->count + 1;                              \
+		bool   ok       = true;                                        \
+                                                                               \
+		FIELDS(VX_SOA_EXPAND_)                                         \
+		if (!ok) {                                                     \
+			return false;                                          \
+		}                                                              \
+                                                                               \
+		FIELDS(VX_SOA_SHIFT_UP_)                                       \
+		name##_set(soa, index, row);                                   \
+		soa->count++;                                                  \
+		FIELDS(VX_SOA_SET_COUNT_)                                      \
+                                                                               \
+		return true;                                                   \
+	}                                                                      \
+                                                                               \
+	static inline bool name##_push(struct name##_soa *soa,                 \
+	                               struct name        row)                 \
+	{                                                                      \
+		return name##_insert(soa, soa->count, row);                    \
+	}                                                                      \
+                                                                               \
+	static inline bool name##_erase(struct name##_soa *soa,                \
+	                                size_t             index,              \
+	                                size_t             n)                  \
+	{                                                                      \
+		bool ok = true;                                                \
+                                                                               \
+		FIELDS(VX_SOA_SHIFT_DOWN_)                                     \
+		soa->count -= n;                                               \
+		FIELDS(VX_SOA_SET_COUNT_)                                      \
+		FIELDS(VX_SOA_SHRINK_)                                         \
+                                                                               \
+		return ok;                                                     \
+	}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
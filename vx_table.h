@@ -0,0 +1,817 @@
+// vx_table.h - columnar tables and scans for vx.h
+// http://github.com/auul/vx.h
+//
+// License: Public Domain (www.unlicense.org); see vx.h
+// ==========================================
+//
+// Linking:
+//      Include this header in place of vx.h, which it includes. The
+//      implementation is compiled along with that of vx.h, in the ONE .c file
+//      which defines VX_IMPLEMENT.
+//
+// Usage:
+//      A table holds named columns of numbers, each an ordinary vector, all of
+//      the same count. Rows are appended in batches, a whole column at a time,
+//      and queries scan one column at a time: a predicate such as 'col < x'
+//      over a column yields either a bitmap, with a bit per row, or a
+//      selection vector, holding the indices of the matching rows in
+//      increasing order. Bitmaps from several predicates may be combined
+//      word by word with &, | and ~ before being turned into a selection, and
+//      a selection may be narrowed further by predicates on other columns.
+//      Only once the rows are known are the columns wanted copied out of the
+//      table, by gathering the selected rows.
+//
+//      Predicates are evaluated 64 rows at a time into a word of the bitmap,
+//      with AVX2 kernels where available (see SIMD in vx.h) and otherwise
+//      with loops the compiler may vectorize. A table holds at most
+//      UINT32_MAX rows, so that selections hold 32-bit indices.
+//
+//      The column vectors may be read directly with vx_table_column(), but
+//      must only be resized via the functions below.
+//
+// API:
+// ====
+// bool vx_table_init(struct vx_table *table)
+//      Initializes an empty table. Returns a bool indicating success or
+//      failure.
+// void vx_table_free(struct vx_table *table)
+//      Frees the columns of 'table'.
+// size_t vx_table_rows(const struct vx_table *table)
+//      Returns the number of rows in 'table'.
+// bool vx_table_add(struct vx_table *table, const char *name,
+//                   enum vx_type type)
+//      Adds a column 'name' of 'type', one of VX_TYPE_I32, VX_TYPE_U32,
+//      VX_TYPE_I64, VX_TYPE_U64 or VX_TYPE_F64 for int32_t, uint32_t, int64_t,
+//      uint64_t or double, holding zero in every existing row. Returns a bool
+//      indicating success or failure, including where 'name' is taken.
+// bool vx_table_attach(struct vx_table *table, const char *name,
+//                      enum vx_type type, void *vx)
+//      As vx_table_add(), but adds the existing vector 'vx' of 'type' as the
+//      column, which the table then owns. Its count must equal the number of
+//      rows, unless the table has no columns. Returns a bool indicating
+//      success or failure, in which case 'vx' is still owned by the caller.
+// void *vx_table_column(const struct vx_table *table, const char *name)
+//      Returns the vector of the column 'name', or NULL if there is none.
+// bool vx_table_append(struct vx_table *table, const void *const *batch,
+//                      size_t count)
+//      Appends 'count' rows, where batch[c] points to the 'count' values of
+//      the c-th column added. Returns a bool indicating success or failure,
+//      in which case 'table' is unchanged.
+// uint64_t *vx_table_scan_bits(const struct vx_table *table,
+//                              const char *name, enum vx_op op,
+//                              const void *value)
+//      Compares each value of the column 'name' against the one pointed to by
+//      'value', of the column's type, by 'op', one of VX_OP_LT, VX_OP_LE,
+//      VX_OP_EQ, VX_OP_NE, VX_OP_GE or VX_OP_GT. Returns a new vector of
+//      uint64_t words, where bit (i % 64) of word (i / 64) is set if row 'i'
+//      matches, with the bits past the last row clear, or NULL on failure.
+// uint32_t *vx_table_scan(const struct vx_table *table, const char *name,
+//                         enum vx_op op, const void *value)
+//      As vx_table_scan_bits(), but returns a new selection vector.
+// uint32_t *vx_table_selection(const uint64_t *bits)
+//      Returns a new selection vector of the rows whose bits are set in the
+//      bitmap 'bits', or NULL on failure.
+// bool vx_table_filter(const struct vx_table *table, const char *name,
+//                      enum vx_op op, const void *value, uint32_t **sel)
+//      Removes from the selection vector '*sel' the rows which do not match
+//      the predicate, as for vx_table_scan(). Returns a bool indicating
+//      success or failure.
+// void *vx_table_gather(const struct vx_table *table, const char *name,
+//                       const uint32_t *sel)
+//      Returns a new vector of the values of the column 'name' in the rows of
+//      the selection vector 'sel', in its order, or NULL on failure.
+// bool vx_table_materialize(const struct vx_table *table,
+//                           const uint32_t *sel, struct vx_table *out)
+//      Initializes 'out' as a new table with the columns of 'table', holding
+//      the rows of the selection vector 'sel'. Returns a bool indicating
+//      success or failure, in which case 'out' need not be freed.
+
+#ifndef VX_TABLE_H
+#define VX_TABLE_H
+
+#include "vx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum vx_type {
+	VX_TYPE_I32,
+	VX_TYPE_U32,
+	VX_TYPE_I64,
+	VX_TYPE_U64,
+	VX_TYPE_F64,
+};
+
+enum vx_op {
+	VX_OP_LT,
+	VX_OP_LE,
+	VX_OP_EQ,
+	VX_OP_NE,
+	VX_OP_GE,
+	VX_OP_GT,
+};
+
+struct vx_column {
+	char        *name;
+	enum vx_type type;
+	void        *data;
+};
+
+struct vx_table {
+	struct vx_column *columns;
+	size_t            rows;
+};
+
+bool      vx_table_init(struct vx_table *table);
+void      vx_table_free(struct vx_table *table);
+size_t    vx_table_rows(const struct vx_table *table);
+bool      vx_table_add(struct vx_table *table,
+                       const char      *name,
+                       enum vx_type     type);
+bool      vx_table_attach(struct vx_table *table,
+                          const char      *name,
+                          enum vx_type     type,
+                          void            *vx);
+void     *vx_table_column(const struct vx_table *table, const char *name);
+bool      vx_table_append(struct vx_table   *table,
+                          const void *const *batch,
+                          size_t             count);
+uint64_t *vx_table_scan_bits(const struct vx_table *table,
+                             const char            *name,
+                             enum vx_op             op,
+                             const void            *value);
+uint32_t *vx_table_scan(const struct vx_table *table,
+                        const char            *name,
+                        enum vx_op             op,
+                        const void            *value);
+uint32_t *vx_table_selection(const uint64_t *bits);
+bool      vx_table_filter(const struct vx_table *table,
+                          const char            *name,
+                          enum vx_op             op,
+                          const void            *value,
+                          uint32_t             **sel);
+void     *vx_table_gather(const struct vx_table *table,
+                          const char            *name,
+                          const uint32_t        *sel);
+bool      vx_table_materialize(const struct vx_table *table,
+                               const uint32_t        *sel,
+                               struct vx_table       *out);
+
+#ifdef VX_IMPLEMENT
+
+static size_t vx_table_unit(enum vx_type type)
+{
+	return type == VX_TYPE_I32 || type == VX_TYPE_U32 ? 4 : 8;
+}
+
+static unsigned vx_table_ctz(uint64_t word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return (unsigned)__builtin_ctzll(word);
+#else
+	unsigned n = 0;
+	for (; !(word & 1); word >>= 1) {
+		n++;
+	}
+	return n;
+#endif
+}
+
+static size_t vx_table_popcount(uint64_t word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return (size_t)__builtin_popcountll(word);
+#else
+	size_t n = 0;
+	for (; word; word &= word - 1) {
+		n++;
+	}
+	return n;
+#endif
+}
+
+// The vector of columns frees each column with this, so that freeing the
+// vector also frees the columns.
+static void vx_table_column_free(void *unit)
+{
+	struct vx_column *column = (struct vx_column *)unit;
+
+	vx_free(column->name);
+	vx_free_(&column->data);
+}
+
+static const struct vx_column *vx_table_find(const struct vx_table *table,
+                                             const char            *name)
+{
+	size_t n = vx_tag_count(vx_tag(table->columns));
+
+	for (size_t c = 0; c < n; c++) {
+		if (!strcmp(table->columns[c].name, name)) {
+			return &table->columns[c];
+		}
+	}
+
+#ifdef VX_USER_ERRORS
+	fprintf(stderr, "Error finding column %s.\n", name);
+#endif
+	return NULL;
+}
+
+bool vx_table_init(struct vx_table *table)
+{
+	table->rows = 0;
+	table->columns =
+	    vx_new(struct vx_column, 0, vx_table_column_free);
+
+	return table->columns != NULL;
+}
+
+void vx_table_free(struct vx_table *table)
+{
+	vx_free(table->columns);
+	table->rows = 0;
+}
+
+size_t vx_table_rows(const struct vx_table *table)
+{
+	return table->rows;
+}
+
+bool vx_table_attach(struct vx_table *table,
+                     const char      *name,
+                     enum vx_type     type,
+                     void            *vx)
+{
+	size_t n     = vx_tag_count(vx_tag(table->columns));
+	size_t count = vx_tag_count(vx_tag(vx));
+
+	for (size_t c = 0; c < n; c++) {
+		if (!strcmp(table->columns[c].name, name)) {
+#ifdef VX_USER_ERRORS
+			fprintf(stderr,
+			        "Error adding column %s: name taken.\n",
+			        name);
+#endif
+			return false;
+		}
+	}
+	if (vx_tag_unit(vx_tag(vx)) != vx_table_unit(type)
+	    || (n && count != table->rows) || count > UINT32_MAX) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error adding column %s: bad vector.\n", name);
+#endif
+		return false;
+	}
+
+	struct vx_column column;
+
+	column.name = vx_str_new("%s", name);
+	column.type = type;
+	column.data = vx;
+
+	if (!column.name || !vx_append_((void **)&table->columns, &column, 1)) {
+		vx_free(column.name);
+		return false;
+	}
+	table->rows = count;
+
+	return true;
+}
+
+bool vx_table_add(struct vx_table *table, const char *name, enum vx_type type)
+{
+	void *vx = vx_new_(vx_table_unit(type), table->rows, NULL);
+	if (!vx) {
+		return false;
+	}
+	if (!vx_table_attach(table, name, type, vx)) {
+		vx_free_(&vx);
+		return false;
+	}
+
+	return true;
+}
+
+void *vx_table_column(const struct vx_table *table, const char *name)
+{
+	const struct vx_column *column = vx_table_find(table, name);
+
+	return column ? column->data : NULL;
+}
+
+bool vx_table_append(struct vx_table   *table,
+                     const void *const *batch,
+                     size_t             count)
+{
+	size_t n     = vx_tag_count(vx_tag(table->columns));
+	size_t total = table->rows + count;
+
+	if (total > UINT32_MAX || total < count) {
+#ifdef VX_USER_ERRORS
+		fprintf(stderr, "Error appending rows: too many rows.\n");
+#endif
+		return false;
+	}
+
+	// Every column is grown before any is appended to, so that a failure
+	// leaves the rows as they were.
+
+	for (size_t c = 0; c < n; c++) {
+		void **data_p = &table->columns[c].data;
+
+		if (vx_tag_capacity(vx_tag(*data_p)) < total
+		    && !vx_expand_(data_p, total)) {
+			return false;
+		}
+	}
+	for (size_t c = 0; c < n; c++) {
+		vx_append_(&table->columns[c].data, (void *)batch[c], count);
+	}
+	table->rows = total;
+
+	return true;
+}
+
+// Scans
+// =====
+// Each kernel sets bit (i % 64) of out[i / 64] where x[i] matches, for 'n'
+// values, and returns the number of values done. The SIMD kernels do whole
+// words of 64 values only, and leave the rest to the scalar kernels.
+
+#ifdef VX_SIMD_X86
+// Values are flipped by 'bias' so that unsigned values compare as signed. LE,
+// NE and GE are the complements of GT, EQ and LT.
+__attribute__((target("avx2"))) static size_t
+vx_table_bits_avx2_32(const uint32_t *x,
+                      size_t          n,
+                      enum vx_op      op,
+                      uint32_t        v,
+                      uint32_t        bias,
+                      uint64_t       *out)
+{
+	const __m256i flip = _mm256_set1_epi32((int)bias);
+	const __m256i key  = _mm256_set1_epi32((int)(v ^ bias));
+	uint64_t      invert =
+	    op == VX_OP_LE || op == VX_OP_NE || op == VX_OP_GE ? ~0ull : 0;
+	size_t b = 0;
+
+	for (; b + 64 <= n; b += 64) {
+		uint64_t word = 0;
+
+		for (unsigned j = 0; j < 8; j++) {
+			__m256i y = _mm256_xor_si256(
+			    _mm256_loadu_si256((const __m256i *)(x + b) + j),
+			    flip);
+			__m256i m;
+
+			if (op == VX_OP_LT || op == VX_OP_GE) {
+				m = _mm256_cmpgt_epi32(key, y);
+			} else if (op == VX_OP_GT || op == VX_OP_LE) {
+				m = _mm256_cmpgt_epi32(y, key);
+			} else {
+				m = _mm256_cmpeq_epi32(y, key);
+			}
+			word |= (uint64_t)(unsigned)_mm256_movemask_ps(
+			            _mm256_castsi256_ps(m))
+			     << (8 * j);
+		}
+		out[b / 64] = word ^ invert;
+	}
+
+	return b;
+}
+
+__attribute__((target("avx2"))) static size_t
+vx_table_bits_avx2_64(const uint64_t *x,
+                      size_t          n,
+                      enum vx_op      op,
+                      uint64_t        v,
+                      uint64_t        bias,
+                      uint64_t       *out)
+{
+	const __m256i flip = _mm256_set1_epi64x((long long)bias);
+	const __m256i key  = _mm256_set1_epi64x((long long)(v ^ bias));
+	uint64_t      invert =
+	    op == VX_OP_LE || op == VX_OP_NE || op == VX_OP_GE ? ~0ull : 0;
+	size_t b = 0;
+
+	for (; b + 64 <= n; b += 64) {
+		uint64_t word = 0;
+
+		for (unsigned j = 0; j < 16; j++) {
+			__m256i y = _mm256_xor_si256(
+			    _mm256_loadu_si256((const __m256i *)(x + b) + j),
+			    flip);
+			__m256i m;
+
+			if (op == VX_OP_LT || op == VX_OP_GE) {
+				m = _mm256_cmpgt_epi64(key, y);
+			} else if (op == VX_OP_GT || op == VX_OP_LE) {
+				m = _mm256_cmpgt_epi64(y, key);
+			} else {
+				m = _mm256_cmpeq_epi64(y, key);
+			}
+			word |= (uint64_t)(unsigned)_mm256_movemask_pd(
+			            _mm256_castsi256_pd(m))
+			     << (4 * j);
+		}
+		out[b / 64] = word ^ invert;
+	}
+
+	return b;
+}
+
+// Doubles compare as in C, so that NaN matches only NE, and no complements are
+// taken.
+#define VX_TABLE_AVX2_F64_(pred)                                               \
+	for (; b + 64 <= n; b += 64) {                                         \
+		uint64_t word = 0;                                             \
+		for (unsigned j = 0; j < 16; j++) {                            \
+			__m256d m = _mm256_cmp_pd(                             \
+			    _mm256_loadu_pd(x + b + 4 * j), key, pred);        \
+			word |= (uint64_t)(unsigned)_mm256_movemask_pd(m)      \
+			     << (4 * j);                                       \
+		}                                                              \
+		out[b / 64] = word;                                            \
+	}                                                                      \
+	break;
+
+__attribute__((target("avx2"))) static size_t vx_table_bits_avx2_f64(
+    const double *x, size_t n, enum vx_op op, double v, uint64_t *out)
+{
+	const __m256d key = _mm256_set1_pd(v);
+	size_t        b   = 0;
+
+	switch (op) {
+	case VX_OP_LT:
+		VX_TABLE_AVX2_F64_(_CMP_LT_OQ)
+	case VX_OP_LE:
+		VX_TABLE_AVX2_F64_(_CMP_LE_OQ)
+	case VX_OP_EQ:
+		VX_TABLE_AVX2_F64_(_CMP_EQ_OQ)
+	case VX_OP_NE:
+		VX_TABLE_AVX2_F64_(_CMP_NEQ_UQ)
+	case VX_OP_GE:
+		VX_TABLE_AVX2_F64_(_CMP_GE_OQ)
+	case VX_OP_GT:
+		VX_TABLE_AVX2_F64_(_CMP_GT_OQ)
+	}
+
+	return b;
+}
+#endif
+
+// Generates, for each type, the scalar kernel and the narrowing of a
+// selection. The comparison is chosen once per 64 values, so that each loop
+// is a simple one the compiler may vectorize.
+#define VX_TABLE_DEFINE_(suffix, type)                                         \
+	static void vx_table_bits_##suffix(                                    \
+	    const type *x, size_t n, enum vx_op op, type v, uint64_t *out)     \
+	{                                                                      \
+		for (size_t b = 0; b < n; b += 64) {                           \
+			const type *y    = x + b;                              \
+			size_t      k    = n - b < 64 ? n - b : 64;            \
+			uint64_t    word = 0;                                  \
+                                                                               \
+			switch (op) {                                          \
+			case VX_OP_LT:                                         \
+				for (size_t j = 0; j < k; j++)                 \
+					word |= (uint64_t)(y[j] < v) << j;     \
+				break;                                         \
+			case VX_OP_LE:                                         \
+				for (size_t j = 0; j < k; j++)                 \
+					word |= (uint64_t)(y[j] <= v) << j;    \
+				break;                                         \
+			case VX_OP_EQ:                                         \
+				for (size_t j = 0; j < k; j++)                 \
+					word |= (uint64_t)(y[j] == v) << j;    \
+				break;                                         \
+			case VX_OP_NE:                                         \
+				for (size_t j = 0; j < k; j++)                 \
+					word |= (uint64_t)(y[j] != v) << j;    \
+				break;                                         \
+			case VX_OP_GE:                                         \
+				for (size_t j = 0; j < k; j++)                 \
+					word |= (uint64_t)(y[j] >= v) << j;    \
+				break;                                         \
+			case VX_OP_GT:                                         \
+				for (size_t j = 0; j < k; j++)                 \
+					word |= (uint64_t)(y[j] > v) << j;     \
+				break;                                         \
+			}                                                      \
+			out[b / 64] = word;                                    \
+		}                                                              \
+	}                                                                      \
+                                                                               \
+	static size_t vx_table_filter_##suffix(                                \
+	    const type *x, uint32_t *sel, size_t n, enum vx_op op, type v)     \
+	{                                                                      \
+		size_t w = 0;                                                  \
+                                                                               \
+		switch (op) {                                                  \
+		case VX_OP_LT:                                                 \
+			for (size_t j = 0; j < n; j++) {                       \
+				sel[w]  = sel[j];                              \
+				w      += x[sel[j]] < v;                       \
+			}                                                      \
+			break;                                                 \
+		case VX_OP_LE:                                                 \
+			for (size_t j = 0; j < n; j++) {                       \
+				sel[w]  = sel[j];                              \
+				w      += x[sel[j]] <= v;                      \
+			}                                                      \
+			break;                                                 \
+		case VX_OP_EQ:                                                 \
+			for (size_t j = 0; j < n; j++) {                       \
+				sel[w]  = sel[j];                              \
+				w      += x[sel[j]] == v;                      \
+			}                                                      \
+			break;                                                 \
+		case VX_OP_NE:                                                 \
+			for (size_t j = 0; j < n; j++) {                       \
+				sel[w]  = sel[j];                              \
+				w      += x[sel[j]] != v;                      \
+			}                                                      \
+			break;                                                 \
+		case VX_OP_GE:                                                 \
+			for (size_t j = 0; j < n; j++) {                       \
+				sel[w]  = sel[j];                              \
+				w      += x[sel[j]] >= v;                      \
+			}                                                      \
+			break;                                                 \
+		case VX_OP_GT:                                                 \
+			for (size_t j = 0; j < n; j++) {                       \
+				sel[w]  = sel[j];                              \
+				w      += x[sel[j]] > v;                       \
+			}                                                      \
+			break;                                                 \
+		}                                                              \
+                                                                               \
+		return w;                                                      \
+	}
+
+VX_TABLE_DEFINE_(i32, int32_t)
+VX_TABLE_DEFINE_(u32, uint32_t)
+VX_TABLE_DEFINE_(i64, int64_t)
+VX_TABLE_DEFINE_(u64, uint64_t)
+VX_TABLE_DEFINE_(f64, double)
+
+// Evaluates the predicate over the 'n' values of 'column' into 'out', using
+// the SIMD kernel for whole words where available.
+static void vx_table_bits(const struct vx_column *column,
+                          size_t                  n,
+                          enum vx_op              op,
+                          const void             *value,
+                          uint64_t               *out)
+{
+	union {
+		int32_t  i32;
+		uint32_t u32;
+		int64_t  i64;
+		uint64_t u64;
+		double   f64;
+	} v;
+	const void *x    = column->data;
+	size_t      done = 0;
+
+	memcpy(&v, value, vx_table_unit(column->type));
+
+#ifdef VX_SIMD_X86
+	if (vx_simd_level() >= VX_SIMD_AVX2) {
+		switch (column->type) {
+		case VX_TYPE_I32:
+			done = vx_table_bits_avx2_32(
+			    (const uint32_t *)x, n, op, v.u32, 0, out);
+			break;
+		case VX_TYPE_U32:
+			done = vx_table_bits_avx2_32(
+			    (const uint32_t *)x, n, op, v.u32, 1u << 31, out);
+			break;
+		case VX_TYPE_I64:
+			done = vx_table_bits_avx2_64(
+			    (const uint64_t *)x, n, op, v.u64, 0, out);
+			break;
+		case VX_TYPE_U64:
+			done = vx_table_bits_avx2_64(
+			    (const uint64_t *)x, n, op, v.u64, 1ull << 63, out);
+			break;
+		case VX_TYPE_F64:
+			done = vx_table_bits_avx2_f64(
+			    (const double *)x, n, op, v.f64, out);
+			break;
+		}
+	}
+#endif
+
+	x    = (const unsigned char *)x + vx_table_unit(column->type) * done;
+	n   -= done;
+	out += done / 64;
+
+	switch (column->type) {
+	case VX_TYPE_I32:
+		vx_table_bits_i32((const int32_t *)x, n, op, v.i32, out);
+		break;
+	case VX_TYPE_U32:
+		vx_table_bits_u32((const uint32_t *)x, n, op, v.u32, out);
+		break;
+	case VX_TYPE_I64:
+		vx_table_bits_i64((const int64_t *)x, n, op, v.i64, out);
+		break;
+	case VX_TYPE_U64:
+		vx_table_bits_u64((const uint64_t *)x, n, op, v.u64, out);
+		break;
+	case VX_TYPE_F64:
+		vx_table_bits_f64((const double *)x, n, op, v.f64, out);
+		break;
+	}
+}
+
+uint64_t *vx_table_scan_bits(const struct vx_table *table,
+                             const char            *name,
+                             enum vx_op             op,
+                             const void            *value)
+{
+	const struct vx_column *column = vx_table_find(table, name);
+	if (!column) {
+		return NULL;
+	}
+
+	uint64_t *bits = vx_new(uint64_t, (table->rows + 63) / 64, NULL);
+	if (bits) {
+		vx_table_bits(column, table->rows, op, value, bits);
+	}
+
+	return bits;
+}
+
+uint32_t *vx_table_selection(const uint64_t *bits)
+{
+	size_t words = vx_tag_count(vx_tag(bits));
+	size_t count = 0;
+
+	for (size_t i = 0; i < words; i++) {
+		count += vx_table_popcount(bits[i]);
+	}
+
+	uint32_t *sel = vx_new(uint32_t, count, NULL);
+	if (!sel) {
+		return NULL;
+	}
+
+	size_t w = 0;
+	for (size_t i = 0; i < words; i++) {
+		for (uint64_t word = bits[i]; word; word &= word - 1) {
+			sel[w++] = (uint32_t)(64 * i + vx_table_ctz(word));
+		}
+	}
+
+	return sel;
+}
+
+uint32_t *vx_table_scan(const struct vx_table *table,
+                        const char            *name,
+                        enum vx_op             op,
+                        const void            *value)
+{
+	uint64_t *bits = vx_table_scan_bits(table, name, op, value);
+	if (!bits) {
+		return NULL;
+	}
+
+	uint32_t *sel = vx_table_selection(bits);
+	vx_free(bits);
+
+	return sel;
+}
+
+bool vx_table_filter(const struct vx_table *table,
+                     const char            *name,
+                     enum vx_op             op,
+                     const void            *value,
+                     uint32_t             **sel)
+{
+	const struct vx_column *column = vx_table_find(table, name);
+	if (!column) {
+		return false;
+	}
+
+	size_t n = vx_tag_count(vx_tag(*sel));
+	size_t w = 0;
+
+	switch (column->type) {
+	case VX_TYPE_I32: {
+		int32_t v;
+		memcpy(&v, value, sizeof(v));
+		w = vx_table_filter_i32(
+		    (const int32_t *)column->data, *sel, n, op, v);
+		break;
+	}
+	case VX_TYPE_U32: {
+		uint32_t v;
+		memcpy(&v, value, sizeof(v));
+		w = vx_table_filter_u32(
+		    (const uint32_t *)column->data, *sel, n, op, v);
+		break;
+	}
+	case VX_TYPE_I64: {
+		int64_t v;
+		memcpy(&v, value, sizeof(v));
+		w = vx_table_filter_i64(
+		    (const int64_t *)column->data, *sel, n, op, v);
+		break;
+	}
+	case VX_TYPE_U64: {
+		uint64_t v;
+		memcpy(&v, value, sizeof(v));
+		w = vx_table_filter_u64(
+		    (const uint64_t *)column->data, *sel, n, op, v);
+		break;
+	}
+	case VX_TYPE_F64: {
+		double v;
+		memcpy(&v, value, sizeof(v));
+		w = vx_table_filter_f64(
+		    (const double *)column->data, *sel, n, op, v);
+		break;
+	}
+	}
+
+	return w == n || vx_dedup_finish((void **)sel, w);
+}
+
+// Materialization
+// ===============
+
+static void *vx_table_gather_column(const struct vx_column *column,
+                                    const uint32_t         *sel)
+{
+	size_t n    = vx_tag_count(vx_tag(sel));
+	size_t unit = vx_table_unit(column->type);
+
+	void *out = vx_new_(unit, n, NULL);
+	if (!out) {
+		return NULL;
+	}
+
+	if (unit == 4) {
+		const uint32_t *src  = (const uint32_t *)column->data;
+		uint32_t       *dest = (uint32_t *)out;
+		for (size_t j = 0; j < n; j++) {
+			dest[j] = src[sel[j]];
+		}
+	} else {
+		const uint64_t *src  = (const uint64_t *)column->data;
+		uint64_t       *dest = (uint64_t *)out;
+		for (size_t j = 0; j < n; j++) {
+			dest[j] = src[sel[j]];
+		}
+	}
+
+	return out;
+}
+
+void *vx_table_gather(const struct vx_table *table,
+                      const char            *name,
+                      const uint32_t        *sel)
+{
+	const struct vx_column *column = vx_table_find(table, name);
+
+	return column ? vx_table_gather_column(column, sel) : NULL;
+}
+
+bool vx_table_materialize(const struct vx_table *table,
+                          const uint32_t        *sel,
+                          struct vx_table       *out)
+{
+	size_t n = vx_tag_count(vx_tag(table->columns));
+
+	if (!vx_table_init(out)) {
+		return false;
+	}
+
+	for (size_t c = 0; c < n; c++) {
+		const struct vx_column *column = &table->columns[c];
+
+		void *data = vx_table_gather_column(column, sel);
+		bool  ok   = data != NULL
+		        && vx_table_attach(
+		               out, column->name, column->type, data);
+		if (!ok) {
+			vx_free_(&data);
+			vx_table_free(out);
+			return false;
+		}
+	}
+	out->rows = vx_tag_count(vx_tag(sel));
+
+	return true;
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif